@@ -3,60 +3,253 @@
 #include <string>
 #include <mutex>
 #include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <istream>
+#include <fstream>
 #include <set>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <chrono>
+#include <type_traits>
 
+#if !defined(WAVEREAD_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define WAVEREAD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define WAVEREAD_TARGET_SSE2
+#define WAVEREAD_TARGET_AVX2
+#else
+#define WAVEREAD_TARGET_SSE2 __attribute__((target("sse2")))
+#define WAVEREAD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
-constexpr size_t WAV_HEADER_DEFAULT_SIZE = 44u;
+#if defined(__unix__) || defined(__APPLE__)
+#define WAVEREAD_POSIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(WAVEREAD_NO_MMAP) && defined(WAVEREAD_POSIX)
+#define WAVEREAD_MMAP
+#include <sys/mman.h>
+#endif
+
+#if defined(WAVEREAD_IO_URING) && defined(__linux__)
+#define WAVEREAD_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SANITIZE_THREAD__)
+#define WAVEREAD_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define WAVEREAD_TSAN
+#endif
+#endif
+#if defined(WAVEREAD_URING) && defined(WAVEREAD_TSAN)
+extern "C" void __tsan_acquire(void* address);
+extern "C" void __tsan_release(void* address);
+#define WAVEREAD_TSAN_RELEASE(address) __tsan_release(address) /* orders what ThreadSanitizer can't see pass through the kernel */
+#define WAVEREAD_TSAN_ACQUIRE(address) __tsan_acquire(address)
+#else
+#define WAVEREAD_TSAN_RELEASE(address) ((void)0)
+#define WAVEREAD_TSAN_ACQUIRE(address) ((void)0)
+#endif
+
+
+constexpr size_t WAV_HEADER_DEFAULT_SIZE = 44u; /*!< Size of the header of a file holding only the RIFF header, a 16-byte fmt chunk and the data chunk */
+constexpr uint16_t WAV_FORMAT_PCM = 0x0001u; /*!< Audio format code for uncompressed integer samples */
+constexpr uint16_t WAV_FORMAT_MS_ADPCM = 0x0002u; /*!< Audio format code for Microsoft ADPCM, 4 bits per sample in blocks */
+constexpr uint16_t WAV_FORMAT_IEEE_FLOAT = 0x0003u; /*!< Audio format code for 32 or 64-bit floating point samples */
+constexpr uint16_t WAV_FORMAT_ALAW = 0x0006u; /*!< Audio format code for 8-bit G.711 A-law samples */
+constexpr uint16_t WAV_FORMAT_MULAW = 0x0007u; /*!< Audio format code for 8-bit G.711 mu-law samples */
+constexpr uint16_t WAV_FORMAT_IMA_ADPCM = 0x0011u; /*!< Audio format code for IMA (DVI) ADPCM, 4 bits per sample in blocks */
+constexpr uint16_t WAV_FORMAT_EXTENSIBLE = 0xFFFEu; /*!< Audio format code for WAVE_FORMAT_EXTENSIBLE, where the format is given by the sub-format */
+//! Chunk of a RIFF file
+struct WAV_CHUNK
+{
+	char m_id[4]; /*!< Chunk ID */
+	uint64_t m_offset; /*!< Position of the chunk body in the file, after the ID and size */
+	uint64_t m_size; /*!< Size of the chunk body in bytes, from ds64 for RF64 files */
+};
 //! Wave header
 /*!
- Reads and stores the wave header in the same way it appears in the WAV file.
+ Reads and stores the wave header. The fields numbered by their offset are laid out as they appear in a file with no chunks other than fmt and data;
+ read() walks every chunk of the file to fill them, so other chunks may come first, and indexes the chunks it finds.
 */
 struct WAV_HEADER
 {
 	/*!
-	* Read the first 44 bytes of the input stream into the header.
+	* Walk the chunks of the input stream, filling the header from the fmt, fact, ds64 and data chunks, and indexing every chunk by its position.
+	* Each chunk header is read once, and chunk bodies other than these are skipped with seeks, so large files are opened without being read.
+	* RF64 (and BW64) files take their 64-bit sizes from the ds64 chunk.
+	* \param rewind seek to the start of the stream first, and index the chunks after the data chunk too. Pass false to read from the current position of a stream that can't seek:
+	* chunks before the data chunk are read past, and the stream is left at the start of the data.
+	* \return true if a fmt chunk and a data chunk were found.
 	*/
-	bool read(std::istream& s)
+	bool read(std::istream& s, bool rewind = true)
 	{
-		if (s.good())
-		{
+		clear();
+		if (!s.good())
+			return false;
+		if (rewind)
 			s.seekg(0u);
-			s.read(&m_0_headerChunkID[0], 4);
-			s.read((char*)&m_4_chunkSize, 4);
-			s.read(&m_8_format[0], 4);
-			s.read(&m_12_subchunk1ID[0], 4);
-			s.read((char*)&m_16_subchunk1Size, 4);
-			s.read((char*)&m_20_audioFormat, 2);
-			s.read((char*)&m_22_numChannels, 2);
-			s.read((char*)&m_24_sampleRate, 4);
-			s.read((char*)&m_28_byteRate, 4);
-			s.read((char*)&m_32_bytesPerBlock, 2);
-			s.read((char*)&m_34_bitsPerSample, 2);
-			s.read(&m_36_dataSubchunkID[0], 4);
-			s.read((char*)&m_40_dataSubchunkSize, 4);
+		uint64_t pos{ 12u }; // position of the next chunk
+		s.read(&m_0_headerChunkID[0], 4);
+		s.read((char*)&m_4_chunkSize, 4);
+		s.read(&m_8_format[0], 4);
+		bool rf64{ id(m_0_headerChunkID, "RF64") || id(m_0_headerChunkID, "BW64") };
+		uint64_t ds64DataSize{ 0u };
+		bool fmt{ false };
+		while (s.good())
+		{
+			WAV_CHUNK chunk{};
+			uint32_t size{ 0u };
+			s.read(&chunk.m_id[0], 4);
+			s.read((char*)&size, 4);
+			if (!s.good())
+				break;
+			chunk.m_offset = pos + 8u;
+			chunk.m_size = size;
+			uint64_t consumed{ 0u }; // bytes of the body read while parsing it
+			if (id(chunk.m_id, "fmt ") && size >= 16u)
+			{
+				std::copy(chunk.m_id, chunk.m_id + 4, m_12_subchunk1ID);
+				m_16_subchunk1Size = (int16_t)std::min<uint32_t>(size, INT16_MAX); // for display: fmt chunks of 32KB or more don't fit, and the indexed chunk keeps the size
+				s.read((char*)&m_20_audioFormat, 2);
+				s.read((char*)&m_22_numChannels, 2);
+				s.read((char*)&m_24_sampleRate, 4);
+				s.read((char*)&m_28_byteRate, 4);
+				s.read((char*)&m_32_bytesPerBlock, 2);
+				s.read((char*)&m_34_bitsPerSample, 2);
+				consumed = 16u;
+				if (size >= 40u && (uint16_t)m_20_audioFormat == WAV_FORMAT_EXTENSIBLE)
+				{
+					uint16_t extensionSize{ 0u };
+					s.read((char*)&extensionSize, 2);
+					s.read((char*)&m_validBitsPerSample, 2);
+					s.read((char*)&m_channelMask, 4);
+					s.read((char*)&m_subFormat, 2); // the first two bytes of the sub-format GUID are the format code
+					consumed = 26u;
+				}
+				else if (size >= 20u && ((uint16_t)m_20_audioFormat == WAV_FORMAT_MS_ADPCM || (uint16_t)m_20_audioFormat == WAV_FORMAT_IMA_ADPCM))
+				{
+					uint16_t extensionSize{ 0u };
+					s.read((char*)&extensionSize, 2);
+					s.read((char*)&m_samplesPerBlock, 2);
+					consumed = 20u;
+					uint16_t coefficients{ 0u };
+					if ((uint16_t)m_20_audioFormat == WAV_FORMAT_MS_ADPCM && size >= 22u)
+					{
+						s.read((char*)&coefficients, 2);
+						consumed = 22u;
+					}
+					for (uint16_t i{ 0u }; i < coefficients && consumed + 4u <= size; ++i, consumed += 4u) // pairs of predictor coefficients
+					{
+						int16_t pair[2]{};
+						s.read((char*)pair, 4);
+						m_coefficients.push_back(pair[0]);
+						m_coefficients.push_back(pair[1]);
+					}
+				}
+				fmt = true;
+			}
+			else if (id(chunk.m_id, "ds64") && size >= 24u)
+			{
+				uint64_t riffSize{ 0u };
+				s.read((char*)&riffSize, 8);
+				s.read((char*)&ds64DataSize, 8);
+				s.read((char*)&m_factSamples, 8);
+				consumed = 24u;
+			}
+			else if (id(chunk.m_id, "fact") && size >= 4u && m_factSamples == 0u)
+			{
+				uint32_t factSamples{ 0u };
+				s.read((char*)&factSamples, 4);
+				m_factSamples = factSamples;
+				consumed = 4u;
+			}
+			else if (id(chunk.m_id, "data"))
+			{
+				std::copy(chunk.m_id, chunk.m_id + 4, m_36_dataSubchunkID);
+				m_40_dataSubchunkSize = (int32_t)size;
+				if (rf64 && size == 0xFFFFFFFFu)
+					chunk.m_size = ds64DataSize;
+				m_dataOffset = chunk.m_offset;
+				m_dataSize = chunk.m_size;
+			}
+			m_chunks.push_back(chunk);
+			if (m_dataOffset != 0u && !rewind)
+				break; // leave a forward-only stream at the start of the data
+			pos = chunk.m_offset + chunk.m_size + (chunk.m_size & 1u); // chunks are padded to an even size
+			if (rewind)
+				s.seekg((std::streamoff)pos);
+			else
+				s.ignore((std::streamsize)(pos - chunk.m_offset - consumed));
 		}
-		return s.good();
+		if (rewind)
+			s.clear(); // clear eof from walking off the end, so the stream can be read again
+		return fmt && m_dataOffset != 0u;
 	}
 	/*!
 	* Checks whether the header is in a format that can be read by waveread
 	*/
 	bool valid() const
 	{
-		return (std::string{ &m_0_headerChunkID[0],4u } == std::string{ "RIFF" }) && // RIFF 
-			std::string{ &m_8_format[0],4u } == std::string{ "WAVE" } && // WAVE format
-			m_16_subchunk1Size == 16 &&// PCM, with no extra parameters in file
-			m_20_audioFormat == 1 && // uncompressed
-			m_32_bytesPerBlock == (m_22_numChannels * (m_34_bitsPerSample / 8)) && // block align matches # channels and bit depth
+		return (id(m_0_headerChunkID, "RIFF") || id(m_0_headerChunkID, "RF64") || id(m_0_headerChunkID, "BW64")) && // RIFF, or RIFF with 64-bit sizes
+			id(m_8_format, "WAVE") && // WAVE format
+			std::any_of(m_chunks.begin(), m_chunks.end(), [](const WAV_CHUNK& c) { return id(c.m_id, "fmt ") && c.m_size >= 16u; }) && // fmt chunk, possibly with extra parameters
+			m_dataOffset != 0u && // data chunk found
+			m_22_numChannels > 0 &&
+			(
+				compressed() ? adpcm() :
+				m_32_bytesPerBlock == (m_22_numChannels * (m_34_bitsPerSample / 8)) // block align matches # channels and bit depth
+				) &&
 			(
-				(m_34_bitsPerSample == 8) ||
-				(m_34_bitsPerSample == 16) ||
-				(m_34_bitsPerSample == 24) ||
-				(m_34_bitsPerSample == 32) // available bit depths
+				compressed() ||
+				(format() == WAV_FORMAT_PCM && // uncompressed integers
+					(
+						(m_34_bitsPerSample == 8) ||
+						(m_34_bitsPerSample == 16) ||
+						(m_34_bitsPerSample == 24) ||
+						(m_34_bitsPerSample == 32) // available bit depths
+						)) ||
+				(format() == WAV_FORMAT_IEEE_FLOAT && // floating point
+					(
+						(m_34_bitsPerSample == 32) ||
+						(m_34_bitsPerSample == 64)
+						)) ||
+				((format() == WAV_FORMAT_ALAW || format() == WAV_FORMAT_MULAW) && m_34_bitsPerSample == 8) // G.711 companded
 				);
 	}
 	/*!
+	* Audio format code of the samples: the sub-format for WAVE_FORMAT_EXTENSIBLE, otherwise the audio format.
+	*/
+	uint16_t format() const { return (uint16_t)m_20_audioFormat == WAV_FORMAT_EXTENSIBLE ? m_subFormat : (uint16_t)m_20_audioFormat; }
+	/*!
+	* Is the audio ADPCM, coded in blocks of m_samplesPerBlock frames, each m_32_bytesPerBlock bytes long and decodable on its own?
+	*/
+	bool compressed() const { return format() == WAV_FORMAT_MS_ADPCM || format() == WAV_FORMAT_IMA_ADPCM; }
+	/*!
 	* Clear all data in the header setting values to 0 or "nil\0"
 	*/
 	void clear()
@@ -80,18 +273,63 @@ struct WAV_HEADER
 		m_34_bitsPerSample = 0;
 		cpy(none, m_36_dataSubchunkID);
 		m_40_dataSubchunkSize = 0;
+		m_validBitsPerSample = 0u;
+		m_channelMask = 0u;
+		m_subFormat = 0u;
+		m_dataOffset = 0u;
+		m_dataSize = 0u;
+		m_factSamples = 0u;
+		m_samplesPerBlock = 0u;
+		m_coefficients.clear();
+		m_chunks.clear();
 	}
 	/*!
 	* Samples per channel
 	*/
-	int samples() const { return (m_40_dataSubchunkSize / ((m_22_numChannels * m_34_bitsPerSample) / 8)); }
+	size_t samples() const { return samples(m_dataSize); }
+	/*!
+	* Samples per channel held in the first bytes of the data chunk. For ADPCM, this counts the samples of a short final block,
+	* and is limited to the length given by the fact chunk, since the final block is usually padded.
+	*/
+	size_t samples(uint64_t bytes) const
+	{
+		if (m_32_bytesPerBlock <= 0)
+			return 0u;
+		if (!compressed())
+			return (size_t)(bytes / (uint64_t)m_32_bytesPerBlock);
+		uint64_t frames{ bytes / (uint64_t)m_32_bytesPerBlock * m_samplesPerBlock + blockSamples((size_t)(bytes % (uint64_t)m_32_bytesPerBlock)) };
+		return (size_t)(m_factSamples != 0u ? std::min(frames, m_factSamples) : frames);
+	}
+	/*!
+	* Samples per channel in an ADPCM block of a number of bytes: m_samplesPerBlock for a whole block, fewer for one cut short at the end of the data.
+	*/
+	size_t blockSamples(size_t bytes) const
+	{
+		size_t channels{ (size_t)m_22_numChannels }, preamble{ (format() == WAV_FORMAT_IMA_ADPCM ? 4u : 7u) * channels };
+		if (!compressed() || channels == 0u || bytes < preamble)
+			return 0u;
+		size_t frames{ format() == WAV_FORMAT_IMA_ADPCM ?
+			1u + (bytes - preamble) / (4u * channels) * 8u : // the header's sample, then runs of eight samples in four bytes per channel
+			2u + (bytes - preamble) * 2u / channels }; // the header's two samples, then a nibble per sample
+		return std::min(frames, (size_t)m_samplesPerBlock);
+	}
+	/*!
+	* Find a chunk by its ID, such as "LIST". Returns nullptr if the file has no such chunk.
+	*/
+	const WAV_CHUNK* chunk(const char* chunkID) const
+	{
+		for (const WAV_CHUNK& c : m_chunks)
+			if (id(c.m_id, chunkID))
+				return &c;
+		return nullptr;
+	}
 
 	char m_0_headerChunkID[4]; /*!< Header chunk ID */
 	int32_t m_4_chunkSize; /*!< Chunk size*/
 	char m_8_format[4]; /*!< Format */
 
 	char m_12_subchunk1ID[4]; /*!< Subchunk ID */
-	int16_t m_16_subchunk1Size; /*!< Subchunk size*/
+	int16_t m_16_subchunk1Size; /*!< Subchunk size, up to INT16_MAX: the size of the fmt chunk as indexed in m_chunks is the one to rely on */
 
 	int16_t m_20_audioFormat; /*!< Audio format */
 	int16_t m_22_numChannels; /*!< Number of channels*/
@@ -100,381 +338,4258 @@ struct WAV_HEADER
 	int16_t m_32_bytesPerBlock; /*!< Number of bytes per block (where a block is a single sample from each channel)*/
 	int16_t m_34_bitsPerSample; /*!< Bits per sample */
 
-	char m_36_dataSubchunkID[4]; /*!< Detailed description after the member */
-	int32_t m_40_dataSubchunkSize; /*!< Detailed description after the member */
+	char m_36_dataSubchunkID[4]; /*!< Data chunk ID */
+	int32_t m_40_dataSubchunkSize; /*!< Data chunk size, as it appears in the file. See m_dataSize. */
+
+	uint16_t m_validBitsPerSample; /*!< WAVE_FORMAT_EXTENSIBLE: bits of each sample that are used */
+	uint32_t m_channelMask; /*!< WAVE_FORMAT_EXTENSIBLE: speaker position of each channel */
+	uint16_t m_subFormat; /*!< WAVE_FORMAT_EXTENSIBLE: audio format code of the samples */
+	uint64_t m_dataOffset; /*!< Position of the audio data in the file */
+	uint64_t m_dataSize; /*!< Size of the audio data in bytes, from ds64 for RF64 files */
+	uint64_t m_factSamples; /*!< Samples per channel given by the fact or ds64 chunk, or 0 if there is none */
+	uint16_t m_samplesPerBlock; /*!< ADPCM: samples per channel in each block */
+	std::vector<int16_t> m_coefficients; /*!< MS ADPCM: pairs of predictor coefficients, in 8.8 fixed point */
+	std::vector<WAV_CHUNK> m_chunks; /*!< Every chunk in the file, in file order */
+
+private:
+	//! Is the ADPCM block layout consistent? The block align must leave whole runs of samples after each block's header, and give the samples per block that the fmt chunk states.
+	bool adpcm() const
+	{
+		size_t channels{ (size_t)m_22_numChannels }, align{ m_32_bytesPerBlock > 0 ? (size_t)m_32_bytesPerBlock : 0u };
+		if (m_34_bitsPerSample != 4 || m_samplesPerBlock == 0u)
+			return false;
+		if (format() == WAV_FORMAT_IMA_ADPCM)
+			return align > 4u * channels && align % (4u * channels) == 0u && m_samplesPerBlock == blockSamples(align);
+		return align > 7u * channels && m_samplesPerBlock == blockSamples(align) && m_coefficients.size() >= 14u; // MS ADPCM has at least the seven standard predictors
+	}
+	//! Does a four character chunk ID match?
+	static bool id(const char* chunkID, const char* expected) { return std::equal(chunkID, chunkID + 4, expected); }
+};
+
+constexpr char WAV_OVERVIEW_MAGIC[5] = "WRPK"; /*!< Identifies an overview written by Waveread::saveOverview() */
+constexpr uint32_t WAV_OVERVIEW_VERSION = 2u; /*!< Layout of a saved overview: version 2 keeps sums of squares as doubles */
+constexpr size_t WAV_OVERVIEW_BLOCK_SIZE = 256u; /*!< Number of frames summarised by each entry in the finest level of an overview */
+//! Summary of a range of samples from one channel, for drawing a waveform overview
+struct WAV_PEAK
+{
+	float min; /*!< Lowest sample */
+	float max; /*!< Highest sample */
+	float rms; /*!< Root mean square of the samples */
+};
+
+//! Range of samples, see Waveread::readBatch()
+struct WAV_RANGE
+{
+	size_t startSample; /*!< Index of first sample */
+	size_t sampleCount; /*!< Number of samples including first sample */
 };
-static_assert(sizeof(WAV_HEADER) == WAV_HEADER_DEFAULT_SIZE, "WAV File header is not the expected size.");
 
-//! Wave reader
+//! Access pattern hint for memory-mapped readers, see Waveread(const std::string&, WAV_ACCESS).
+enum class WAV_ACCESS
+{
+	normal, /*!< No particular pattern */
+	sequential, /*!< Audio is read from start to end, e.g. playback: the kernel reads ahead aggressively */
+	random /*!< Audio is read from scattered positions, e.g. scrubbing: the kernel reads only what is touched */
+};
+
+//! Ways of reading from a Waveread, whose cache hits and misses WAV_STATS counts separately
+enum class WAV_CALL : size_t
+{
+	vector, /*!< audio() returning a std::vector */
+	buffer, /*!< audio() into a float buffer */
+	typed, /*!< audio() into an integer or double buffer, or a buffer for each channel, and mix() */
+	batch, /*!< readBatch(), for ranges it found cached */
+	count /*!< Number of ways */
+};
+
+//! Counters of a Waveread, see Waveread::stats(). They are only kept if WAVEREAD_STATS is defined; otherwise they are all zero.
+struct WAV_STATS
+{
+	static const size_t leadBuckets{ 12u }; /*!< Number of buckets in prefetchLead */
+
+	size_t hits[(size_t)WAV_CALL::count]; /*!< Pages found cached, for each way of reading */
+	size_t misses[(size_t)WAV_CALL::count]; /*!< Pages read on demand, for each way of reading */
+	uint64_t bytesRead; /*!< Bytes read from the stream: pages, and spans read by readBatch() or a thread pool */
+	size_t loads; /*!< Pages read into the cache on demand */
+	size_t prefetchLoads; /*!< Pages read into the cache by the prefetch thread */
+	uint64_t lockWaitNanoseconds; /*!< Time that readers waited for the cache lock */
+	uint64_t lockHeldNanoseconds; /*!< Time that readers held the cache lock, looking up and decoding pages */
+	uint64_t loadNanoseconds; /*!< Time that readers spent reading pages on demand, including waiting for the stream */
+	size_t prefetchWasted; /*!< Prefetched pages evicted before anything read them */
+	size_t ringFallbacks; /*!< Pages read from the stream because their read through a Wavering failed or fell short, even when retried */
+	size_t ringStopped; /*!< 1 once an error that can't go away, such as O_DIRECT alignment being refused, has stopped the reader using its Wavering */
+	/*! Prefetched pages, by how long before they were first read they arrived. [0]: late, the page was needed while the prefetch thread was still reading it;
+	    [1]: under 1ms early; [k]: under 2^(k-1)ms early; [leadBuckets - 1]: longer. */
+	size_t prefetchLead[leadBuckets];
+};
+
+//! Span of time in a Waveread, handed to the callback set by Waveread::setTrace()
+struct WAV_SPAN
+{
+	const char* name; /*!< "audio": a call of audio(); "wait": waiting for the cache lock; "load": reading a page on demand; "prefetch": the prefetch thread reading a page; "read": a span read by readBatch() or a thread pool */
+	std::chrono::steady_clock::time_point start; /*!< When the span began */
+	std::chrono::steady_clock::duration duration; /*!< How long it took */
+	uint64_t offset; /*!< Position in the data chunk, in bytes, of the audio concerned */
+	uint64_t bytes; /*!< Number of bytes of audio concerned */
+};
+
+//! Implementation details of Waveread
 /*!
-  Reads audio from an input stream.
+ Sample conversion kernels: each bit depth has a scalar kernel and, on x86, SSE2 and AVX2 kernels chosen at runtime. All kernels produce bit-identical results:
+ the vector kernels convert the same integers to float and scale by the same power of two as the scalar ones. 32-bit float samples are copied, and 64-bit float
+ samples are rounded to float by the same conversion instruction in every kernel. Define WAVEREAD_NO_SIMD to build with the scalar kernels only.
+
+ Memory mapping, on POSIX systems. Define WAVEREAD_NO_MMAP to read files through std::ifstream instead.
 */
-class Waveread
+namespace waveread_detail
 {
-public:
-	//! Constructor
-	/*!
-	* \param stream the input stream
-	* \param cacheSize the size of the cache. This should usually be a reasonable multiple of the size of the set of samples you expect to read each time you call audio().
-	* \param cacheExtensionThreshold Within interval [0,1]. When a caller gets audio, how far into the cache should the caller go before the cache is triggered to be extended?
-	*/
-	Waveread(
-		std::unique_ptr<std::istream>&& stream,
-		size_t cacheSize = 1048576u,
-		double cacheExtensionThreshold = 0.5
-	)
-		:
-		m_stream{ stream.release() },
-		m_header{},
-		m_data{},
-		m_dataMutex{},
-		m_cachePos{ 0u },
-		m_opened{ false },
-		m_cacheSize{ cacheSize }, // 1MB == 1048576u
-		m_cacheExtensionThreshold{ cacheExtensionThreshold }
+	//! Instruction sets available to the conversion kernels, in increasing order of preference.
+	enum class Simd { none, sse2, avx2 };
+
+	//! Which instruction set does this CPU support? Detected once.
+	inline Simd simdSupported()
 	{
-		if (m_cacheExtensionThreshold < 0.0)
-			m_cacheExtensionThreshold = 0.0;
-		else if (m_cacheExtensionThreshold > 1.0)
-			m_cacheExtensionThreshold = 1.0;
+#if defined(WAVEREAD_X86)
+		static const Simd supported{ []() {
+#if defined(_MSC_VER)
+			int info[4]{};
+			__cpuid(info, 0);
+			int ids{ info[0] };
+			__cpuid(info, 1);
+			bool sse2{ (info[3] & (1 << 26)) != 0 };
+			bool osAvx{ (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6 }; // OSXSAVE, AVX, and the OS saves ymm state
+			bool avx2{ false };
+			if (osAvx && ids >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+			return avx2 ? Simd::avx2 : sse2 ? Simd::sse2 : Simd::none;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2") ? Simd::avx2 : __builtin_cpu_supports("sse2") ? Simd::sse2 : Simd::none;
+#endif
+		}() };
+		return supported;
+#else
+		return Simd::none;
+#endif
+	}
 
-		m_header.clear();
+	// NOTE: (a) see narrow_cast<T>(var) (b) addition defined in C++ as: T operator+(const T &a, const T2 &b);
+	// EXCEPTIONS: Integer types smaller than int are promoted when an operation is performed on them.
+	inline float pcm8(const uint8_t* s) // unsigned 8-bit
+	{
+		return (float)
+			(s[0] - 128)  // unsigned, so offset by 2^7
+			/ (128.f); // divide by 2^7
+	}
+	inline float pcm16(const uint8_t* s) // signed 16-bit
+	{
+		return (float)
+			(int16_t)((s[0]) |
+				(s[1] << 8)) // narrow so that the sign bit is extended
+			/ (32768.f); // divide by 2^15
+	}
+	inline float pcm24(const uint8_t* s) // signed 24-bit
+	{
+		// 24-bit is different to others: put the value into a 32-bit int with zeros at the (LSB) end
+		return (float)
+			(int32_t)(((uint32_t)s[0] << 8) |
+				((uint32_t)s[1] << 16) |
+				((uint32_t)s[2] << 24))
+			/ (2147483648.f); // divide by 2^31
+	}
+	inline float pcm32(const uint8_t* s) // signed 32-bit
+	{
+		return (float)
+			(int32_t)((uint32_t)s[0] |
+				((uint32_t)s[1] << 8) |
+				((uint32_t)s[2] << 16) |
+				((uint32_t)s[3] << 24))
+			/ (2147483648.f);  // signed, so divide by 2^31
+	}
+	inline float ieee32(const uint8_t* s) // 32-bit float, copied as the data needn't be aligned
+	{
+		float v;
+		std::memcpy(&v, s, 4u);
+		return v;
+	}
+	inline float ieee64(const uint8_t* s) // 64-bit float, rounded to the nearest float
+	{
+		double v;
+		std::memcpy(&v, s, 8u);
+		return (float)v;
 	}
 
-	Waveread(const Waveread&) = delete;
-	Waveread& operator=(const Waveread&) = delete;
+	//! Convert count contiguous samples from src to dst, one at a time.
+	template<float(*Convert)(const uint8_t*), size_t Bytes>
+	void scalar(const uint8_t* src, float* dst, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i, src += Bytes)
+			dst[i] = Convert(src);
+	}
+	//! 32-bit float samples are already in the output format.
+	inline void ieee32_copy(const uint8_t* src, float* dst, size_t count)
+	{
+		std::memcpy(dst, src, count * 4u);
+	}
 
-	//! Move Constructor
-	/*!
-	* \param other	Another waveread object. The move constructor enables the placement of waveread objects in containers using std::move().
-	*				For instance you can do:
-	*				Waveread a{stream};
-	*				std::vector<Waveread> readers;
-	*				readers.push_back(std::move(a))
-	*				a is now unusable, but the vector now contains the wavereader.
-	*/
-	Waveread(Waveread&& other) noexcept
-		:
-		m_stream{ },
-		m_header{ },
-		m_data{ },
-		m_dataMutex{},
-		m_cachePos{ other.m_cachePos },
-		m_opened{ other.m_opened },
-		m_cacheSize{ other.m_cacheSize },
-		m_cacheExtensionThreshold{ other.m_cacheExtensionThreshold }
+#if defined(WAVEREAD_X86)
+	WAVEREAD_TARGET_SSE2 inline void pcm8_sse2(const uint8_t* src, float* dst, size_t count)
 	{
-		std::lock_guard<std::mutex> l{ other.m_dataMutex };
-		m_data = other.m_data;
-		m_header = other.m_header;
-		m_stream.reset(other.m_stream.release());
+		const __m128i zero{ _mm_setzero_si128() }, offset{ _mm_set1_epi16(128) };
+		const __m128 scale{ _mm_set1_ps(1.f / 128.f) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			__m128i v{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)) };
+			__m128i lo{ _mm_sub_epi16(_mm_unpacklo_epi8(v, zero), offset) }, hi{ _mm_sub_epi16(_mm_unpackhi_epi8(v, zero), offset) };
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), scale));
+			_mm_storeu_ps(dst + i + 4u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), scale));
+			_mm_storeu_ps(dst + i + 8u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), scale));
+			_mm_storeu_ps(dst + i + 12u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), scale));
+		}
+		scalar<&pcm8, 1u>(src + i, dst + i, count - i);
 	}
-	//! Reset
-	/*!
-	* Resets the wavereader, clearing all data.
-	* \param stream a new std::istream to read a wave file from.
-	*/
-	void reset(std::unique_ptr<std::istream>&& stream)
+	WAVEREAD_TARGET_SSE2 inline void pcm16_sse2(const uint8_t* src, float* dst, size_t count)
 	{
-		std::lock_guard<std::mutex> lock{ m_dataMutex };
-		m_stream = std::move(stream);
-		m_data.clear();
-		m_header.clear();
-		m_cachePos = 0u;
-		m_opened = false;
+		const __m128 scale{ _mm_set1_ps(1.f / 32768.f) };
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			__m128i v{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2u)) };
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), scale));
+			_mm_storeu_ps(dst + i + 4u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), scale));
+		}
+		scalar<&pcm16, 2u>(src + i * 2u, dst + i, count - i);
 	}
-	//! Open
-	/*!
-	* Loads the wave header from file, and fills the cache from the start.
-	*/
-	bool open()
+	WAVEREAD_TARGET_SSE2 inline void pcm24_sse2(const uint8_t* src, float* dst, size_t count)
 	{
-		if (!m_opened)
+		// Four samples from one 16-byte load: sample k occupies bytes [3k,3k+2], and shifting the register left by k+1 bytes
+		// moves it to bytes [4k+1,4k+3], the top of 32-bit lane k. Then mask each shifted copy down to its own lane.
+		const __m128i m0{ _mm_set_epi32(0, 0, 0, -256) }, m1{ _mm_set_epi32(0, 0, -256, 0) }, m2{ _mm_set_epi32(0, -256, 0, 0) }, m3{ _mm_set_epi32(-256, 0, 0, 0) };
+		const __m128 scale{ _mm_set1_ps(1.f / 2147483648.f) };
+		size_t i{ 0u };
+		for (; i + 6u <= count; i += 4u) // 6 samples remaining (18 bytes) means the 16-byte load stays in bounds
 		{
-			m_header.read(*m_stream.operator->());
-			if (m_header.valid())
-			{
-				m_opened = true;
-				load(0u, m_cacheSize);
-				return true;
-			}
-			else
-				return false; // we couldn't open it
+			__m128i v{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3u)) };
+			__m128i x{ _mm_or_si128(
+				_mm_or_si128(_mm_and_si128(_mm_slli_si128(v, 1), m0), _mm_and_si128(_mm_slli_si128(v, 2), m1)),
+				_mm_or_si128(_mm_and_si128(_mm_slli_si128(v, 3), m2), _mm_and_si128(_mm_slli_si128(v, 4), m3))) };
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
 		}
-		return true; // we didn't open it, but it was already opened.
+		scalar<&pcm24, 3u>(src + i * 3u, dst + i, count - i);
 	}
-	//! Close
-	/*!
-	* Closes the wavereader.
-	*/
-	void close()
+	WAVEREAD_TARGET_SSE2 inline void pcm32_sse2(const uint8_t* src, float* dst, size_t count)
 	{
-		std::lock_guard<std::mutex> lock{ m_dataMutex };
-		m_stream->seekg(0u);
-		m_data.clear();
-		m_header.clear();
-		m_cachePos = 0u;
-		m_opened = false;
+		const __m128 scale{ _mm_set1_ps(1.f / 2147483648.f) };
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4u))), scale));
+			_mm_storeu_ps(dst + i + 4u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4u + 16u))), scale));
+		}
+		scalar<&pcm32, 4u>(src + i * 4u, dst + i, count - i);
 	}
-	//! Audio
-	/*!
-	* Get interleaved floating point audio samples in the interval (-1.f,1.f).
-	* \param startSample index of first sample desired
-	* \param sampleCount number of samples needed including first sample
-	* \param channels Which channels would you like to retrieve. Zero-indexed. If channels are out of bounds, then their modulus with the channel count will be taken. This means if you ask for channels {0,1} from a mono file, you will retrieve two copies of the mono channel, interleaved.
-	* \param stride for each channel, when getting samples, skip every n samples where n == stride.
-	* \param interleaved determines how samples are ordered: true provides {C1S1, C2S1, ..., CMS1, C1S2, C2S2, ..., CMS2} false provides {C1S1, C1S2, ..., C1SN, C2S1, C2S2, ..., C2S2, ...}
-	*/
-	std::vector<float> audio(
-		size_t startSample, 
-		size_t sampleCount, 
-		std::set<int> channels = std::set<int>{ 0,1 }, 
-		size_t stride = 0u, 
-		bool interleaved = true
-	)
+	WAVEREAD_TARGET_SSE2 inline void ieee64_sse2(const uint8_t* src, float* dst, size_t count)
 	{
-		if (!open())
-			return std::vector<float>{};
-
-		size_t startSample_ch_bit{ startSample * m_header.m_32_bytesPerBlock };
-		size_t sampleCount_ch_bit{ sampleCount * m_header.m_32_bytesPerBlock };
+		size_t i{ 0u };
+		for (; i + 4u <= count; i += 4u)
+		{
+			__m128 lo{ _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(src + i * 8u))) }, hi{ _mm_cvtpd_ps(_mm_loadu_pd(reinterpret_cast<const double*>(src + i * 8u + 16u))) };
+			_mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+		}
+		scalar<&ieee64, 8u>(src + i * 8u, dst + i, count - i);
+	}
 
-		if ((startSample_ch_bit + sampleCount_ch_bit) >= (size_t)m_header.m_40_dataSubchunkSize)	// case1: out of bounds of file
+	WAVEREAD_TARGET_AVX2 inline void pcm8_avx2(const uint8_t* src, float* dst, size_t count)
+	{
+		const __m256i offset{ _mm256_set1_epi32(128) };
+		const __m256 scale{ _mm256_set1_ps(1.f / 128.f) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
 		{
-			if (startSample_ch_bit >= (size_t)m_header.m_40_dataSubchunkSize)						// case1A: read starts out of bounds
-				return std::vector<float>{};
-			else																					// case1B: read starts within bounds, ends out of bounds
-			{
-				load(startSample_ch_bit, m_header.m_40_dataSubchunkSize - startSample_ch_bit);
-				return samples(0u, m_header.m_40_dataSubchunkSize - startSample_ch_bit, channels, stride, interleaved);
-			}
+			__m128i v{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)) };
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(v), offset)), scale));
+			_mm256_storeu_ps(dst + i + 8u, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_unpackhi_epi64(v, v)), offset)), scale));
 		}
-		else if (startSample_ch_bit >= m_cachePos &&
-			(startSample_ch_bit + sampleCount_ch_bit) <= (m_cachePos + m_data.size()))				// case2: within cache
+		scalar<&pcm8, 1u>(src + i, dst + i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void pcm16_avx2(const uint8_t* src, float* dst, size_t count)
+	{
+		const __m256 scale{ _mm256_set1_ps(1.f / 32768.f) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
 		{
-			std::vector<float> result{ samples(startSample_ch_bit - m_cachePos, sampleCount_ch_bit, channels, stride,interleaved) };
-			if (startSample_ch_bit > (m_cachePos + (size_t)(m_data.size() * 0.5)))					// case2A: approaching end of cache
-			{
-				std::thread extendBuffer{ &Waveread::load,this,m_cachePos + (size_t)(m_cacheSize * 0.5), m_cacheSize };
-				extendBuffer.detach();
-			}
-			return result;
+			__m128i lo{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2u)) }, hi{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2u + 16u)) };
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lo)), scale));
+			_mm256_storeu_ps(dst + i + 8u, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(hi)), scale));
 		}
-		else																						// case3: within file, outside of cache
+		scalar<&pcm16, 2u>(src + i * 2u, dst + i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void pcm24_avx2(const uint8_t* src, float* dst, size_t count)
+	{
+		// Eight samples per iteration: four from each 128-bit lane, each shuffled into the top three bytes of a 32-bit lane.
+		const __m256i shuffle{ _mm256_setr_epi8(
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+			-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11) };
+		const __m256 scale{ _mm256_set1_ps(1.f / 2147483648.f) };
+		size_t i{ 0u };
+		for (; i + 10u <= count; i += 8u) // 10 samples remaining (30 bytes) means the upper 16-byte load, at byte 12, stays in bounds
 		{
-			if (load(startSample_ch_bit, m_cacheSize > sampleCount_ch_bit ? m_cacheSize : sampleCount_ch_bit)) // load samplecount or cachesize, whichever is greater.
-				return samples(0u, sampleCount_ch_bit, channels, stride, interleaved);
-			else
-				return std::vector<float>{};
+			const uint8_t* p{ src + i * 3u };
+			__m256i v{ _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12u)), 1) };
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_shuffle_epi8(v, shuffle)), scale));
 		}
+		scalar<&pcm24, 3u>(src + i * 3u, dst + i, count - i);
 	}
+	WAVEREAD_TARGET_AVX2 inline void pcm32_avx2(const uint8_t* src, float* dst, size_t count)
+	{
+		const __m256 scale{ _mm256_set1_ps(1.f / 2147483648.f) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4u))), scale));
+			_mm256_storeu_ps(dst + i + 8u, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4u + 32u))), scale));
+		}
+		scalar<&pcm32, 4u>(src + i * 4u, dst + i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void ieee64_avx2(const uint8_t* src, float* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			__m128 lo{ _mm256_cvtpd_ps(_mm256_loadu_pd(reinterpret_cast<const double*>(src + i * 8u))) }, hi{ _mm256_cvtpd_ps(_mm256_loadu_pd(reinterpret_cast<const double*>(src + i * 8u + 32u))) };
+			_mm256_storeu_ps(dst + i, _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+		}
+		scalar<&ieee64, 8u>(src + i * 8u, dst + i, count - i);
+	}
+#endif
 
-	//! Get header file
-	const WAV_HEADER& header() const { return m_header; }
-	//! Get size of cache
-	const size_t& cacheSize() const { return m_cacheSize; }
-	//! Get start position of cache
-	const size_t& cachePos() const { return m_cachePos; }
-	//! Has the file been opened
-	const bool& opened() const { return m_opened; }
-	//! Get cache extension threshold: this is the fraction of the cache that is read before it is extended.
-	const double& cacheExtensionThreshold() const { return m_cacheExtensionThreshold; }
-
-
-	//! Set cache extension threshold. Does not extend the cache until audio() has been called. Function will halt until the last load operation has finished.
-	void setCacheExtensionThreshold(const double& cacheExtensionThreshold)
+	//! G.711 decoding tables: each 8-bit A-law or mu-law sample as a 16-bit linear sample.
+	/*!
+	* A class template, so that the tables can be defined in this header.
+	*/
+	template<typename Unused = void> struct G711
 	{
-		std::lock_guard<std::mutex> l{ m_dataMutex };
-		m_cacheExtensionThreshold = cacheExtensionThreshold;
+		static const int16_t alaw[256];
+		static const int16_t mulaw[256];
+	};
+	template<typename Unused> const int16_t G711<Unused>::alaw[256]{
+		-5504, -5248, -6016, -5760, -4480, -4224, -4992, -4736, -7552, -7296, -8064, -7808, -6528, -6272, -7040, -6784,
+		-2752, -2624, -3008, -2880, -2240, -2112, -2496, -2368, -3776, -3648, -4032, -3904, -3264, -3136, -3520, -3392,
+		-22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944, -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+		-11008, -10496, -12032, -11520, -8960, -8448, -9984, -9472, -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+		-344, -328, -376, -360, -280, -264, -312, -296, -472, -456, -504, -488, -408, -392, -440, -424,
+		-88, -72, -120, -104, -24, -8, -56, -40, -216, -200, -248, -232, -152, -136, -184, -168,
+		-1376, -1312, -1504, -1440, -1120, -1056, -1248, -1184, -1888, -1824, -2016, -1952, -1632, -1568, -1760, -1696,
+		-688, -656, -752, -720, -560, -528, -624, -592, -944, -912, -1008, -976, -816, -784, -880, -848,
+		5504, 5248, 6016, 5760, 4480, 4224, 4992, 4736, 7552, 7296, 8064, 7808, 6528, 6272, 7040, 6784,
+		2752, 2624, 3008, 2880, 2240, 2112, 2496, 2368, 3776, 3648, 4032, 3904, 3264, 3136, 3520, 3392,
+		22016, 20992, 24064, 23040, 17920, 16896, 19968, 18944, 30208, 29184, 32256, 31232, 26112, 25088, 28160, 27136,
+		11008, 10496, 12032, 11520, 8960, 8448, 9984, 9472, 15104, 14592, 16128, 15616, 13056, 12544, 14080, 13568,
+		344, 328, 376, 360, 280, 264, 312, 296, 472, 456, 504, 488, 408, 392, 440, 424,
+		88, 72, 120, 104, 24, 8, 56, 40, 216, 200, 248, 232, 152, 136, 184, 168,
+		1376, 1312, 1504, 1440, 1120, 1056, 1248, 1184, 1888, 1824, 2016, 1952, 1632, 1568, 1760, 1696,
+		688, 656, 752, 720, 560, 528, 624, 592, 944, 912, 1008, 976, 816, 784, 880, 848,
+	};
+	template<typename Unused> const int16_t G711<Unused>::mulaw[256]{
+		-32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956, -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+		-15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412, -11900, -11388, -10876, -10364, -9852, -9340, -8828, -8316,
+		-7932, -7676, -7420, -7164, -6908, -6652, -6396, -6140, -5884, -5628, -5372, -5116, -4860, -4604, -4348, -4092,
+		-3900, -3772, -3644, -3516, -3388, -3260, -3132, -3004, -2876, -2748, -2620, -2492, -2364, -2236, -2108, -1980,
+		-1884, -1820, -1756, -1692, -1628, -1564, -1500, -1436, -1372, -1308, -1244, -1180, -1116, -1052, -988, -924,
+		-876, -844, -812, -780, -748, -716, -684, -652, -620, -588, -556, -524, -492, -460, -428, -396,
+		-372, -356, -340, -324, -308, -292, -276, -260, -244, -228, -212, -196, -180, -164, -148, -132,
+		-120, -112, -104, -96, -88, -80, -72, -64, -56, -48, -40, -32, -24, -16, -8, 0,
+		32124, 31100, 30076, 29052, 28028, 27004, 25980, 24956, 23932, 22908, 21884, 20860, 19836, 18812, 17788, 16764,
+		15996, 15484, 14972, 14460, 13948, 13436, 12924, 12412, 11900, 11388, 10876, 10364, 9852, 9340, 8828, 8316,
+		7932, 7676, 7420, 7164, 6908, 6652, 6396, 6140, 5884, 5628, 5372, 5116, 4860, 4604, 4348, 4092,
+		3900, 3772, 3644, 3516, 3388, 3260, 3132, 3004, 2876, 2748, 2620, 2492, 2364, 2236, 2108, 1980,
+		1884, 1820, 1756, 1692, 1628, 1564, 1500, 1436, 1372, 1308, 1244, 1180, 1116, 1052, 988, 924,
+		876, 844, 812, 780, 748, 716, 684, 652, 620, 588, 556, 524, 492, 460, 428, 396,
+		372, 356, 340, 324, 308, 292, 276, 260, 244, 228, 212, 196, 180, 164, 148, 132,
+		120, 112, 104, 96, 88, 80, 72, 64, 56, 48, 40, 32, 24, 16, 8, 0,
+	};
+	//! Decoding table of a G.711 format
+	template<uint16_t Format> inline const int16_t* g711Table() { return Format == WAV_FORMAT_ALAW ? G711<>::alaw : G711<>::mulaw; }
+	//! G.711 sample as a full-scale 32-bit integer
+	template<uint16_t Format> inline int32_t g711Int(const uint8_t* s) { return (int32_t)((uint32_t)(uint16_t)g711Table<Format>()[s[0]] << 16); }
+	template<uint16_t Format> inline float g711(const uint8_t* s) { return (float)g711Table<Format>()[s[0]] * (1.f / 32768.f); }
+	//! Look up count contiguous G.711 samples
+	template<uint16_t Format> void g711_scalar(const uint8_t* src, float* dst, size_t count)
+	{
+		const int16_t* table{ g711Table<Format>() };
+		for (size_t i{ 0u }; i < count; ++i)
+			dst[i] = (float)table[src[i]] * (1.f / 32768.f);
 	}
-	//! Set cache size. Does not extend the cache until audio() has been called. Function will halt until the last load operation has finished.
-	void setCacheSize(const size_t& csize)
+#if defined(WAVEREAD_X86)
+	//! Decode sixteen samples at a time in 16-bit lanes, as the tables were made: the segment picks a power of two with a shuffle, which scales the mantissa.
+	template<uint16_t Format> WAVEREAD_TARGET_AVX2 void g711_avx2(const uint8_t* src, float* dst, size_t count)
 	{
-		std::lock_guard<std::mutex> l{ m_dataMutex };
-		m_cacheSize = csize;
+		const bool alaw{ Format == WAV_FORMAT_ALAW };
+		const __m256i power{ alaw ? _mm256_setr_epi8(1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0) :
+			_mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0) };
+		const __m256i flip{ _mm256_set1_epi16(alaw ? 0x55 : 0xFF) }, seven{ _mm256_set1_epi16(7) }, fifteen{ _mm256_set1_epi16(15) }, high{ _mm256_set1_epi16((short)0x8000) };
+		const __m256 scale{ _mm256_set1_ps(1.f / 32768.f) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			__m256i x{ _mm256_xor_si256(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))), flip) };
+			__m256i segment{ _mm256_and_si256(_mm256_srli_epi16(x, 4), seven) }, mantissa{ _mm256_and_si256(x, fifteen) };
+			__m256i scaleBy{ _mm256_shuffle_epi8(power, _mm256_or_si256(segment, high)) }; // the high byte of each lane indexes with its top bit set, giving 0
+			__m256i t;
+			if (alaw) // ((m << 4) + 8) for segment 0, ((m << 4) + 0x108) << (segment - 1) otherwise
+			{
+				__m256i above{ _mm256_andnot_si256(_mm256_cmpeq_epi16(segment, _mm256_setzero_si256()), _mm256_set1_epi16(0x100)) };
+				t = _mm256_mullo_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(mantissa, 4), _mm256_set1_epi16(8)), above), scaleBy);
+			}
+			else // (((m << 3) + 0x84) << segment) - 0x84
+				t = _mm256_sub_epi16(_mm256_mullo_epi16(_mm256_add_epi16(_mm256_slli_epi16(mantissa, 3), _mm256_set1_epi16(0x84)), scaleBy), _mm256_set1_epi16(0x84));
+			__m256i sign{ _mm256_and_si256(x, _mm256_set1_epi16(0x80)) }; // once flipped, set for positive A-law samples, and negative mu-law samples
+			__m256i negative{ _mm256_cmpeq_epi16(sign, alaw ? _mm256_setzero_si256() : _mm256_set1_epi16(0x80)) };
+			t = _mm256_sub_epi16(_mm256_xor_si256(t, negative), negative);
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(t))), scale));
+			_mm256_storeu_ps(dst + i + 8u, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(t, 1))), scale));
+		}
+		g711_scalar<Format>(src + i, dst + i, count - i);
 	}
-private:
-	//! Load data into the cache
-	bool load(size_t pos, size_t size) // method will offset read by header size
+#endif
+
+	//! ADPCM tables: the IMA step sizes and changes to the step index, and the MS ADPCM adaptation of the step with its standard predictor coefficients.
+	/*!
+	* A class template, so that the tables can be defined in this header.
+	*/
+	template<typename Unused = void> struct Adpcm
 	{
-		std::lock_guard<std::mutex> lock{ m_dataMutex };
-		size_t truncatedSize{ (pos + size) < (size_t)m_header.m_40_dataSubchunkSize
-			? size : (size_t)m_header.m_40_dataSubchunkSize - pos };
-		if (pos < (size_t)m_header.m_40_dataSubchunkSize)
+		static const int16_t imaStep[89];
+		static const int8_t imaIndex[16];
+		static const int16_t msAdapt[16];
+	};
+	template<typename Unused> const int16_t Adpcm<Unused>::imaStep[89]{
+		7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+		130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411,
+		1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+		12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+	};
+	template<typename Unused> const int8_t Adpcm<Unused>::imaIndex[16]{ -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+	template<typename Unused> const int16_t Adpcm<Unused>::msAdapt[16]{ 230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230 };
+	//! Little-endian 16-bit integer
+	inline int16_t le16(const uint8_t* s) { return (int16_t)(uint16_t)(s[0] | (s[1] << 8)); }
+	inline int clamp16(int x) { return std::min(std::max(x, -32768), 32767); }
+	//! Decode a block of IMA ADPCM into interleaved 16-bit samples.
+	/*!
+	* Each channel's header holds its first sample and step index. Its samples follow in runs of eight, four bytes per channel in turn, the low nibble first.
+	* \param bytes size of the block, which is less than the block align only if the data chunk ends part way through it.
+	* \return number of frames decoded
+	*/
+	inline size_t imaBlock(const WAV_HEADER& header, const uint8_t* src, size_t bytes, int16_t* dst)
+	{
+		size_t channels{ (size_t)header.m_22_numChannels }, frames{ header.blockSamples(bytes) };
+		for (size_t c{ 0u }; c < channels; ++c)
 		{
-			m_stream->seekg(((std::streampos)pos + (std::streampos)sizeof(WAV_HEADER))); // add header size
-			m_data.resize(truncatedSize);
-			if (m_stream->good())
+			int sample{ le16(src + 4u * c) }, index{ std::min<int>(src[4u * c + 2u], 88) };
+			const uint8_t* data{ src + 4u * channels + 4u * c };
+			dst[c] = (int16_t)sample;
+			for (size_t f{ 1u }; f < frames; ++f)
 			{
-				m_stream->read(reinterpret_cast<char*>(&m_data[0]), truncatedSize);
-				m_cachePos = pos;
-				m_stream->clear(std::iostream::eofbit);
-				return m_stream->good();
+				size_t k{ f - 1u };
+				uint8_t byte{ data[(k / 8u) * 4u * channels + (k % 8u) / 2u] };
+				int nibble{ (k & 1u) ? byte >> 4 : byte & 15 }, step{ Adpcm<>::imaStep[index] }, difference{ step >> 3 };
+				if (nibble & 4)
+					difference += step;
+				if (nibble & 2)
+					difference += step >> 1;
+				if (nibble & 1)
+					difference += step >> 2;
+				sample = clamp16((nibble & 8) ? sample - difference : sample + difference);
+				index = std::min(std::max(index + Adpcm<>::imaIndex[nibble], 0), 88);
+				dst[f * channels + c] = (int16_t)sample;
 			}
 		}
-		return false;
+		return frames;
 	}
-	//! Transform cached bytes into floats.
+	//! Decode a block of MS ADPCM into interleaved 16-bit samples, as imaBlock().
 	/*!
-	* \param posInCache
-	* \param size
-	* \param channels
-	* \param stride
-	* \param interleaved
+	* The header gives each channel's predictor, step and first two samples, each field for every channel in turn. Samples follow a nibble each,
+	* channels interleaved, the high nibble first. A sample is predicted from the previous two by the predictor's coefficients, and corrected by the nibble times the step.
 	*/
-	std::vector<float> samples(
-		size_t posInCache,
-		size_t size,
-		std::set<int> channels = std::set<int>{},
-		size_t stride = 0u,
-		bool interleaved = true) // posInCache is pos relative to cachepos.
+	inline size_t msBlock(const WAV_HEADER& header, const uint8_t* src, size_t bytes, int16_t* dst)
 	{
-		std::vector<float> result{};
-		if (
-			(posInCache + size) <= m_data.size() &&			// if caller is not overshooting the cache
-			!channels.empty() 								// if caller has provided channels
-			)
+		size_t channels{ (size_t)header.m_22_numChannels }, frames{ header.blockSamples(bytes) };
+		const uint8_t* data{ src + 7u * channels };
+		for (size_t c{ 0u }; c < channels; ++c)
 		{
-			std::lock_guard<std::mutex> lock{ m_dataMutex };
-			size_t bpc{ m_header.m_32_bytesPerBlock / (size_t)m_header.m_22_numChannels }; // bytes per channel
+			size_t predictor{ std::min<size_t>(src[c], header.m_coefficients.size() / 2u - 1u) };
+			int coefficient1{ header.m_coefficients[2u * predictor] }, coefficient2{ header.m_coefficients[2u * predictor + 1u] };
+			int step{ le16(src + channels + 2u * c) }, sample1{ le16(src + 3u * channels + 2u * c) }, sample2{ le16(src + 5u * channels + 2u * c) };
+			dst[c] = (int16_t)sample2;
+			dst[channels + c] = (int16_t)sample1;
+			for (size_t f{ 2u }, k{ c }; f < frames; ++f, k += channels)
+			{
+				int nibble{ (k & 1u) ? data[k / 2u] & 15 : data[k / 2u] >> 4 };
+				int sample{ clamp16((sample1 * coefficient1 + sample2 * coefficient2) / 256 + (nibble >= 8 ? nibble - 16 : nibble) * step) };
+				sample2 = sample1;
+				sample1 = sample;
+				step = std::min(std::max(Adpcm<>::msAdapt[nibble] * step / 256, 16), std::numeric_limits<int>::max() / 768); // bounded, so that a corrupt block can't overflow it
+				dst[f * channels + c] = (int16_t)sample;
+			}
+		}
+		return frames;
+	}
+	//! Decode a block of either kind of ADPCM
+	inline size_t adpcmBlock(const WAV_HEADER& header, const uint8_t* src, size_t bytes, int16_t* dst)
+	{
+		return header.format() == WAV_FORMAT_IMA_ADPCM ? imaBlock(header, src, bytes, dst) : msBlock(header, src, bytes, dst);
+	}
 
-			if (interleaved)
-				switch (m_header.m_34_bitsPerSample)
-				{
-				case 8: // unsigned 8-bit
-					for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-					{
-						for (auto ch : channels)
-						{
-							// NOTE: (a) see narrow_cast<T>(var) (b) addition defined in C++ as: T operator+(const T &a, const T2 &b);
-							// EXCEPTIONS: Integer types smaller than int are promoted when an operation is performed on them.
-							size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-							result.emplace_back((float)
-								(m_data[i + cho] - 128)  // unsigned, so offset by 2^7
-								/ (128.f)); // divide by 2^7
-						}
-					}
-					break;
-				case 16: // signed 16-bit
-					for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-					{
-						for (auto ch : channels)
-						{
-							size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-							result.emplace_back((float)
-								((m_data[i + cho]) |
-									(m_data[i + 1u + cho] << 8))
-								/ (32768.f)); // divide by 2^15
-						}
-					}
-					break;
-				case 24: // signed 24-bit
-					for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-					{
-						for (auto ch : channels)
-						{
-							size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-							// 24-bit is different to others: put the value into a 32-bit int with zeros at the (LSB) end
-							result.emplace_back((float)
-								((m_data[i + cho] << 8) |
-									(m_data[i + 1u + cho] << 16) |
-									(m_data[i + 2u + cho] << 24))
-								/ (2147483648.f)); // divide by 2^31
-						}
-					}
-					break;
-				case 32: // signed 32-bit
-					for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-					{
-						for (auto ch : channels)
-						{
-							size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-							result.emplace_back((float)
-								(m_data[i + cho] |
-									(m_data[i + 1u + cho] << 8) |
-									(m_data[i + 2u + cho] << 16) |
-									(m_data[i + 3u + cho] << 24))
-								/ (2147483648.f));  // signed, so divide by 2^31
-						}
-					}
-					break;
-				default:
-					break;
+	//! Read-only memory mapping of a whole file. Empty if the file can't be mapped, or if mapping isn't available on this platform.
+	class Mapping
+	{
+	public:
+		Mapping() : m_data{ nullptr }, m_size{ 0u } {}
+		explicit Mapping(const std::string& path) : Mapping{}
+		{
+#if defined(WAVEREAD_MMAP)
+			int fd{ ::open(path.c_str(), O_RDONLY) };
+			if (fd < 0)
+				return;
+			struct stat st;
+			if (::fstat(fd, &st) == 0 && st.st_size > 0)
+			{
+				void* data{ ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) };
+				if (data != MAP_FAILED)
+				{
+					m_data = static_cast<const uint8_t*>(data);
+					m_size = (size_t)st.st_size;
 				}
+			}
+			::close(fd); // the mapping keeps its own reference to the file
+#else
+			(void)path;
+#endif
+		}
+		Mapping(const Mapping&) = delete;
+		Mapping& operator=(const Mapping&) = delete;
+		Mapping(Mapping&& other) noexcept : m_data{ other.m_data }, m_size{ other.m_size }
+		{
+			other.m_data = nullptr;
+			other.m_size = 0u;
+		}
+		Mapping& operator=(Mapping&& other) noexcept
+		{
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+			return *this;
+		}
+		~Mapping()
+		{
+#if defined(WAVEREAD_MMAP)
+			if (m_data != nullptr)
+				::munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+		}
+		//! Tell the kernel how the bytes [offset, offset + size) will be read.
+		void advise(size_t offset, size_t size, WAV_ACCESS access) const
+		{
+#if defined(WAVEREAD_MMAP)
+			if (m_data == nullptr || offset >= m_size)
+				return;
+			size_t page{ (size_t)::sysconf(_SC_PAGESIZE) };
+			size_t aligned{ offset - offset % page }; // madvise needs a page-aligned address
+			size = std::min(size, m_size - offset) + (offset - aligned);
+			int advice{ access == WAV_ACCESS::sequential ? MADV_SEQUENTIAL : access == WAV_ACCESS::random ? MADV_RANDOM : MADV_NORMAL };
+			::madvise(const_cast<uint8_t*>(m_data) + aligned, size, advice);
+#else
+			(void)offset; (void)size; (void)access;
+#endif
+		}
+		//! Tell the kernel that a range will be needed soon, so that it starts reading it in.
+		void willneed(size_t offset, size_t size) const
+		{
+#if defined(WAVEREAD_MMAP)
+			if (m_data == nullptr || offset >= m_size)
+				return;
+			size_t page{ (size_t)::sysconf(_SC_PAGESIZE) };
+			size_t aligned{ offset - offset % page };
+			::madvise(const_cast<uint8_t*>(m_data) + aligned, std::min(size, m_size - offset) + (offset - aligned), MADV_WILLNEED);
+#else
+			(void)offset; (void)size;
+#endif
+		}
+		const uint8_t* data() const { return m_data; }
+		size_t size() const { return m_size; }
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+	};
+
+	//! An istream over a block of memory, so that headers can be parsed from a mapping without copying it.
+	class MemoryStream : public std::istream
+	{
+	public:
+		MemoryStream(const uint8_t* data, size_t size) : std::istream{ nullptr }, m_buf{ data, size } { rdbuf(&m_buf); }
+	private:
+		struct Buffer : public std::streambuf
+		{
+			Buffer(const uint8_t* data, size_t size)
+			{
+				char* begin{ const_cast<char*>(reinterpret_cast<const char*>(data)) }; // never written through: the buffer only supports input
+				setg(begin, begin, begin + size);
+			}
+			pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+			{
+				off_type base{ dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? (off_type)(gptr() - eback()) : (off_type)(egptr() - eback()) };
+				if (base + off < 0 || base + off > (off_type)(egptr() - eback()))
+					return pos_type(off_type(-1));
+				setg(eback(), eback() + base + off, egptr());
+				return pos_type(base + off);
+			}
+			pos_type seekpos(pos_type pos, std::ios_base::openmode which) override { return seekoff(off_type(pos), std::ios_base::beg, which); }
+		} m_buf;
+	};
+
+	//! Contiguous conversion kernel: converts count samples from src into dst.
+	typedef void(*Kernel)(const uint8_t* src, float* dst, size_t count);
+
+	//! Get the conversion kernel for a bit depth and format, using the best instruction set up to simd that the CPU supports. Returns nullptr for unsupported bit depths.
+	inline Kernel kernel(int bitsPerSample, Simd simd = Simd::avx2, uint16_t format = WAV_FORMAT_PCM)
+	{
+		if (simd > simdSupported())
+			simd = simdSupported();
+		if (format == WAV_FORMAT_ALAW || format == WAV_FORMAT_MULAW)
+		{
+			if (bitsPerSample != 8)
+				return nullptr;
+#if defined(WAVEREAD_X86)
+			if (simd == Simd::avx2)
+				return format == WAV_FORMAT_ALAW ? &g711_avx2<WAV_FORMAT_ALAW> : &g711_avx2<WAV_FORMAT_MULAW>;
+#endif
+			return format == WAV_FORMAT_ALAW ? &g711_scalar<WAV_FORMAT_ALAW> : &g711_scalar<WAV_FORMAT_MULAW>;
+		}
+		if (format == WAV_FORMAT_IEEE_FLOAT)
+			switch (bitsPerSample)
+			{
+			case 32: return &ieee32_copy;
+#if defined(WAVEREAD_X86)
+			case 64: return simd == Simd::avx2 ? &ieee64_avx2 : simd == Simd::sse2 ? &ieee64_sse2 : &scalar<&ieee64, 8u>;
+#else
+			case 64: return &scalar<&ieee64, 8u>;
+#endif
+			default: return nullptr;
+			}
+		switch (bitsPerSample)
+		{
+#if defined(WAVEREAD_X86)
+		case 8: return simd == Simd::avx2 ? &pcm8_avx2 : simd == Simd::sse2 ? &pcm8_sse2 : &scalar<&pcm8, 1u>;
+		case 16: return simd == Simd::avx2 ? &pcm16_avx2 : simd == Simd::sse2 ? &pcm16_sse2 : &scalar<&pcm16, 2u>;
+		case 24: return simd == Simd::avx2 ? &pcm24_avx2 : simd == Simd::sse2 ? &pcm24_sse2 : &scalar<&pcm24, 3u>;
+		case 32: return simd == Simd::avx2 ? &pcm32_avx2 : simd == Simd::sse2 ? &pcm32_sse2 : &scalar<&pcm32, 4u>;
+#else
+		case 8: return &scalar<&pcm8, 1u>;
+		case 16: return &scalar<&pcm16, 2u>;
+		case 24: return &scalar<&pcm24, 3u>;
+		case 32: return &scalar<&pcm32, 4u>;
+#endif
+		default: return nullptr;
+		}
+	}
+
+	//! Dot product of two float arrays: the inner loop of the resampler's filter.
+	inline float dot(const float* a, const float* b, size_t count)
+	{
+		float sum[4]{};
+		size_t i{ 0u };
+		for (; i + 4u <= count; i += 4u)
+			for (size_t k{ 0u }; k < 4u; ++k)
+				sum[k] += a[i + k] * b[i + k];
+		float result{ (sum[0] + sum[2]) + (sum[1] + sum[3]) };
+		for (; i < count; ++i)
+			result += a[i] * b[i];
+		return result;
+	}
+#if defined(WAVEREAD_X86)
+	WAVEREAD_TARGET_SSE2 inline float dot_sse2(const float* a, const float* b, size_t count)
+	{
+		__m128 sum0{ _mm_setzero_ps() }, sum1{ _mm_setzero_ps() };
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4u), _mm_loadu_ps(b + i + 4u)));
+		}
+		__m128 sum{ _mm_add_ps(sum0, sum1) };
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		float result{ _mm_cvtss_f32(sum) };
+		for (; i < count; ++i)
+			result += a[i] * b[i];
+		return result;
+	}
+	WAVEREAD_TARGET_AVX2 inline float dot_avx2(const float* a, const float* b, size_t count)
+	{
+		__m256 sum0{ _mm256_setzero_ps() }, sum1{ _mm256_setzero_ps() };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+			sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8u), _mm256_loadu_ps(b + i + 8u)));
+		}
+		for (; i + 8u <= count; i += 8u)
+			sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+		__m256 wide{ _mm256_add_ps(sum0, sum1) };
+		__m128 sum{ _mm_add_ps(_mm256_castps256_ps128(wide), _mm256_extractf128_ps(wide, 1)) };
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		float result{ _mm_cvtss_f32(sum) };
+		for (; i < count; ++i)
+			result += a[i] * b[i];
+		return result;
+	}
+#endif
+	typedef float(*Dot)(const float* a, const float* b, size_t count);
+	//! Get the dot product for an instruction set, or the best this CPU supports. The sum is taken in a different order by each, so results may differ in the last bits.
+	inline Dot dotKernel(Simd simd = Simd::avx2)
+	{
+		if (simd > simdSupported())
+			simd = simdSupported();
+#if defined(WAVEREAD_X86)
+		return simd == Simd::avx2 ? &dot_avx2 : simd == Simd::sse2 ? &dot_sse2 : &dot;
+#else
+		(void)simd;
+		return &dot;
+#endif
+	}
+
+	//! Add weight times count floats from src into acc: the inner loop of Waveread::mix(), vectorized across frames.
+	inline void accumulate(const float* src, float weight, float* acc, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i)
+			acc[i] += weight * src[i];
+	}
+#if defined(WAVEREAD_X86)
+	WAVEREAD_TARGET_SSE2 inline void accumulate_sse2(const float* src, float weight, float* acc, size_t count)
+	{
+		const __m128 w{ _mm_set1_ps(weight) };
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(w, _mm_loadu_ps(src + i))));
+			_mm_storeu_ps(acc + i + 4u, _mm_add_ps(_mm_loadu_ps(acc + i + 4u), _mm_mul_ps(w, _mm_loadu_ps(src + i + 4u))));
+		}
+		accumulate(src + i, weight, acc + i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void accumulate_avx2(const float* src, float weight, float* acc, size_t count)
+	{
+		const __m256 w{ _mm256_set1_ps(weight) };
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			_mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(w, _mm256_loadu_ps(src + i))));
+			_mm256_storeu_ps(acc + i + 8u, _mm256_add_ps(_mm256_loadu_ps(acc + i + 8u), _mm256_mul_ps(w, _mm256_loadu_ps(src + i + 8u))));
+		}
+		accumulate(src + i, weight, acc + i, count - i);
+	}
+#endif
+	typedef void(*Accumulate)(const float* src, float weight, float* acc, size_t count);
+	//! Get the accumulation for an instruction set, or the best this CPU supports. Each multiplies then adds, so all give the same results.
+	inline Accumulate accumulateKernel(Simd simd = Simd::avx2)
+	{
+		if (simd > simdSupported())
+			simd = simdSupported();
+#if defined(WAVEREAD_X86)
+		return simd == Simd::avx2 ? &accumulate_avx2 : simd == Simd::sse2 ? &accumulate_sse2 : &accumulate;
+#else
+		(void)simd;
+		return &accumulate;
+#endif
+	}
+
+	//! Are the channels every channel of the file, in file order?
+	inline bool contiguous(const WAV_HEADER& header, const int* channels, size_t channelCount)
+	{
+		if (channelCount != (size_t)header.m_22_numChannels)
+			return false;
+		for (size_t c{ 0u }; c < channelCount; ++c)
+			if ((size_t)(channels[c] % header.m_22_numChannels) != c)
+				return false;
+		return true;
+	}
+	//! Sample types that audio() can decode to
+	template<typename T> struct SampleType { static const bool supported = false; };
+	template<> struct SampleType<int16_t> { static const bool supported = true; static const bool ieee = false; };
+	template<> struct SampleType<int32_t> { static const bool supported = true; static const bool ieee = false; };
+	template<> struct SampleType<float> { static const bool supported = true; static const bool ieee = true; };
+	template<> struct SampleType<double> { static const bool supported = true; static const bool ieee = true; };
+
+	//! Integer sample of a bit depth, as a signed 32-bit integer at full scale.
+	template<int Bits> int32_t pcmInt(const uint8_t* s);
+	template<> inline int32_t pcmInt<8>(const uint8_t* s) { return (int32_t)((uint32_t)(uint8_t)(s[0] ^ 0x80u) << 24); } // unsigned: flipping the top bit offsets by 2^7
+	template<> inline int32_t pcmInt<16>(const uint8_t* s) { return (int32_t)(((uint32_t)s[0] << 16) | ((uint32_t)s[1] << 24)); }
+	template<> inline int32_t pcmInt<24>(const uint8_t* s) { return (int32_t)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24)); }
+	template<> inline int32_t pcmInt<32>(const uint8_t* s) { return (int32_t)((uint32_t)s[0] | ((uint32_t)s[1] << 8) | ((uint32_t)s[2] << 16) | ((uint32_t)s[3] << 24)); }
+
+	//! Full-scale 32-bit integer sample as an output sample: shifted to the width of an integer, or scaled to (-1,1).
+	template<typename T> T fromInt(int32_t v);
+	template<> inline int16_t fromInt<int16_t>(int32_t v) { return (int16_t)(v >> 16); }
+	template<> inline int32_t fromInt<int32_t>(int32_t v) { return v; }
+	template<> inline float fromInt<float>(int32_t v) { return (float)v / 2147483648.f; }
+	template<> inline double fromInt<double>(int32_t v) { return (double)v / 2147483648.0; }
+
+	//! Floating point sample as an output sample: scaled to the width of an integer, rounding and clipping.
+	template<typename T> T fromReal(double v);
+	template<> inline int16_t fromReal<int16_t>(double v) { return (int16_t)std::floor(std::min(std::max(v * 32768.0, -32768.0), 32767.0) + 0.5); }
+	template<> inline int32_t fromReal<int32_t>(double v) { return (int32_t)std::floor(std::min(std::max(v * 2147483648.0, -2147483648.0), 2147483647.0) + 0.5); }
+	template<> inline float fromReal<float>(double v) { return (float)v; }
+	template<> inline double fromReal<double>(double v) { return v; }
+
+	template<typename T, int Bits> T pcmAs(const uint8_t* s) { return fromInt<T>(pcmInt<Bits>(s)); }
+	template<typename T> T ieee32As(const uint8_t* s) { return fromReal<T>((double)ieee32(s)); }
+	template<typename T> T ieee64As(const uint8_t* s)
+	{
+		double v;
+		std::memcpy(&v, s, 8u);
+		return fromReal<T>(v);
+	}
+	// to float, the same conversions as the kernels, so that every layout gives exactly the same samples.
+	template<> inline float pcmAs<float, 8>(const uint8_t* s) { return pcm8(s); }
+	template<> inline float pcmAs<float, 16>(const uint8_t* s) { return pcm16(s); }
+	template<> inline float pcmAs<float, 24>(const uint8_t* s) { return pcm24(s); }
+	template<> inline float pcmAs<float, 32>(const uint8_t* s) { return pcm32(s); }
+	template<> inline float ieee32As<float>(const uint8_t* s) { return ieee32(s); }
+	template<> inline float ieee64As<float>(const uint8_t* s) { return ieee64(s); }
+	template<typename T, uint16_t Format> T g711As(const uint8_t* s) { return fromInt<T>(g711Int<Format>(s)); }
+	template<> inline float g711As<float, WAV_FORMAT_ALAW>(const uint8_t* s) { return g711<WAV_FORMAT_ALAW>(s); }
+	template<> inline float g711As<float, WAV_FORMAT_MULAW>(const uint8_t* s) { return g711<WAV_FORMAT_MULAW>(s); }
+
+	//! Output laid out as interleaved frames
+	template<typename T> struct InterleavedOut
+	{
+		T* out;
+		size_t channels;
+		T& at(size_t frame, size_t channel) const { return out[frame * channels + channel]; }
+		T* flat(size_t first) const { return out + first * channels; }
+	};
+	//! Output laid out as a buffer for each channel
+	template<typename T> struct PlanarOut
+	{
+		T* const* out;
+		T& at(size_t frame, size_t channel) const { return out[channel][frame]; }
+		T* flat(size_t) const { return nullptr; }
+	};
+	//! Output with any distance between frames, and between channels
+	template<typename T> struct StridedOut
+	{
+		T* out;
+		size_t frameStride;
+		size_t channelStride;
+		size_t channels;
+		T& at(size_t frame, size_t channel) const { return out[frame * frameStride + channel * channelStride]; }
+		T* flat(size_t first) const { return (frameStride == channels && (channelStride == 1u || channels == 1u)) ? out + first * frameStride : nullptr; }
+	};
+
+	//! Decode frames from a fixed number of channels, whose byte offsets in a frame are worked out once.
+	template<typename T, T(*Convert)(const uint8_t*), size_t Channels, typename Out>
+	void decodeFixed(const uint8_t* src, size_t frames, size_t step, const size_t* offsets, const Out& out, size_t first)
+	{
+		size_t offset[Channels];
+		for (size_t c{ 0u }; c < Channels; ++c)
+			offset[c] = offsets[c];
+		for (size_t f{ 0u }; f < frames; ++f, src += step)
+			for (size_t c{ 0u }; c < Channels; ++c)
+				out.at(first + f, c) = Convert(src + offset[c]);
+	}
+	//! Decode frames of one bit depth to one sample type, placing frame f at out.at(first + f, channel).
+	/*!
+	* Channels are resolved to byte offsets within a frame before the loop over samples: mono and stereo are unrolled, every channel in file order
+	* with no stride is one run of samples, and other selections are decoded a channel at a time.
+	*/
+	template<typename T, T(*Convert)(const uint8_t*), typename Out>
+	void decodeAs(const WAV_HEADER& header, const uint8_t* src, size_t frames, size_t step, const int* channels, size_t channelCount, const Out& out, size_t first)
+	{
+		size_t bpc{ header.m_32_bytesPerBlock / (size_t)header.m_22_numChannels }; // bytes per channel
+		T* flat{ out.flat(first) };
+		if (flat != nullptr && step == (size_t)header.m_32_bytesPerBlock && contiguous(header, channels, channelCount))
+		{
+			for (size_t i{ 0u }, n{ frames * channelCount }; i < n; ++i, src += bpc)
+				flat[i] = Convert(src);
+			return;
+		}
+		if (channelCount <= 2u)
+		{
+			size_t offsets[2]{ (channels[0] % header.m_22_numChannels) * bpc, (channels[channelCount - 1u] % header.m_22_numChannels) * bpc };
+			if (channelCount == 1u)
+				decodeFixed<T, Convert, 1u>(src, frames, step, offsets, out, first);
 			else
-				switch (m_header.m_34_bitsPerSample)
-				{
-				case 8: // unsigned 8-bit
-					for (auto ch : channels)
-					{
-						size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-						for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-						{
-							// NOTE: (a) see narrow_cast<T>(var) (b) addition defined in C++ as: T operator+(const T &a, const T2 &b);
-							// EXCEPTIONS: Integer types smaller than int are promoted when an operation is performed on them.
-							result.emplace_back((float)
-								(m_data[i + cho] - 128)  // unsigned, so offset by 2^7
-								/ (128.f)); // divide by 2^7
-						}
-					}
-					break;
-				case 16: // signed 16-bit
-					for (auto ch : channels)
-					{
-						size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-						for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-						{
-							result.emplace_back((float)
-								((m_data[i + cho]) |
-									(m_data[i + 1u + cho] << 8))
-								/ (32768.f)); // divide by 2^15
-						}
-					}
-					break;
-				case 24: // signed 24-bit
-					for (auto ch : channels)
-					{
-						size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-						for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-						{
-							// 24-bit is different to others: put the value into a 32-bit int with zeros at the (LSB) end
-							result.emplace_back((float)
-								((m_data[i + cho] << 8) |
-									(m_data[i + 1u + cho] << 16) |
-									(m_data[i + 2u + cho] << 24))
-								/ (2147483648.f)); // divide by 2^31
-						}
-					}
-					break;
-				case 32: // signed 32-bit
-					for (auto ch : channels)
+				decodeFixed<T, Convert, 2u>(src, frames, step, offsets, out, first);
+			return;
+		}
+		for (size_t c{ 0u }; c < channelCount; ++c)
+		{
+			const uint8_t* s{ src + (channels[c] % header.m_22_numChannels) * bpc };
+			for (size_t f{ 0u }; f < frames; ++f, s += step)
+				out.at(first + f, c) = Convert(s);
+		}
+	}
+	//! Copy or convert every channel in file order straight into interleaved output, if there is a way to: returns false if not.
+	template<typename T>
+	bool contiguousAs(const WAV_HEADER& header, const uint8_t* src, size_t count, T* dst)
+	{
+		if (header.m_34_bitsPerSample != 8 * (int)sizeof(T) || (header.format() == WAV_FORMAT_IEEE_FLOAT) != SampleType<T>::ieee)
+			return false;
+		std::memcpy(dst, src, count * sizeof(T)); // the file holds the output type
+		return true;
+	}
+	inline bool contiguousAs(const WAV_HEADER& header, const uint8_t* src, size_t count, float* dst)
+	{
+		Kernel k{ kernel(header.m_34_bitsPerSample, Simd::avx2, header.format()) };
+		if (k != nullptr)
+			k(src, dst, count);
+		return k != nullptr;
+	}
+
+	//! Transform bytes from the data chunk of a file with this header into samples of type T, placing frame f at out.at(first + f, channel).
+	/*!
+	* The conversion is chosen once for the bit depth, format and sample type, so the loop over samples has no branches.
+	*/
+	template<typename T, typename Out>
+	void samplesAs(const WAV_HEADER& header, const uint8_t* src, size_t frames, size_t stride, const int* channels, size_t channelCount, const Out& out, size_t first)
+	{
+		T* flat{ out.flat(first) };
+		if (flat != nullptr && stride == 0u && contiguous(header, channels, channelCount) && contiguousAs(header, src, frames * channelCount, flat))
+			return;
+
+		size_t step{ header.m_32_bytesPerBlock * (1u + stride) };
+		if (header.format() == WAV_FORMAT_ALAW)
+			decodeAs<T, &g711As<T, WAV_FORMAT_ALAW>>(header, src, frames, step, channels, channelCount, out, first);
+		else if (header.format() == WAV_FORMAT_MULAW)
+			decodeAs<T, &g711As<T, WAV_FORMAT_MULAW>>(header, src, frames, step, channels, channelCount, out, first);
+		else if (header.format() == WAV_FORMAT_IEEE_FLOAT)
+			switch (header.m_34_bitsPerSample)
+			{
+			case 32: decodeAs<T, &ieee32As<T>>(header, src, frames, step, channels, channelCount, out, first); break;
+			case 64: decodeAs<T, &ieee64As<T>>(header, src, frames, step, channels, channelCount, out, first); break;
+			default: break;
+			}
+		else
+			switch (header.m_34_bitsPerSample)
+			{
+			case 8: decodeAs<T, &pcmAs<T, 8>>(header, src, frames, step, channels, channelCount, out, first); break;
+			case 16: decodeAs<T, &pcmAs<T, 16>>(header, src, frames, step, channels, channelCount, out, first); break;
+			case 24: decodeAs<T, &pcmAs<T, 24>>(header, src, frames, step, channels, channelCount, out, first); break;
+			case 32: decodeAs<T, &pcmAs<T, 32>>(header, src, frames, step, channels, channelCount, out, first); break;
+			default: break;
+			}
+	}
+	//! Transform bytes from the data chunk of a file with this header into floats.
+	/*!
+	* \param header header of the file
+	* \param src first frame to read
+	* \param frames number of frames to write
+	* \param stride number of frames to skip after each frame read
+	* \param channels
+	* \param channelCount
+	* \param out destination for samples.
+	* \param frameStride distance in out between consecutive frames of a channel
+	* \param channelStride distance in out between channels of a frame
+	*/
+	inline void samples(
+		const WAV_HEADER& header,
+		const uint8_t* src,
+		size_t frames,
+		size_t stride,
+		const int* channels,
+		size_t channelCount,
+		float* out,
+		size_t frameStride,
+		size_t channelStride)
+	{
+		samplesAs<float>(header, src, frames, stride, channels, channelCount, StridedOut<float>{ out, frameStride, channelStride, channelCount }, 0u);
+	}
+	//! Frames that mixSamples() decodes at a time for a number of channels, so that a block of every channel stays in L1 cache
+	inline size_t mixBlock(size_t channels) { return std::min((size_t)256u, std::max((size_t)8u, 4096u / channels / 8u * 8u)); }
+	//! Floats of scratch that mixSamples() needs for a number of channels: a block interleaved, the same block planar, and a block of one output
+	inline size_t mixScratch(size_t channels) { return (2u * channels + 1u) * mixBlock(channels); }
+	//! Decode frames of every channel and mix them down to outputs channels as they are decoded: output o of a frame is gains[o] times the sum over channels c of matrix[o * channels + c] times channel c.
+	/*!
+	* Frames are converted a block at a time by the file's conversion kernel, reading each byte once, then spread into planar scratch small enough to stay in L1 cache.
+	* Each output is accumulated across the block with accumulateKernel() and written interleaved into out, so the decoded channels never travel to memory and back.
+	* Zero weights are skipped, and channels no output uses aren't spread.
+	* \param gains one for each output, or nullptr for unity
+	* \param scratch mixScratch(channels) floats
+	*/
+	inline void mixSamples(const WAV_HEADER& header, const uint8_t* src, size_t frames, size_t stride, const float* matrix, const float* gains, size_t outputs, float* out, float* scratch)
+	{
+		size_t nch{ (size_t)header.m_22_numChannels }, bpb{ (size_t)header.m_32_bytesPerBlock }, step{ bpb * (1u + stride) }, block{ mixBlock(nch) };
+		Kernel convert{ kernel(header.m_34_bitsPerSample, Simd::avx2, header.format()) };
+		if (convert == nullptr)
+			return;
+		float* interleaved{ scratch };
+		float* planar{ scratch + nch * block };
+		float* acc{ planar + nch * block };
+		Accumulate add{ accumulateKernel() };
+		for (size_t done{ 0u }; done < frames; done += block)
+		{
+			size_t n{ std::min(block, frames - done) };
+			const uint8_t* s{ src + done * step };
+			if (stride == 0u)
+				convert(s, interleaved, n * nch);
+			else
+				for (size_t f{ 0u }; f < n; ++f)
+					convert(s + f * step, interleaved + f * nch, nch);
+			for (size_t c{ 0u }; c < nch; ++c)
+				for (size_t o{ 0u }; o < outputs; ++o)
+					if (matrix[o * nch + c] != 0.f)
 					{
-						size_t cho{ (ch % m_header.m_22_numChannels) * bpc };
-						for (size_t i{ posInCache }; i < (posInCache + size); i += (m_header.m_32_bytesPerBlock * (1u + stride)))
-						{
-							result.emplace_back((float)
-								(m_data[i + cho] |
-									(m_data[i + 1u + cho] << 8) |
-									(m_data[i + 2u + cho] << 16) |
-									(m_data[i + 3u + cho] << 24))
-								/ (2147483648.f));  // signed, so divide by 2^31
-						}
+						float* channel{ planar + c * block };
+						for (size_t f{ 0u }; f < n; ++f)
+							channel[f] = interleaved[f * nch + c];
+						break;
 					}
-					break;
-				default:
-					break;
+			for (size_t o{ 0u }; o < outputs; ++o)
+			{
+				const float* weights{ matrix + o * nch };
+				std::fill(acc, acc + n, 0.f);
+				for (size_t c{ 0u }; c < nch; ++c)
+					if (weights[c] != 0.f)
+						add(planar + c * block, weights[c], acc, n);
+				float gain{ gains != nullptr ? gains[o] : 1.f };
+				float* dst{ out + done * outputs + o };
+				for (size_t f{ 0u }; f < n; ++f)
+					dst[f * outputs] = acc[f] * gain;
+			}
+		}
+	}
+
+#if defined(WAVEREAD_STATS)
+	//! Counters behind Waveread::stats(), updated by readers and the prefetch thread, and the trace callback.
+	class Recorder
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+		typedef Clock::time_point Time;
+		static const bool enabled{ true };
+
+		Recorder() : m_trace{} { reset(); }
+		//! Take the counters and the callback of another recorder, which is left as it is.
+		void take(const Recorder& other)
+		{
+			m_trace = other.m_trace;
+			for (size_t i{ 0u }; i < counters; ++i)
+				m_counters[i].store(other.m_counters[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+		void reset()
+		{
+			for (size_t i{ 0u }; i < counters; ++i)
+				m_counters[i].store(0u, std::memory_order_relaxed);
+		}
+		static Time now() { return Clock::now(); }
+
+		void hit(WAV_CALL call) { add(hits + (size_t)call, 1u); }
+		void miss(WAV_CALL call) { add(misses + (size_t)call, 1u); }
+		void read(uint64_t bytes) { add(bytesRead, bytes); }
+		void load(bool prefetch) { add(prefetch ? prefetchLoads : loads, 1u); }
+		void wasted() { add(prefetchWasted, 1u); }
+		//! A page is read from the stream because its read through the ring failed, and the ring is no longer used if stopped is set.
+		void fallback(bool stopped)
+		{
+			add(ringFallbacks, 1u);
+			if (stopped)
+				add(ringStopped, 1u);
+		}
+		void late() { add(prefetchLead, 1u); }
+		//! A prefetched page, loaded at a time, is being read for the first time.
+		void lead(Time loaded)
+		{
+			uint64_t ms{ (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - loaded).count() }, bucket{ 1u };
+			while (ms > 0u && bucket + 1u < WAV_STATS::leadBuckets)
+			{
+				ms >>= 1u;
+				++bucket;
+			}
+			add(prefetchLead + bucket, 1u);
+		}
+		//! The cache lock, asked for at a time, has been taken. Returns the time it was taken.
+		Time locked(Time asked, uint64_t offset, uint64_t bytes)
+		{
+			Time t{ Clock::now() };
+			add(lockWait, elapsed(asked, t));
+			span("wait", asked, t, offset, bytes);
+			return t;
+		}
+		//! The cache lock, taken at a time, is being released.
+		void unlocked(Time taken) { add(lockHeld, elapsed(taken, Clock::now())); }
+		//! A page, asked for at a time, has been read on demand. Returns the time it arrived.
+		Time loaded(Time asked, uint64_t offset, uint64_t bytes)
+		{
+			Time t{ Clock::now() };
+			add(loadTime, elapsed(asked, t));
+			span("load", asked, t, offset, bytes);
+			return t;
+		}
+		//! Trace a span from start until now.
+		void span(const char* name, Time start, uint64_t offset, uint64_t bytes) { span(name, start, Clock::now(), offset, bytes); }
+
+		void setTrace(std::function<void(const WAV_SPAN&)> trace) { m_trace = std::move(trace); }
+		WAV_STATS stats() const
+		{
+			WAV_STATS s{};
+			for (size_t i{ 0u }; i < (size_t)WAV_CALL::count; ++i)
+			{
+				s.hits[i] = get(hits + i);
+				s.misses[i] = get(misses + i);
+			}
+			s.bytesRead = get(bytesRead);
+			s.loads = get(loads);
+			s.prefetchLoads = get(prefetchLoads);
+			s.lockWaitNanoseconds = get(lockWait);
+			s.lockHeldNanoseconds = get(lockHeld);
+			s.loadNanoseconds = get(loadTime);
+			s.prefetchWasted = get(prefetchWasted);
+			s.ringFallbacks = get(ringFallbacks);
+			s.ringStopped = get(ringStopped);
+			for (size_t i{ 0u }; i < WAV_STATS::leadBuckets; ++i)
+				s.prefetchLead[i] = get(prefetchLead + i);
+			return s;
+		}
+	private:
+		//! Index of each counter in m_counters
+		enum : size_t
+		{
+			hits = 0u,
+			misses = hits + (size_t)WAV_CALL::count,
+			bytesRead = misses + (size_t)WAV_CALL::count,
+			loads, prefetchLoads, lockWait, lockHeld, loadTime, prefetchWasted, ringFallbacks, ringStopped,
+			prefetchLead,
+			counters = prefetchLead + WAV_STATS::leadBuckets
+		};
+		void add(size_t counter, uint64_t n) { m_counters[counter].fetch_add(n, std::memory_order_relaxed); }
+		size_t get(size_t counter) const { return (size_t)m_counters[counter].load(std::memory_order_relaxed); }
+		static uint64_t elapsed(Time from, Time to) { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count(); }
+		void span(const char* name, Time start, Time end, uint64_t offset, uint64_t bytes)
+		{
+			if (m_trace)
+				m_trace(WAV_SPAN{ name, start, end - start, offset, bytes });
+		}
+
+		std::atomic<uint64_t> m_counters[counters];
+		std::function<void(const WAV_SPAN&)> m_trace;
+	};
+#else
+	//! Stands in for the counters behind Waveread::stats() when WAVEREAD_STATS isn't defined: records nothing, and costs nothing.
+	class Recorder
+	{
+	public:
+		struct Time {};
+		static const bool enabled{ false };
+
+		void take(const Recorder&) {}
+		void reset() {}
+		static Time now() { return Time{}; }
+		void hit(WAV_CALL) {}
+		void miss(WAV_CALL) {}
+		void read(uint64_t) {}
+		void load(bool) {}
+		void wasted() {}
+		void fallback(bool) {}
+		void late() {}
+		void lead(Time) {}
+		Time locked(Time, uint64_t, uint64_t) { return Time{}; }
+		void unlocked(Time) {}
+		Time loaded(Time, uint64_t, uint64_t) { return Time{}; }
+		void span(const char*, Time, uint64_t, uint64_t) {}
+		void setTrace(std::function<void(const WAV_SPAN&)>) {}
+		WAV_STATS stats() const { return WAV_STATS{}; }
+	};
+#endif
+}
+
+//! Pool of threads for decoding in parallel
+/*!
+  Runs batches of tasks across a fixed set of threads. Each thread starts with its own contiguous share of a batch, taking tasks from the front;
+  a thread with none left steals from the back of another's, so a thread held up by slow reads doesn't hold up the batch. The thread calling run() works too.
+*/
+class Wavethreads
+{
+public:
+	//! Constructor
+	/*!
+	* \param threads number of threads that run tasks, including the caller of run(). At least one.
+	*/
+	explicit Wavethreads(size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+		:
+		m_threads{},
+		m_queues{ new Queue[std::max<size_t>(1u, threads)] },
+		m_size{ std::max<size_t>(1u, threads) },
+		m_runMutex{},
+		m_mutex{},
+		m_start{},
+		m_done{},
+		m_generation{ 0u },
+		m_busy{ 0u },
+		m_stop{ false },
+		m_task{ nullptr }
+	{
+		for (size_t t{ 1u }; t < m_size; ++t)
+			m_threads.emplace_back(&Wavethreads::loop, this, t);
+	}
+	//! Destructor. Waits for the threads to finish.
+	~Wavethreads()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_stop = true;
+		}
+		m_start.notify_all();
+		for (std::thread& thread : m_threads)
+			thread.join();
+	}
+	Wavethreads(const Wavethreads&) = delete;
+	Wavethreads& operator=(const Wavethreads&) = delete;
+
+	//! Get number of threads that run tasks, including the caller of run()
+	size_t size() const { return m_size; }
+	//! Run task(index, thread) for every index in [0, tasks), and wait for them all. thread is in [0, size()), and no two tasks run on the same thread at once.
+	void run(size_t tasks, const std::function<void(size_t, size_t)>& task)
+	{
+		std::lock_guard<std::mutex> run{ m_runMutex };
+		for (size_t q{ 0u }; q < m_size; ++q)
+		{
+			std::lock_guard<std::mutex> lock{ m_queues[q].mutex };
+			for (size_t i{ q * tasks / m_size }; i < (q + 1u) * tasks / m_size; ++i)
+				m_queues[q].tasks.push_back(i);
+		}
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			m_task = &task;
+			m_busy = m_size - 1u;
+			++m_generation;
+		}
+		m_start.notify_all();
+		work(0u, task);
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		m_done.wait(lock, [this]() { return m_busy == 0u; });
+		m_task = nullptr;
+	}
+
+private:
+	//! Tasks waiting to run on one thread
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+	//! Take the next task for a thread: its own first, then one stolen from the others.
+	bool next(size_t self, size_t& task)
+	{
+		for (size_t i{ 0u }; i < m_size; ++i)
+		{
+			Queue& q{ m_queues[(self + i) % m_size] };
+			std::lock_guard<std::mutex> lock{ q.mutex };
+			if (!q.tasks.empty())
+			{
+				if (i == 0u)
+				{
+					task = q.tasks.front();
+					q.tasks.pop_front();
 				}
+				else
+				{
+					task = q.tasks.back();
+					q.tasks.pop_back();
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+	//! Run tasks until there are none left.
+	void work(size_t self, const std::function<void(size_t, size_t)>& task)
+	{
+		size_t i{ 0u };
+		while (next(self, i))
+			task(i, self);
+	}
+	//! Worker thread: runs each batch, then tells run() it has finished.
+	void loop(size_t self)
+	{
+		size_t generation{ 0u };
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		while (true)
+		{
+			m_start.wait(lock, [&]() { return m_stop || m_generation != generation; });
+			if (m_stop)
+				return;
+			generation = m_generation;
+			const std::function<void(size_t, size_t)>& task{ *m_task };
+			lock.unlock();
+			work(self, task);
+			lock.lock();
+			if (--m_busy == 0u)
+				m_done.notify_all();
 		}
-		return result;
 	}
 
-	bool m_opened; /*!< Has the file been opened */
-	std::unique_ptr<std::istream> m_stream; /*!< Input stream */
+	std::vector<std::thread> m_threads; /*!< Worker threads */
+	std::unique_ptr<Queue[]> m_queues; /*!< Tasks of each thread, including the caller of run() at index 0 */
+	size_t m_size; /*!< Number of threads that run tasks */
+	std::mutex m_runMutex; /*!< Lets one run() at a time use the pool */
+	std::mutex m_mutex; /*!< Lock on the batch */
+	std::condition_variable m_start; /*!< Signalled when a batch starts, or the pool stops */
+	std::condition_variable m_done; /*!< Signalled when the last worker finishes a batch */
+	size_t m_generation; /*!< Number of batches started */
+	size_t m_busy; /*!< Number of workers yet to finish the batch */
+	bool m_stop; /*!< Tells the workers to finish */
+	const std::function<void(size_t, size_t)>* m_task; /*!< Task of the batch */
+};
 
-	WAV_HEADER m_header; /*!< Holds structure of header when opened, used in subsequent operations. */
-	std::vector<uint8_t> m_data;/*!< Cached data holding part of the data chunk of the WAV file. */
-	std::mutex m_dataMutex; /*!< Mutex to lock data when buffer is being extended */
-	size_t m_cachePos; /*!< At what point, from the start of the data chunk (i.e. cachePos == idx - 44u), does the cached data in m_data begin at. */
-	size_t m_cacheSize; /*!< How big should the cache (all channels) be in bytes */
-	double m_cacheExtensionThreshold; /*!< Within interval [0,1]. When a caller gets audio, how far into the cache should the caller go before the cache is triggered to be extended? */
+//! Ring of reads shared by many readers
+/*!
+  Readers constructed with a ring submit the reads that fill their caches to it, rather than each reading its stream in turn, so that
+  hundreds of readers streaming at once keep a fast device's queue full. Reads go through one io_uring: a reader submits its read and sleeps,
+  and a thread reaping completions wakes it when the read is done. Reads from many threads are in flight at once.
+
+  io_uring is used only when WAVEREAD_IO_URING is defined, on Linux. Without it, or if the kernel refuses a ring, reads are made with pread.
+*/
+class Wavering
+{
+public:
+	//! Constructor
+	/*!
+	* \param entries number of reads that can be in flight at once, which the kernel rounds up to a power of two. 0 makes no ring, so reads are made with pread.
+	*/
+	explicit Wavering(unsigned entries = 256u)
+		:
+		m_fd{ -1 },
+		m_wake{ -1 },
+		m_entries{ 0u },
+		m_sqRing{ nullptr },
+		m_cqRing{ nullptr },
+		m_sqSize{ 0u },
+		m_cqSize{ 0u },
+		m_sqes{ nullptr },
+		m_submitMutex{},
+		m_space{},
+		m_inFlight{ 0u },
+		m_reaper{},
+		m_reads{ 0u },
+		m_failed{ false }
+	{
+#if defined(WAVEREAD_URING)
+		io_uring_params params{};
+		int fd{ entries == 0u ? -1 : (int)::syscall(__NR_io_uring_setup, entries, &params) };
+		if (fd < 0)
+			return;
+		int wake{ ::eventfd(0u, EFD_CLOEXEC) };
+		if (wake < 0)
+		{
+			::close(fd);
+			return;
+		}
+		m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single{ (params.features & IORING_FEAT_SINGLE_MMAP) != 0u }; // both rings in one mapping
+		if (single)
+			m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+		void* sq{ ::mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING) };
+		void* cq{ single ? sq : ::mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING) };
+		void* sqes{ ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES) };
+		if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+		{
+			if (sq != MAP_FAILED)
+				::munmap(sq, m_sqSize);
+			if (!single && cq != MAP_FAILED)
+				::munmap(cq, m_cqSize);
+			if (sqes != MAP_FAILED)
+				::munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+			::close(wake);
+			::close(fd);
+			return;
+		}
+		m_sqRing = static_cast<uint8_t*>(sq);
+		m_cqRing = static_cast<uint8_t*>(cq);
+		m_sqes = static_cast<io_uring_sqe*>(sqes);
+		m_sqTail = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.tail);
+		m_sqMask = *reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.ring_mask);
+		m_sqArray = reinterpret_cast<unsigned*>(m_sqRing + params.sq_off.array);
+		m_cqHead = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.head);
+		m_cqTail = reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.tail);
+		m_cqMask = *reinterpret_cast<unsigned*>(m_cqRing + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(m_cqRing + params.cq_off.cqes);
+		m_entries = params.sq_entries; // the completion ring is larger, so it can't overflow while no more than this are in flight
+		m_fd = fd;
+		m_wake = wake;
+		m_reaper = std::thread{ &Wavering::reap, this };
+#else
+		(void)entries;
+#endif
+	}
+	//! Destructor. Every reader using the ring must have been destroyed first.
+	~Wavering()
+	{
+#if defined(WAVEREAD_URING)
+		if (m_fd < 0)
+			return;
+		uint64_t one{ 1u };
+		while (::write(m_wake, &one, sizeof(one)) < 0 && errno == EINTR) // a write to a fresh eventfd can only be interrupted
+			;
+		m_reaper.join();
+		::munmap(m_sqes, m_entries * sizeof(io_uring_sqe));
+		if (m_cqRing != m_sqRing)
+			::munmap(m_cqRing, m_cqSize);
+		::munmap(m_sqRing, m_sqSize);
+		::close(m_wake);
+		::close(m_fd);
+#endif
+	}
+	Wavering(const Wavering&) = delete;
+	Wavering& operator=(const Wavering&) = delete;
+
+	//! Are reads made through io_uring, rather than with pread?
+	bool asynchronous() const { return m_fd >= 0; }
+	//! Get number of reads made through io_uring
+	size_t reads() const { return m_reads.load(std::memory_order_relaxed); }
+	//! Read from a file, waiting until the read is done
+	/*!
+	* \param fd file descriptor, which may have been opened with O_DIRECT, in which case offset, size and to must be suitably aligned.
+	* \return number of bytes read, fewer than size only at the end of the file, or a negative error number, such as -EINVAL, if nothing could be read.
+	*/
+	long long read(int fd, uint64_t offset, size_t size, uint8_t* to)
+	{
+		size_t done{ 0u };
+		while (done < size)
+		{
+			long long n{ readOnce(fd, offset + done, size - done, to + done) };
+			if (n < 0)
+				return done == 0u ? n : (long long)done;
+			if (n == 0)
+				break;
+			done += (size_t)n;
+		}
+		return (long long)done;
+	}
+
+private:
+	//! Read waiting for its completion
+	struct Request
+	{
+		std::mutex mutex; /*!< Lock on the result */
+		std::condition_variable completed; /*!< Signalled by the reaper when the read is done */
+		bool done; /*!< Has the read completed? */
+		int result; /*!< Bytes read, or a negative error number */
+	};
+
+	//! Make a single read, which may read less than asked. Returns a negative error number if it fails.
+	long long readOnce(int fd, uint64_t offset, size_t size, uint8_t* to)
+	{
+#if defined(WAVEREAD_URING)
+		if (m_fd >= 0)
+		{
+			Request request{};
+			request.done = false;
+			request.result = 0;
+			size = std::min<size_t>(size, 1u << 30); // a read's length is 32 bits
+			if (!submit(IORING_OP_READ, fd, offset, to, (unsigned)size, &request))
+				return -(long long)errno;
+			std::unique_lock<std::mutex> lock{ request.mutex };
+			request.completed.wait(lock, [&request]() { return request.done; });
+			m_reads.fetch_add(1u, std::memory_order_relaxed);
+			return request.result;
+		}
+#endif
+#if defined(WAVEREAD_POSIX)
+		ssize_t n;
+		do
+			n = ::pread(fd, to, size, (off_t)offset);
+		while (n < 0 && errno == EINTR);
+		return n < 0 ? -(long long)errno : (long long)n;
+#else
+		(void)fd; (void)offset; (void)size; (void)to;
+		return -ENOSYS;
+#endif
+	}
+#if defined(WAVEREAD_URING)
+	//! Queue an operation on the submission ring, and tell the kernel, waiting first if the ring is full.
+	/*!
+	* If the kernel is short of resources, the entry is taken back and submitted again once some reads have completed, or after a millisecond.
+	* Returns false with errno set if the kernel refuses it, or the reaper has stopped.
+	*/
+	bool submit(uint8_t opcode, int fd, uint64_t offset, uint8_t* to, unsigned size, Request* request)
+	{
+		std::unique_lock<std::mutex> lock{ m_submitMutex };
+		for (;;)
+		{
+			m_space.wait(lock, [this]() { return m_failed || m_inFlight < m_entries; });
+			if (m_failed)
+			{
+				errno = ESHUTDOWN;
+				return false;
+			}
+			unsigned tail{ *m_sqTail }, index{ tail & m_sqMask }; // only submit() moves the tail, with the lock held
+			io_uring_sqe& sqe{ m_sqes[index] };
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = opcode;
+			sqe.fd = fd;
+			sqe.off = offset;
+			sqe.addr = (uint64_t)(uintptr_t)to;
+			sqe.len = size;
+			sqe.user_data = (uint64_t)(uintptr_t)request;
+			m_sqArray[index] = index;
+			WAVEREAD_TSAN_RELEASE(request);
+			__atomic_store_n(m_sqTail, tail + 1u, __ATOMIC_RELEASE);
+			long result;
+			do
+				result = ::syscall(__NR_io_uring_enter, m_fd, 1u, 0u, 0u, nullptr, 0u);
+			while (result < 0 && errno == EINTR);
+			if (result >= 0)
+			{
+				++m_inFlight;
+				return true;
+			}
+			int error{ errno };
+			__atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE); // the kernel didn't take it
+			if (error != EAGAIN && error != EBUSY)
+			{
+				errno = error;
+				return false;
+			}
+			m_space.wait_for(lock, std::chrono::milliseconds(1)); // lets the reaper free resources, and other submitters wait their turn
+		}
+	}
+	//! Wait for completions, and wake the reader of each. Runs on m_reaper until the destructor signals m_wake, or waiting fails for good.
+	/*!
+	* The ring's file is polled, rather than waited on with io_uring_enter, so that the destructor can stop the reaper through m_wake whatever state the ring is in.
+	* If polling fails, the ring is marked as failed and later reads are refused, so readers read from their streams instead.
+	*/
+	void reap()
+	{
+		pollfd fds[2]{ { m_fd, POLLIN, 0 }, { m_wake, POLLIN, 0 } };
+		for (;;)
+		{
+			if (::poll(fds, 2u, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if ((fds[1].revents & POLLIN) != 0)
+				return;
+			if ((fds[0].revents & (POLLERR | POLLNVAL)) != 0)
+				break;
+			unsigned head{ *m_cqHead }, tail{ __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) }, reaped{ 0u };
+			for (; head != tail; ++head, ++reaped)
+			{
+				const io_uring_cqe& cqe{ m_cqes[head & m_cqMask] };
+				Request* request{ reinterpret_cast<Request*>((uintptr_t)cqe.user_data) };
+				WAVEREAD_TSAN_ACQUIRE(request); // the CQ tail acquire orders the request, through the kernel
+				std::lock_guard<std::mutex> lock{ request->mutex }; // held while notifying, since the reader destroys the request once it sees it done
+				request->result = cqe.res;
+				request->done = true;
+				request->completed.notify_one();
+			}
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+			if (reaped > 0u)
+			{
+				std::lock_guard<std::mutex> lock{ m_submitMutex };
+				m_inFlight -= reaped;
+			}
+			m_space.notify_all();
+		}
+		{
+			std::lock_guard<std::mutex> lock{ m_submitMutex };
+			m_failed = true;
+		}
+		m_space.notify_all();
+	}
+#endif
+
+	int m_fd; /*!< io_uring file descriptor, or -1 if reads are made with pread */
+	int m_wake; /*!< eventfd that tells the reaper to finish */
+	unsigned m_entries; /*!< Size of the submission ring */
+	uint8_t* m_sqRing; /*!< Mapping of the submission ring */
+	uint8_t* m_cqRing; /*!< Mapping of the completion ring, which may be the same as the submission ring's */
+	size_t m_sqSize; /*!< Size of the submission ring's mapping */
+	size_t m_cqSize; /*!< Size of the completion ring's mapping */
+#if defined(WAVEREAD_URING)
+	io_uring_sqe* m_sqes; /*!< Submission entries */
+	io_uring_cqe* m_cqes; /*!< Completion entries */
+	unsigned* m_sqTail; /*!< Tail of the submission ring, moved by submit() */
+	unsigned* m_sqArray; /*!< Indices of submission entries, in order of submission */
+	unsigned m_sqMask; /*!< Mask giving a position in the submission ring */
+	unsigned* m_cqHead; /*!< Head of the completion ring, moved by the reaper */
+	unsigned* m_cqTail; /*!< Tail of the completion ring, moved by the kernel */
+	unsigned m_cqMask; /*!< Mask giving a position in the completion ring */
+#else
+	void* m_sqes; /*!< Unused without io_uring */
+#endif
+	std::mutex m_submitMutex; /*!< Lock on the submission ring */
+	std::condition_variable m_space; /*!< Signalled when reads complete, making room for more */
+	unsigned m_inFlight; /*!< Operations submitted and not yet reaped */
+	std::thread m_reaper; /*!< Thread reaping completions */
+	std::atomic<size_t> m_reads; /*!< Reads made through io_uring */
+	bool m_failed; /*!< Has the reaper stopped on an error? Guarded by m_submitMutex */
+};
+
+constexpr size_t WAV_SLAB_SIZE = 1048576u; /*!< Bytes of the data chunk decoded by each task of a parallel decode */
+
+namespace waveread_detail
+{
+	//! Decode frames in slabs across a pool of threads, straight into their place in the output.
+	/*!
+	* \param fetch called as fetch(firstFrame, frames, scratch) to get the bytes of frames from firstFrame. It may fill scratch, a buffer belonging to the calling thread, and return it,
+	* or return memory that already holds them. Returns nullptr if they couldn't be read.
+	* \return false if any slab couldn't be read.
+	*/
+	template<typename Fetch>
+	bool decodeSlabs(const WAV_HEADER& header, Wavethreads& threads, size_t startSample, size_t frames, float* out, const int* channels, size_t channelCount, bool interleaved, Fetch fetch)
+	{
+		size_t slabFrames{ std::max<size_t>(1u, WAV_SLAB_SIZE / (size_t)header.m_32_bytesPerBlock) };
+		std::vector<std::vector<uint8_t>> scratch(threads.size());
+		std::atomic<bool> failed{ false };
+		threads.run((frames + slabFrames - 1u) / slabFrames, [&](size_t slab, size_t thread) {
+			size_t first{ slab * slabFrames }, n{ std::min(slabFrames, frames - first) };
+			const uint8_t* src{ fetch(startSample + first, n, scratch[thread]) };
+			if (src == nullptr)
+				failed = true;
+			else
+				samples(header, src, n, 0u, channels, channelCount, out + (interleaved ? first * channelCount : first), interleaved ? channelCount : 1u, interleaved ? 1u : frames);
+		});
+		return !failed;
+	}
+}
+
+//! Wave reader
+/*!
+  Reads audio from an input stream.
+
+  Audio read from a stream is cached in fixed-size pages, each holding a whole number of frames from a fixed, page-aligned position in the data chunk.
+  Pages are kept within the cache size, and evicted with the CLOCK algorithm (an approximation of least-recently-used) when another is needed,
+  so a caller alternating between distant parts of a file keeps each part cached. A prefetch thread reads ahead of sequential callers.
+
+  ADPCM is coded in blocks that each begin with the decoder's state, so any sample is found by decoding only the block holding it.
+  Decoded blocks are kept in a second, smaller cache, so that scrubbing back and forth over the same blocks doesn't decode them again.
+*/
+class Waveread
+{
+public:
+	//! Constructor
+	/*!
+	* \param stream the input stream
+	* \param cacheSize the size of the cache. This should usually be a reasonable multiple of the size of the set of samples you expect to read each time you call audio().
+	* \param cacheExtensionThreshold Within interval [0,1]. When a caller gets audio, how far into the cache should the caller go before the cache is triggered to be extended?
+	* \param cachePageSize the size in bytes of each page of the cache, rounded down to a whole number of frames. No larger than cacheSize.
+	*/
+	Waveread(
+		std::unique_ptr<std::istream>&& stream,
+		size_t cacheSize = 1048576u,
+		double cacheExtensionThreshold = 0.5,
+		size_t cachePageSize = 65536u
+	)
+		:
+		m_opened{ false },
+		m_stream{ stream.release() },
+		m_header{},
+		m_dataMutex{},
+		m_cachePos{ 0u },
+		m_cacheSize{ cacheSize }, // 1MB == 1048576u
+		m_cacheExtensionThreshold{ cacheExtensionThreshold },
+		m_mapping{},
+		m_access{ WAV_ACCESS::normal },
+		m_cachePageSize{ cachePageSize },
+		m_pages{},
+		m_pageTable{},
+		m_buffers{},
+		m_pageFrames{ 0u },
+		m_pageBytes{ 0u },
+		m_bufferStride{ 0u },
+		m_spare{ 0u },
+		m_clockHand{ 0u },
+		m_cacheHits{ 0u },
+		m_cacheMisses{ 0u },
+		m_layoutStale{ false },
+		m_streamMutex{},
+		m_prefetcher{},
+		m_prefetchMutex{},
+		m_prefetchCondition{},
+		m_prefetchPending{ false },
+		m_prefetchBusy{ false },
+		m_prefetchPage{ 0u },
+		m_prefetchCount{ 0u },
+		m_prefetchGeneration{ 0u },
+		m_prefetchStop{ false },
+		m_jobs{},
+		m_jobSequence{ 0u },
+		m_recorder{},
+		m_overview{},
+		m_blockHeader{},
+		m_blockMutex{},
+		m_blocks{},
+		m_blockTable{},
+		m_blockSamples{},
+		m_blockHand{ 0u },
+		m_blocksDecoded{ 0u },
+		m_ring{ nullptr },
+		m_directFd{ -1 },
+		m_direct{},
+		m_mixMutex{},
+		m_mixScratch{}
+	{
+		if (m_cacheExtensionThreshold < 0.0)
+			m_cacheExtensionThreshold = 0.0;
+		else if (m_cacheExtensionThreshold > 1.0)
+			m_cacheExtensionThreshold = 1.0;
+
+		m_header.clear();
+	}
+
+	//! Constructor, from a file path
+	/*!
+	* Maps the file into memory and decodes straight from the mapping, so there is no cache to fill and no copy of the audio.
+	* Where the file can't be mapped, it is read through a std::ifstream, as with the stream constructor.
+	* \param path path of the WAV file
+	* \param access how audio will be read from the file. This is passed on to the kernel to tune read-ahead.
+	* \param cacheSize as in the stream constructor, used only if the file can't be mapped.
+	* \param cacheExtensionThreshold as in the stream constructor, used only if the file can't be mapped.
+	*/
+	explicit Waveread(
+		const std::string& path,
+		WAV_ACCESS access = WAV_ACCESS::sequential,
+		size_t cacheSize = 1048576u,
+		double cacheExtensionThreshold = 0.5
+	)
+		:
+		Waveread{ std::unique_ptr<std::istream>{}, cacheSize, cacheExtensionThreshold }
+	{
+		m_mapping = waveread_detail::Mapping{ path };
+		m_access = access;
+		if (m_mapping.data() != nullptr)
+			m_stream.reset(new waveread_detail::MemoryStream{ m_mapping.data(), m_mapping.size() });
+		else
+			m_stream.reset(new std::ifstream{ path, std::ios::binary });
+	}
+	//! Constructor, from a file path, reading the cache through a shared ring
+	/*!
+	* The file is read through the cache, as with the stream constructor, but pages are read through ring, with O_DIRECT where the file system allows it,
+	* so that they bypass the operating system's page cache rather than evicting other files' pages from it. Where the file can't be opened for
+	* positional reads, or a read through the ring fails, pages are read from a std::ifstream instead.
+	* \param path path of the WAV file
+	* \param ring ring to submit reads to, shared with other readers. It must outlive the reader.
+	* \param cacheSize as in the stream constructor.
+	* \param cacheExtensionThreshold as in the stream constructor.
+	* \param cachePageSize as in the stream constructor.
+	*/
+	Waveread(
+		const std::string& path,
+		Wavering& ring,
+		size_t cacheSize = 1048576u,
+		double cacheExtensionThreshold = 0.5,
+		size_t cachePageSize = 65536u
+	)
+		:
+		Waveread{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } }, cacheSize, cacheExtensionThreshold, cachePageSize }
+	{
+#if defined(WAVEREAD_POSIX)
+#if defined(O_DIRECT)
+		m_directFd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+#endif
+		if (m_directFd < 0)
+			m_directFd = ::open(path.c_str(), O_RDONLY);
+		if (m_directFd >= 0)
+			m_ring = &ring;
+#else
+		(void)ring;
+#endif
+	}
+
+	Waveread(const Waveread&) = delete;
+	Waveread& operator=(const Waveread&) = delete;
+
+	//! Move Constructor
+	/*!
+	* \param other	Another waveread object. The move constructor enables the placement of waveread objects in containers using std::move().
+	*				For instance you can do:
+	*				Waveread a{stream};
+	*				std::vector<Waveread> readers;
+	*				readers.push_back(std::move(a))
+	*				a is now unusable, but the vector now contains the wavereader.
+	*/
+	Waveread(Waveread&& other) noexcept
+		:
+		Waveread{ std::unique_ptr<std::istream>{}, other.m_cacheSize, other.m_cacheExtensionThreshold, other.m_cachePageSize }
+	{
+		other.stopPrefetcher(); // its thread works on other, so it must finish before other's state is taken. This reader starts its own when needed.
+		std::lock_guard<std::mutex> l{ other.m_dataMutex };
+		m_opened = other.m_opened;
+		m_stream.reset(other.m_stream.release());
+		m_header = other.m_header;
+		m_cachePos = other.m_cachePos;
+		m_mapping = std::move(other.m_mapping); // the memory stream points into the mapping, which stays where it is.
+		m_access = other.m_access;
+		m_pages = std::move(other.m_pages);
+		m_pageTable = std::move(other.m_pageTable);
+		m_buffers = std::move(other.m_buffers);
+		m_pageFrames = other.m_pageFrames;
+		m_pageBytes = other.m_pageBytes;
+		m_bufferStride = other.m_bufferStride;
+		m_spare = other.m_spare;
+		m_clockHand = other.m_clockHand;
+		m_cacheHits = other.m_cacheHits;
+		m_cacheMisses = other.m_cacheMisses;
+		m_layoutStale = other.m_layoutStale;
+		m_recorder.take(other.m_recorder);
+		m_overview = std::move(other.m_overview);
+		std::lock_guard<std::mutex> blockLock{ other.m_blockMutex };
+		m_blockHeader = other.m_blockHeader;
+		m_blocks = std::move(other.m_blocks);
+		m_blockTable = std::move(other.m_blockTable);
+		m_blockSamples = std::move(other.m_blockSamples);
+		m_blockHand = other.m_blockHand;
+		m_blocksDecoded = other.m_blocksDecoded;
+		m_ring = other.m_ring;
+		m_directFd = other.m_directFd;
+		m_direct = std::move(other.m_direct);
+		other.m_ring = nullptr;
+		other.m_directFd = -1;
+	}
+	//! Destructor. Stops the prefetch thread, waiting for any load in progress.
+	~Waveread()
+	{
+		stopPrefetcher();
+		closeDirect();
+	}
+	//! Reset
+	/*!
+	* Resets the wavereader, clearing all data.
+	* \param stream a new std::istream to read a wave file from.
+	*/
+	void reset(std::unique_ptr<std::istream>&& stream)
+	{
+		cancelPrefetch();
+		std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+		std::lock_guard<std::mutex> lock{ m_dataMutex };
+		m_stream = std::move(stream);
+		m_mapping = waveread_detail::Mapping{};
+		closeDirect();
+		clearCache();
+		m_overview.clear();
+		m_header.clear();
+		m_opened = false;
+	}
+	//! Open
+	/*!
+	* Loads the wave header from file, and fills the first page of the cache.
+	*/
+	bool open()
+	{
+		if (!m_opened)
+		{
+			m_header.read(*m_stream.operator->());
+			if (m_header.valid())
+			{
+				m_opened = true;
+				if (m_header.compressed()) // blocks are decoded to 16-bit integers
+				{
+					m_blockHeader = m_header;
+					m_blockHeader.m_20_audioFormat = (int16_t)WAV_FORMAT_PCM;
+					m_blockHeader.m_34_bitsPerSample = 16;
+					m_blockHeader.m_32_bytesPerBlock = (int16_t)(2 * m_header.m_22_numChannels);
+				}
+				if (mapped())
+					m_mapping.advise((size_t)m_header.m_dataOffset, (size_t)m_header.m_dataSize, m_access);
+				else
+				{
+					{
+						std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+						std::lock_guard<std::mutex> lock{ m_dataMutex };
+						layout();
+					}
+					std::unique_lock<std::mutex> lock{ m_dataMutex, std::defer_lock };
+					load(0u, lock);
+				}
+				return true;
+			}
+			else
+				return false; // we couldn't open it
+		}
+		return true; // we didn't open it, but it was already opened.
+	}
+	//! Close
+	/*!
+	* Closes the wavereader.
+	*/
+	void close()
+	{
+		cancelPrefetch();
+		std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+		std::lock_guard<std::mutex> lock{ m_dataMutex };
+		m_stream->seekg(0u);
+		clearCache();
+		m_overview.clear();
+		m_header.clear();
+		m_opened = false;
+	}
+	//! Audio
+	/*!
+	* Get interleaved floating point audio samples in the interval (-1.f,1.f). Samples of floating point files are passed through as they are, so may lie outside it.
+	* \param startSample index of first sample desired
+	* \param sampleCount number of samples needed including first sample
+	* \param channels Which channels would you like to retrieve. Zero-indexed. If channels are out of bounds, then their modulus with the channel count will be taken. This means if you ask for channels {0,1} from a mono file, you will retrieve two copies of the mono channel, interleaved.
+	* \param stride for each channel, when getting samples, skip every n samples where n == stride.
+	* \param interleaved determines how samples are ordered: true provides {C1S1, C2S1, ..., CMS1, C1S2, C2S2, ..., CMS2} false provides {C1S1, C1S2, ..., C1SN, C2S1, C2S2, ..., C2S2, ...}
+	*/
+	std::vector<float> audio(
+		size_t startSample, 
+		size_t sampleCount, 
+		const std::set<int>& channels = std::set<int>{ 0,1 }, 
+		size_t stride = 0u, 
+		bool interleaved = true
+	)
+	{
+		std::vector<int> ch{ channels.begin(), channels.end() };
+		if (!open() || ch.empty())
+			return std::vector<float>{};
+
+		size_t fileSamples{ (size_t)m_header.samples() };
+		size_t frames{ startSample < fileSamples ? std::min(sampleCount, fileSamples - startSample) : 0u };
+		std::vector<float> result(((frames + stride) / (1u + stride)) * ch.size());
+		if (!result.empty())
+			result.resize(audio(startSample, sampleCount, &result[0], result.size(), &ch[0], ch.size(), stride, interleaved, WAV_CALL::vector) * ch.size());
+		return result;
+	}
+	//! Audio, into a caller-provided buffer
+	/*!
+	* Same as audio() above, but decodes into memory owned by the caller. Once the requested range is cached, no heap allocation takes place, so this is the variant to call from a real-time thread.
+	* \param startSample index of first sample desired
+	* \param sampleCount number of samples needed including first sample
+	* \param out destination buffer, holding at least capacity floats.
+	* \param capacity number of floats that out can hold. If it is too small for the request, only as many whole frames as fit are written.
+	* \param channels array of channelCount zero-indexed channels. As in audio() above, out of bounds channels are taken modulo the channel count, and channels may be repeated.
+	* \param channelCount number of entries in channels
+	* \param stride for each channel, when getting samples, skip every n samples where n == stride.
+	* \param interleaved true provides {C1S1, C2S1, ..., CMS1, C1S2, ...}, false provides {C1S1, C1S2, ..., C1SN, C2S1, ...} where N is the return value.
+	* \return number of frames written, where a frame is one sample from each of the requested channels.
+	*/
+	size_t audio(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		size_t stride = 0u,
+		bool interleaved = true
+	)
+	{
+		return audio(startSample, sampleCount, out, capacity, channels, channelCount, stride, interleaved, WAV_CALL::buffer);
+	}
+	//! Audio, as integers or floating point
+	/*!
+	* Same as the audio() above, but decodes to a sample type of your choosing: int16_t, int32_t, float or double. Samples are converted straight from the file:
+	* integer samples are shifted to the width of an integer output, or scaled to (-1,1) for a floating point output; floating point samples are scaled
+	* to the width of an integer output, with rounding and clipping.
+	* \param out destination buffer, holding at least capacity samples, interleaved: {C1S1, C2S1, ..., CMS1, C1S2, ...}
+	* \return number of frames written
+	*/
+	template<typename T>
+	typename std::enable_if<waveread_detail::SampleType<T>::supported, size_t>::type audio( // enabled only for sample types, so that T* const* selects the planar audio() below
+		size_t startSample,
+		size_t sampleCount,
+		T* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		size_t stride = 0u
+	)
+	{
+		if (out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		size_t frames{ count(startSample, sampleCount, stride, capacity / channelCount) };
+		return decodeRange(startSample, frames, stride, WAV_CALL::typed, [&](const uint8_t* src, size_t first, size_t n) {
+			waveread_detail::samplesAs<T>(decodedHeader(), src, n, stride, channels, channelCount, waveread_detail::InterleavedOut<T>{ out, channelCount }, first);
+		});
+	}
+	//! Audio, as integers or floating point, into one buffer per channel
+	/*!
+	* Same as the audio() above, but planar: each channel is decoded into a buffer of its own.
+	* \param out array of channelCount buffers, one for each channel in channels, each holding at least capacity samples.
+	* \param capacity number of samples each buffer can hold.
+	* \return number of samples written to each buffer
+	*/
+	template<typename T>
+	size_t audio(
+		size_t startSample,
+		size_t sampleCount,
+		T* const* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		size_t stride = 0u
+	)
+	{
+		static_assert(waveread_detail::SampleType<T>::supported, "Waveread decodes to int16_t, int32_t, float or double.");
+		if (out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		size_t frames{ count(startSample, sampleCount, stride, capacity) };
+		return decodeRange(startSample, frames, stride, WAV_CALL::typed, [&](const uint8_t* src, size_t first, size_t n) {
+			waveread_detail::samplesAs<T>(decodedHeader(), src, n, stride, channels, channelCount, waveread_detail::PlanarOut<T>{ out }, first);
+		});
+	}
+	//! Mixdown
+	/*!
+	* Decode every channel and mix them down to any number of outputs with gains, in the same pass over the file's bytes as decoding: output o of each frame is
+	* gains[o] times the sum over channels c of matrix[o * numChannels + c] times channel c. For example, {0.5f, 0.5f} mixes stereo to mono, and a matrix of
+	* 2 rows of 6 mixes 5.1 to stereo. This saves audio() of every channel into a buffer of its own, and a second pass over that buffer to mix it.
+	* \param startSample index of first sample desired
+	* \param sampleCount number of samples needed including first sample
+	* \param out destination buffer, holding at least capacity floats, interleaved: {O1S1, O2S1, ..., ONS1, O1S2, ...}
+	* \param capacity number of floats that out can hold. If it is too small for the request, only as many whole frames as fit are written.
+	* \param matrix outputs rows of numChannels weights, one row for each output
+	* \param outputs number of outputs
+	* \param gains array of outputs gains, or nullptr for a gain of 1 on every output
+	* \param stride skip every n samples where n == stride.
+	* \return number of frames written. Performs no heap allocation once the requested range is cached and the reader's mix scratch has been sized by a first call,
+	* unless another thread is mixing from the same reader at the time: mix() never waits for it, and uses scratch of its own instead.
+	*/
+	size_t mix(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const float* matrix,
+		size_t outputs,
+		const float* gains = nullptr,
+		size_t stride = 0u
+	)
+	{
+		if (out == nullptr || matrix == nullptr || outputs == 0u)
+			return 0u;
+		size_t frames{ count(startSample, sampleCount, stride, capacity / outputs) };
+		if (frames == 0u)
+			return 0u;
+		std::unique_lock<std::mutex> lock{ m_mixMutex, std::try_to_lock };
+		std::vector<float> own{}; // only while another thread is mixing from this reader
+		std::vector<float>& scratch{ lock.owns_lock() ? m_mixScratch : own };
+		size_t need{ waveread_detail::mixScratch((size_t)m_header.m_22_numChannels) };
+		if (scratch.size() < need)
+			scratch.resize(need);
+		return decodeRange(startSample, frames, stride, WAV_CALL::typed, [&](const uint8_t* src, size_t first, size_t n) {
+			waveread_detail::mixSamples(decodedHeader(), src, n, stride, matrix, gains, outputs, out + first * outputs, &scratch[0]);
+		});
+	}
+	//! Mixdown, into a std::vector
+	/*!
+	* Same as mix() above, with as many outputs as matrix has rows of numChannels weights. Returns nothing if the size of matrix isn't a whole number of rows,
+	* or gains isn't empty and doesn't hold one gain for each output.
+	*/
+	std::vector<float> mix(
+		size_t startSample,
+		size_t sampleCount,
+		const std::vector<float>& matrix,
+		const std::vector<float>& gains = std::vector<float>{},
+		size_t stride = 0u
+	)
+	{
+		if (!open() || matrix.empty() || matrix.size() % (size_t)m_header.m_22_numChannels != 0u)
+			return std::vector<float>{};
+		size_t outputs{ matrix.size() / (size_t)m_header.m_22_numChannels };
+		if (!gains.empty() && gains.size() != outputs)
+			return std::vector<float>{};
+		std::vector<float> result(count(startSample, sampleCount, stride, (size_t)-1) * outputs);
+		if (!result.empty())
+			result.resize(mix(startSample, sampleCount, &result[0], result.size(), &matrix[0], outputs, gains.empty() ? nullptr : &gains[0], stride) * outputs);
+		return result;
+	}
+	//! Audio, decoded across a pool of threads
+	/*!
+	* Same as the audio() above, but splits the range into slabs of WAV_SLAB_SIZE bytes, and decodes them on every thread of a pool, each straight into its place in out.
+	* Slabs bypass the cache. A mapped file is decoded from the mapping; otherwise slabs are read from the stream one at a time, while others are decoded.
+	* ADPCM is decoded on the calling thread instead, through the block cache.
+	* \return number of frames written, or 0 if any part of the range couldn't be read.
+	*/
+	size_t audio(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		Wavethreads& threads,
+		bool interleaved = true
+	)
+	{
+		if (!open() || out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		if (m_header.compressed())
+			return audio(startSample, sampleCount, out, capacity, channels, channelCount, 0u, interleaved, WAV_CALL::buffer);
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		size_t fileSamples{ this->fileSamples() };
+		if (startSample >= fileSamples)
+			return 0u;
+		size_t frames{ std::min(std::min(sampleCount, fileSamples - startSample), capacity / channelCount) };
+		if (frames == 0u)
+			return 0u;
+
+		bool read{ false };
+		if (mapped())
+			read = waveread_detail::decodeSlabs(m_header, threads, startSample, frames, out, channels, channelCount, interleaved,
+				[this, bpb](size_t first, size_t, std::vector<uint8_t>&) -> const uint8_t* { return mappedData() + first * bpb; });
+		else
+			read = waveread_detail::decodeSlabs(m_header, threads, startSample, frames, out, channels, channelCount, interleaved,
+				[this, bpb](size_t first, size_t n, std::vector<uint8_t>& scratch) -> const uint8_t* {
+					scratch.resize(n * bpb);
+					waveread_detail::Recorder::Time start{ waveread_detail::Recorder::now() };
+					std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+					m_stream->seekg((std::streamoff)(m_header.m_dataOffset + first * bpb));
+					m_stream->read(reinterpret_cast<char*>(&scratch[0]), (std::streamsize)scratch.size());
+					bool read{ !m_stream->fail() };
+					m_stream->clear();
+					m_recorder.read(scratch.size());
+					m_recorder.span("read", start, first * bpb, scratch.size());
+					return read ? &scratch[0] : nullptr;
+				});
+		return read ? frames : 0u;
+	}
+	//! Audio, read in the background
+	/*!
+	* Same as the audio() returning a vector, but queued for the I/O thread of this reader, which also runs the prefetching. Once the file is open, returns at once,
+	* without waiting for the stream, so it can be called from a thread that mustn't block. Reads are served in order of deadline, as are prefetch() requests.
+	* The file is opened on the calling thread first if need be, so that the I/O thread never opens it while the caller reads.
+	* \param deadline when the audio is needed by. By default it is needed now, so it goes ahead of prefetches due later.
+	* \return a future that holds the audio once it has been read.
+	*/
+	std::future<std::vector<float>> audioAsync(
+		size_t startSample,
+		size_t sampleCount,
+		const std::set<int>& channels = std::set<int>{ 0,1 },
+		size_t stride = 0u,
+		bool interleaved = true,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+	)
+	{
+		std::shared_ptr<std::promise<std::vector<float>>> promise{ std::make_shared<std::promise<std::vector<float>>>() };
+		std::future<std::vector<float>> result{ promise->get_future() };
+		open();
+		schedule(deadline, [this, promise, startSample, sampleCount, channels, stride, interleaved]() {
+			try
+			{
+				promise->set_value(audio(startSample, sampleCount, channels, stride, interleaved));
+			}
+			catch (...)
+			{
+				promise->set_exception(std::current_exception());
+			}
+		});
+		return result;
+	}
+	//! Audio, read in the background, handed to a function
+	/*!
+	* Same as the audioAsync() above, but calls done with the audio on the I/O thread instead of returning a future. done must be quick,
+	* since prefetching waits for it.
+	*/
+	void audioAsync(
+		size_t startSample,
+		size_t sampleCount,
+		std::function<void(std::vector<float>)> done,
+		const std::set<int>& channels = std::set<int>{ 0,1 },
+		size_t stride = 0u,
+		bool interleaved = true,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+	)
+	{
+		open();
+		schedule(deadline, [this, done, startSample, sampleCount, channels, stride, interleaved]() {
+			done(audio(startSample, sampleCount, channels, stride, interleaved));
+		});
+	}
+	//! Audio, read in the background into a caller-provided buffer
+	/*!
+	* Same as the audio() into a buffer, but queued for the I/O thread, which calls done with the number of frames written.
+	* out and channels must stay valid until done is called.
+	*/
+	void audioAsync(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		std::function<void(size_t)> done,
+		size_t stride = 0u,
+		bool interleaved = true,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+	)
+	{
+		open();
+		schedule(deadline, [=]() {
+			done(audio(startSample, sampleCount, out, capacity, channels, channelCount, stride, interleaved));
+		});
+	}
+	//! Ask for a range of audio to be in the cache by a deadline
+	/*!
+	* Queues the pages holding the range for the I/O thread, which reads them in order of deadline alongside audioAsync() reads,
+	* and marks them as recently used, so they stay cached until read. Returns at once.
+	* A range larger than the cache is only read as far as fits. For a memory-mapped file, the kernel is asked to read the range in.
+	* \param startSample index of first sample
+	* \param sampleCount number of samples, including the first
+	* \param deadline when the audio will be needed
+	*/
+	void prefetch(size_t startSample, size_t sampleCount, std::chrono::steady_clock::time_point deadline)
+	{
+		if (!open() || sampleCount == 0u || startSample >= m_header.samples())
+			return;
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock }, last{ std::min(startSample + sampleCount, (size_t)m_header.samples()) - 1u };
+		size_t begin{ offset(startSample) }, end{ std::min(offset(last) + bpb, (size_t)m_header.m_dataSize) };
+		if (mapped())
+		{
+			m_mapping.willneed((size_t)m_header.m_dataOffset + begin, end - begin);
+			return;
+		}
+		size_t first{ 0u }, count{ 0u };
+		{
+			std::lock_guard<std::mutex> lock{ m_dataMutex };
+			if (m_layoutStale || m_pageBytes == 0u)
+				return;
+			first = begin / m_pageBytes;
+			count = std::min((end + m_pageBytes - 1u) / m_pageBytes - first, std::max<size_t>(1u, m_pages.size() - 1u)); // leave a slot for audio() to read into
+		}
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		if (!m_prefetchStop)
+			queue(Job{ deadline, 0u, first, count, false, std::function<void()>{} });
+	}
+
+	//! Batch of audio
+	/*!
+	* Get many ranges of audio at once, as audio() would give each of them. Ranges are sorted and merged where they overlap or lie
+	* within a cache page of each other, and each merged span that isn't already cached is read from the stream with a single seek and read,
+	* bypassing the cache, so that scattered reads don't evict it. Spans that are cached are decoded from the cache.
+	* \param ranges ranges of samples, in any order, and possibly overlapping.
+	* \param channels which channels to get, as in audio()
+	* \param interleaved sample layout, as in audio()
+	* \return the audio for each range, in the order of ranges. Ranges outside the file give no samples, and those running past its end are truncated.
+	*/
+	std::vector<std::vector<float>> readBatch(
+		const std::vector<WAV_RANGE>& ranges,
+		const std::set<int>& channels = std::set<int>{ 0,1 },
+		bool interleaved = true
+	)
+	{
+		std::vector<std::vector<float>> result(ranges.size());
+		std::vector<int> ch{ channels.begin(), channels.end() };
+		if (ch.empty() || !open())
+			return result;
+
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		size_t fileSamples{ this->fileSamples() };
+		std::vector<size_t> order{};
+		for (size_t i{ 0u }; i < ranges.size(); ++i)
+			if (ranges[i].startSample < fileSamples && ranges[i].sampleCount > 0u)
+			{
+				result[i].resize(std::min(ranges[i].sampleCount, fileSamples - ranges[i].startSample) * ch.size());
+				order.push_back(i);
+			}
+		std::sort(order.begin(), order.end(), [&ranges](size_t a, size_t b) { return ranges[a].startSample < ranges[b].startSample; });
+		if (m_header.compressed()) // decoded block by block, through the block cache
+		{
+			for (size_t i : order)
+				result[i].resize(audio(ranges[i].startSample, ranges[i].sampleCount, &result[i][0], result[i].size(), &ch[0], ch.size(), 0u, interleaved, WAV_CALL::batch) * ch.size());
+			return result;
+		}
+		auto decode = [&](size_t i, const uint8_t* src) {
+			size_t frames{ result[i].size() / ch.size() };
+			samples(src, frames, 0u, &ch[0], ch.size(), &result[i][0], interleaved ? ch.size() : 1u, interleaved ? 1u : frames);
+		};
+
+		if (mapped())
+		{
+			for (size_t i : order) // in file order, so the mapping is paged in with one pass
+				decode(i, mappedData() + ranges[i].startSample * bpb);
+			return result;
+		}
+
+		size_t gap{ std::max<size_t>(1u, m_cachePageSize / bpb) };
+		std::vector<uint8_t> span{};
+		for (size_t first{ 0u }, last{ 0u }; first < order.size(); first = last)
+		{
+			size_t begin{ ranges[order[first]].startSample }, end{ begin + result[order[first]].size() / ch.size() };
+			for (last = first + 1u; last < order.size() && ranges[order[last]].startSample <= end + gap; ++last)
+				end = std::max(end, ranges[order[last]].startSample + result[order[last]].size() / ch.size());
+
+			bool read{ false };
+			if (!cached(begin * bpb, end * bpb))
+			{
+				span.resize((end - begin) * bpb);
+				waveread_detail::Recorder::Time start{ waveread_detail::Recorder::now() };
+				std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+				m_stream->seekg((std::streamoff)(m_header.m_dataOffset + begin * bpb));
+				m_stream->read(reinterpret_cast<char*>(&span[0]), (std::streamsize)span.size());
+				read = !m_stream->fail();
+				m_stream->clear();
+				m_recorder.read(span.size());
+				m_recorder.span("read", start, begin * bpb, span.size());
+			}
+			for (size_t k{ first }; k < last; ++k)
+			{
+				size_t i{ order[k] };
+				if (read)
+					decode(i, &span[(ranges[i].startSample - begin) * bpb]);
+				else // cached, or the file is shorter than its header claims
+					result[i].resize(audio(ranges[i].startSample, ranges[i].sampleCount, &result[i][0], result[i].size(), &ch[0], ch.size(), 0u, interleaved, WAV_CALL::batch) * ch.size());
+			}
+		}
+		return result;
+	}
+
+	//! Build overview
+	/*!
+	* Reads the whole file once to build a pyramid of peak and RMS summaries, used by overview(). The finest level summarises every WAV_OVERVIEW_BLOCK_SIZE frames, and each coarser level merges pairs of entries from the level below.
+	* \return false if the file couldn't be read.
+	*/
+	bool buildOverview()
+	{
+		m_overview.clear();
+		if (!open())
+			return false;
+
+		size_t nch{ (size_t)m_header.m_22_numChannels }, fileSamples{ (size_t)m_header.samples() };
+		std::vector<int> channels(nch);
+		std::iota(channels.begin(), channels.end(), 0);
+		std::vector<float> buffer(WAV_OVERVIEW_BLOCK_SIZE * 256u * nch);
+		std::vector<OverviewBlock> level(((fileSamples + WAV_OVERVIEW_BLOCK_SIZE - 1u) / WAV_OVERVIEW_BLOCK_SIZE) * nch,
+			OverviewBlock{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.0 });
+		for (size_t start{ 0u }; start < fileSamples; )
+		{
+			size_t frames{ audio(start, buffer.size() / nch, &buffer[0], buffer.size(), &channels[0], nch) };
+			if (frames == 0u)
+				return false;
+			for (size_t f{ 0u }; f < frames; ++f)
+			{
+				OverviewBlock* block{ &level[((start + f) / WAV_OVERVIEW_BLOCK_SIZE) * nch] };
+				for (size_t c{ 0u }; c < nch; ++c)
+				{
+					float v{ buffer[f * nch + c] };
+					block[c].min = std::min(block[c].min, v);
+					block[c].max = std::max(block[c].max, v);
+					block[c].squares += (double)v * v;
+				}
+			}
+			start += frames;
+		}
+		m_overview.push_back(std::move(level));
+		while (m_overview.back().size() > nch) // merge pairs until a single entry covers the file
+		{
+			const std::vector<OverviewBlock>& fine{ m_overview.back() };
+			size_t fineBlocks{ fine.size() / nch };
+			std::vector<OverviewBlock> coarse(((fineBlocks + 1u) / 2u) * nch);
+			for (size_t b{ 0u }; b < fineBlocks; ++b)
+				for (size_t c{ 0u }; c < nch; ++c)
+				{
+					OverviewBlock& to{ coarse[(b / 2u) * nch + c] };
+					const OverviewBlock& from{ fine[b * nch + c] };
+					to = (b % 2u == 0u) ? from : OverviewBlock{ std::min(to.min, from.min), std::max(to.max, from.max), to.squares + from.squares };
+				}
+			m_overview.push_back(std::move(coarse));
+		}
+		return true;
+	}
+	//! Overview
+	/*!
+	* Summarise audio for drawing a waveform: divide a range of samples into pixels, and give the peaks and RMS of each. Builds the overview first if need be.
+	* Each pixel is answered from the coarsest level of the overview whose entries are no longer than the pixel, so the cost is proportional to the number of pixels, not samples.
+	* A pixel therefore includes the whole of the entries at its edges. When pixels are shorter than WAV_OVERVIEW_BLOCK_SIZE, the audio is read instead.
+	* \param startSample index of first sample
+	* \param sampleCount number of samples to summarise
+	* \param pixels number of summaries to divide the samples into
+	* \param channels which channels to summarise, as in audio()
+	* \return pixels summaries for each channel, interleaved as in audio(): {C1P1, C2P1, ..., C1P2, C2P2, ...}. Empty if the range is outside the file.
+	*/
+	std::vector<WAV_PEAK> overview(
+		size_t startSample,
+		size_t sampleCount,
+		size_t pixels,
+		const std::set<int>& channels = std::set<int>{ 0,1 }
+	)
+	{
+		std::vector<int> ch{ channels.begin(), channels.end() };
+		if (pixels == 0u || ch.empty() || !open())
+			return std::vector<WAV_PEAK>{};
+		size_t fileSamples{ (size_t)m_header.samples() }, nch{ (size_t)m_header.m_22_numChannels };
+		if (startSample >= fileSamples)
+			return std::vector<WAV_PEAK>{};
+		sampleCount = std::min(sampleCount, fileSamples - startSample);
+		pixels = std::min(pixels, sampleCount);
+		double samplesPerPixel{ (double)sampleCount / (double)pixels };
+
+		std::vector<WAV_PEAK> result(pixels * ch.size());
+		if (samplesPerPixel < (double)WAV_OVERVIEW_BLOCK_SIZE) // zoomed in: summarise the samples themselves
+		{
+			std::vector<float> audioSamples(sampleCount * ch.size());
+			if (audio(startSample, sampleCount, &audioSamples[0], audioSamples.size(), &ch[0], ch.size()) != sampleCount)
+				return std::vector<WAV_PEAK>{};
+			for (size_t p{ 0u }; p < pixels; ++p)
+			{
+				size_t s0{ (size_t)(p * samplesPerPixel) }, s1{ std::max(s0 + 1u, (size_t)((p + 1u) * samplesPerPixel)) };
+				for (size_t c{ 0u }; c < ch.size(); ++c)
+				{
+					WAV_PEAK peak{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.f };
+					double squares{ 0.0 };
+					for (size_t i{ s0 }; i < s1; ++i)
+					{
+						float v{ audioSamples[i * ch.size() + c] };
+						peak.min = std::min(peak.min, v);
+						peak.max = std::max(peak.max, v);
+						squares += (double)v * v;
+					}
+					peak.rms = (float)std::sqrt(squares / (double)(s1 - s0));
+					result[p * ch.size() + c] = peak;
+				}
+			}
+			return result;
+		}
+
+		if (m_overview.empty() && !buildOverview())
+			return std::vector<WAV_PEAK>{};
+		size_t level{ 0u };
+		while (level + 1u < m_overview.size() && (double)(WAV_OVERVIEW_BLOCK_SIZE << (level + 1u)) <= samplesPerPixel)
+			++level;
+		const std::vector<OverviewBlock>& blocks{ m_overview[level] };
+		size_t blockFrames{ WAV_OVERVIEW_BLOCK_SIZE << level };
+		for (size_t p{ 0u }; p < pixels; ++p)
+		{
+			size_t s0{ startSample + (size_t)(p * samplesPerPixel) }, s1{ startSample + (size_t)((p + 1u) * samplesPerPixel) };
+			size_t b0{ s0 / blockFrames }, b1{ (s1 - 1u) / blockFrames }; // at most three entries, since entries are no longer than the pixel
+			size_t frames{ std::min((b1 + 1u) * blockFrames, fileSamples) - b0 * blockFrames };
+			for (size_t c{ 0u }; c < ch.size(); ++c)
+			{
+				size_t cho{ (size_t)(ch[c] % m_header.m_22_numChannels) };
+				WAV_PEAK peak{ std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), 0.f };
+				double squares{ 0.0 };
+				for (size_t b{ b0 }; b <= b1; ++b)
+				{
+					const OverviewBlock& block{ blocks[b * nch + cho] };
+					peak.min = std::min(peak.min, block.min);
+					peak.max = std::max(peak.max, block.max);
+					squares += block.squares;
+				}
+				peak.rms = (float)std::sqrt(squares / (double)frames);
+				result[p * ch.size() + c] = peak;
+			}
+		}
+		return result;
+	}
+	//! Save overview
+	/*!
+	* Write the overview to a stream, building it first if need be, so it can be kept in a sidecar file and loaded with loadOverview() instead of being built again.
+	* The format is native-endian.
+	*/
+	bool saveOverview(std::ostream& s)
+	{
+		if (m_overview.empty() && !buildOverview())
+			return false;
+		uint32_t version{ WAV_OVERVIEW_VERSION }, levels{ (uint32_t)m_overview.size() }, blockSize{ (uint32_t)WAV_OVERVIEW_BLOCK_SIZE };
+		uint64_t dataSize{ m_header.m_dataSize };
+		s.write(WAV_OVERVIEW_MAGIC, 4);
+		s.write((const char*)&version, 4);
+		s.write((const char*)&blockSize, 4);
+		s.write((const char*)&m_header.m_22_numChannels, 2);
+		s.write((const char*)&m_header.m_34_bitsPerSample, 2);
+		s.write((const char*)&dataSize, 8);
+		s.write((const char*)&levels, 4);
+		for (const std::vector<OverviewBlock>& level : m_overview)
+		{
+			uint64_t entries{ (uint64_t)level.size() };
+			s.write((const char*)&entries, 8);
+			s.write((const char*)level.data(), (std::streamsize)(level.size() * sizeof(OverviewBlock)));
+		}
+		return s.good();
+	}
+	//! Load overview
+	/*!
+	* Read an overview written by saveOverview(). Fails, leaving the overview unchanged, if it was saved from a file with a different layout, by another version,
+	* or if its number of levels or entries doesn't match the file: nothing is allocated for a level until its size has been checked.
+	*/
+	bool loadOverview(std::istream& s)
+	{
+		if (!open())
+			return false;
+		char magic[4]{};
+		uint32_t version{ 0u }, blockSize{ 0u }, levels{ 0u };
+		int16_t channels{ 0 }, bits{ 0 };
+		uint64_t dataSize{ 0u };
+		s.read(magic, 4);
+		s.read((char*)&version, 4);
+		s.read((char*)&blockSize, 4);
+		s.read((char*)&channels, 2);
+		s.read((char*)&bits, 2);
+		s.read((char*)&dataSize, 8);
+		s.read((char*)&levels, 4);
+		if (!s.good() || !std::equal(magic, magic + 4, WAV_OVERVIEW_MAGIC) || version != WAV_OVERVIEW_VERSION || blockSize != WAV_OVERVIEW_BLOCK_SIZE ||
+			channels != m_header.m_22_numChannels || bits != m_header.m_34_bitsPerSample || dataSize != m_header.m_dataSize)
+			return false;
+
+		size_t entries{ (((size_t)m_header.samples() + WAV_OVERVIEW_BLOCK_SIZE - 1u) / WAV_OVERVIEW_BLOCK_SIZE) * (size_t)channels };
+		uint32_t expected{ 1u }; // buildOverview() merges pairs of entries until one covers the file
+		for (size_t blocks{ entries / (size_t)channels }; blocks > 1u; blocks = (blocks + 1u) / 2u)
+			++expected;
+		if (levels != expected)
+			return false;
+		std::vector<std::vector<OverviewBlock>> overview(levels);
+		for (std::vector<OverviewBlock>& level : overview)
+		{
+			uint64_t count{ 0u };
+			s.read((char*)&count, 8);
+			if (!s.good() || count != (uint64_t)entries)
+				return false;
+			level.resize(entries);
+			s.read((char*)level.data(), (std::streamsize)(entries * sizeof(OverviewBlock)));
+			entries = ((entries / (size_t)channels + 1u) / 2u) * (size_t)channels;
+		}
+		if (s.fail() || overview.empty())
+			return false;
+		m_overview = std::move(overview);
+		return true;
+	}
+	//! Has an overview been built or loaded?
+	bool hasOverview() const { return !m_overview.empty(); }
+
+	//! Get header file
+	const WAV_HEADER& header() const { return m_header; }
+	//! Get size of cache
+	const size_t& cacheSize() const { return m_cacheSize; }
+	//! Get size of each page of the cache, as requested. Pages hold a whole number of frames, so may be slightly smaller.
+	const size_t& cachePageSize() const { return m_cachePageSize; }
+	//! Get start position of the most recently loaded page of the cache
+	const size_t& cachePos() const { return m_cachePos; }
+	//! Get number of cache pages that audio() has found cached
+	size_t cacheHits() const { return m_cacheHits; }
+	//! Get number of cache pages that audio() has had to read
+	size_t cacheMisses() const { return m_cacheMisses; }
+	//! Get bytes of memory held by the caches of this reader
+	/*!
+	* Counts the page buffers, with the spare page and alignment, the page table, and for ADPCM files the block cache, whether or not it has been filled yet.
+	* A memory-mapped file's pages belong to the kernel, so aren't counted. Zero until the file has been opened.
+	*/
+	size_t footprint()
+	{
+		size_t bytes{ 0u };
+		{
+			std::lock_guard<std::mutex> lock{ m_dataMutex };
+			bytes += m_buffers.capacity() + m_pages.capacity() * sizeof(Page) + m_pageTable.capacity() * sizeof(int);
+		}
+		if (m_opened && m_header.compressed())
+		{
+			size_t samples{ (size_t)m_header.m_samplesPerBlock * (size_t)m_header.m_22_numChannels };
+			bytes += blockSlots(samples) * (samples * sizeof(int16_t) + sizeof(Block)) + blockCount() * sizeof(int);
+		}
+		return bytes;
+	}
+	//! Get number of ADPCM blocks that audio() has decoded. A block stays decoded in the block cache until evicted, so reading it again doesn't add to this.
+	size_t blocksDecoded()
+	{
+		std::lock_guard<std::mutex> lock{ m_blockMutex };
+		return m_blocksDecoded;
+	}
+	//! Get a snapshot of the counters of this reader: cache hits and misses for each way of reading, bytes read, time spent on the cache lock, and how early prefetched pages arrived.
+	/*!
+	* Counters are only kept if WAVEREAD_STATS is defined before waveread.hpp is included. Otherwise they cost nothing, and are all zero.
+	* The counters are read one at a time, while other threads may be updating them, so they may disagree with each other slightly.
+	*/
+	WAV_STATS stats() const { return m_recorder.stats(); }
+	//! Set all counters of stats() to zero.
+	void resetStats() { m_recorder.reset(); }
+	//! Set a function to call with each span of time spent reading or waiting, for tracing. Pass an empty function to stop.
+	/*!
+	* The function is called on whichever thread the span took place, including the prefetch thread, so it must be quick and thread-safe.
+	* Set it before reading, not while another thread is reading. It is only called if WAVEREAD_STATS is defined.
+	*/
+	void setTrace(std::function<void(const WAV_SPAN&)> trace) { m_recorder.setTrace(std::move(trace)); }
+	//! Has the file been opened
+	const bool& opened() const { return m_opened; }
+	//! Is the file memory-mapped, rather than read through a stream into the cache?
+	bool mapped() const { return m_mapping.data() != nullptr; }
+	//! Get access pattern hint of a memory-mapped reader
+	const WAV_ACCESS& access() const { return m_access; }
+	//! Get cache extension threshold: this is the fraction of the cache that is read before it is extended.
+	const double& cacheExtensionThreshold() const { return m_cacheExtensionThreshold; }
+
+
+	//! Set cache extension threshold. Does not extend the cache until audio() has been called. Function will halt until the last cache page has been loaded.
+	void setCacheExtensionThreshold(const double& cacheExtensionThreshold)
+	{
+		std::lock_guard<std::mutex> l{ m_dataMutex };
+		m_cacheExtensionThreshold = std::min(1.0, std::max(0.0, cacheExtensionThreshold));
+	}
+	//! Set access pattern hint. Takes effect immediately if the file is mapped and open.
+	void setAccess(WAV_ACCESS access)
+	{
+		m_access = access;
+		if (mapped() && m_opened)
+			m_mapping.advise((size_t)m_header.m_dataOffset, (size_t)m_header.m_dataSize, m_access);
+	}
+	//! Set cache size. The cache is emptied and resized when audio() is next called. Function will halt until the last cache page has been loaded.
+	void setCacheSize(const size_t& csize)
+	{
+		std::lock_guard<std::mutex> l{ m_dataMutex };
+		m_cacheSize = csize;
+		m_layoutStale = true;
+	}
+	//! Set cache page size. The cache is emptied and resized when audio() is next called. Function will halt until the last cache page has been loaded.
+	void setCachePageSize(const size_t& psize)
+	{
+		std::lock_guard<std::mutex> l{ m_dataMutex };
+		m_cachePageSize = psize;
+		m_layoutStale = true;
+	}
+private:
+	//! Entry of an overview level: peaks and sum of squares for one channel over a run of frames
+	struct OverviewBlock
+	{
+		float min;
+		float max;
+		double squares; /*!< Kept in double, since a coarse entry sums the squares of millions of samples */
+	};
+	//! A page of the cache
+	struct Page
+	{
+		size_t page; /*!< Index of the page in the data chunk, or SIZE_MAX if this slot is empty */
+		size_t buffer; /*!< Index of the buffer holding the page */
+		bool referenced; /*!< Has the page been read since the clock hand last passed? */
+		bool prefetched; /*!< Was the page read by the prefetch thread, and not yet by audio()? */
+		waveread_detail::Recorder::Time loaded; /*!< When the page was read, if WAVEREAD_STATS is defined */
+	};
+	//! Slot of the block cache, holding an ADPCM block decoded to 16-bit samples
+	struct Block
+	{
+		size_t block; /*!< Index of the block in the data chunk, or SIZE_MAX if this slot is empty */
+		size_t frames; /*!< Frames decoded from the block */
+		bool referenced; /*!< Has the block been read since the clock hand last passed? */
+		unsigned pins; /*!< Readers converting samples from the slot without the lock, which keep it from being evicted */
+	};
+	//! Work for the I/O thread: a task, or else pages to load
+	struct Job
+	{
+		std::chrono::steady_clock::time_point deadline; /*!< When the job should be done by */
+		size_t sequence; /*!< Order in which jobs were queued, so that jobs due at the same time run in that order */
+		size_t page; /*!< First page to load */
+		size_t count; /*!< Number of pages to load */
+		bool readahead; /*!< Is this the read-ahead of audio(), rather than a prefetch()? */
+		std::function<void()> task; /*!< Task of audioAsync() to run */
+
+		//! Is a due after b? Orders the heap of jobs so that the earliest is at the front.
+		static bool later(const Job& a, const Job& b) { return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence; }
+	};
+
+	//! Size the cache for the opened file, emptying it. Call with m_streamMutex and m_dataMutex held.
+	void layout()
+	{
+		const size_t alignment{ 4096u };
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		m_pageFrames = std::max<size_t>(1u, std::min(m_cachePageSize, m_cacheSize) / bpb);
+		m_pageBytes = m_pageFrames * bpb;
+		m_bufferStride = (m_pageBytes + alignment - 1u) / alignment * alignment; // so that every buffer starts on an aligned address
+		size_t slots{ std::max<size_t>(1u, m_cacheSize / m_pageBytes) };
+		m_pages.assign(slots, Page{ SIZE_MAX, 0u, false, false, waveread_detail::Recorder::Time{} });
+		for (size_t i{ 0u }; i < slots; ++i)
+			m_pages[i].buffer = i;
+		m_spare = slots; // one more buffer than pages, to read into before it is swapped into the cache.
+		m_buffers.assign((slots + 1u) * m_bufferStride + alignment, 0u);
+		m_pageTable.assign(((size_t)m_header.m_dataSize + m_pageBytes - 1u) / m_pageBytes, -1);
+		m_clockHand = 0u;
+		m_cachePos = 0u;
+		m_layoutStale = false;
+	}
+	//! Free the cache. Call with m_streamMutex and m_dataMutex held.
+	void clearCache()
+	{
+		std::vector<Page>{}.swap(m_pages);
+		std::vector<int>{}.swap(m_pageTable);
+		std::vector<uint8_t>{}.swap(m_buffers);
+		m_cachePos = 0u;
+		std::lock_guard<std::mutex> blockLock{ m_blockMutex };
+		std::vector<Block>{}.swap(m_blocks);
+		std::vector<int>{}.swap(m_blockTable);
+		std::vector<int16_t>{}.swap(m_blockSamples);
+	}
+	//! Address of a buffer, aligned within m_buffers.
+	uint8_t* buffer(size_t index)
+	{
+		uintptr_t base{ reinterpret_cast<uintptr_t>(m_buffers.data()) };
+		return m_buffers.data() + ((4096u - base % 4096u) % 4096u) + index * m_bufferStride;
+	}
+	//! Load a page into the cache.
+	/*!
+	* Reads into the spare buffer without holding m_dataMutex, then swaps it into the cache in place of a page chosen by the CLOCK algorithm.
+	* \param page index of the page in the data chunk
+	* \param lock an unlocked lock on m_dataMutex. It is returned locked, so the caller can decode the page before anything evicts it.
+	* \return the page's slot in m_pages, or -1 if it couldn't be read.
+	*/
+	int load(size_t page, std::unique_lock<std::mutex>& lock)
+	{
+		std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+		return loadLocked(page, lock);
+	}
+	//! Load a page into the cache, as load(), with m_streamMutex already held. prefetch tells whether the prefetch thread is loading it.
+	int loadLocked(size_t page, std::unique_lock<std::mutex>& lock, bool prefetch = false)
+	{
+		lock.lock();
+		if (page >= m_pageTable.size())
+			return -1;
+		if (m_pageTable[page] >= 0) // loaded by the prefetch thread in the meantime
+			return m_pageTable[page];
+		lock.unlock();
+		waveread_detail::Recorder::Time start{ waveread_detail::Recorder::now() };
+		bool read{ fill(page) };
+		m_recorder.load(prefetch);
+		if (prefetch)
+			m_recorder.span("prefetch", start, page * m_pageBytes, m_pageBytes);
+		lock.lock();
+		if (!read || page >= m_pageTable.size())
+			return -1;
+
+		while (m_pages[m_clockHand].referenced) // CLOCK: give every referenced page a second chance, and evict the first that has had one.
+		{
+			m_pages[m_clockHand].referenced = false;
+			m_clockHand = (m_clockHand + 1u) % m_pages.size();
+		}
+		Page& victim{ m_pages[m_clockHand] };
+		if (victim.page != SIZE_MAX)
+			m_pageTable[victim.page] = -1;
+		if (victim.prefetched)
+			m_recorder.wasted();
+		std::swap(victim.buffer, m_spare);
+		victim.page = page;
+		victim.referenced = false; // until audio() reads it: so prefetched pages that go unread are the first to be evicted.
+		victim.prefetched = prefetch;
+		victim.loaded = waveread_detail::Recorder::now();
+		m_pageTable[page] = (int)m_clockHand;
+		m_cachePos = page * m_pageBytes;
+		m_clockHand = (m_clockHand + 1u) % m_pages.size();
+		return m_pageTable[page];
+	}
+	//! Are all of the pages holding a range of bytes of the data chunk cached?
+	bool cached(size_t begin, size_t end)
+	{
+		std::lock_guard<std::mutex> lock{ m_dataMutex };
+		if (m_layoutStale || m_pageBytes == 0u)
+			return false;
+		for (size_t page{ begin / m_pageBytes }; page * m_pageBytes < end; ++page)
+			if (page >= m_pageTable.size() || m_pageTable[page] < 0)
+				return false;
+		return true;
+	}
+	//! Read a page from the stream, or through the ring, into the spare buffer. Call with m_streamMutex held.
+	bool fill(size_t page)
+	{
+		size_t pos{ page * m_pageBytes };
+		if (pos < (size_t)m_header.m_dataSize)
+		{
+			size_t size{ std::min(m_pageBytes, (size_t)m_header.m_dataSize - pos) };
+			if (m_ring != nullptr && fillDirect(pos, size))
+				return true;
+			m_stream->seekg((std::streamoff)(m_header.m_dataOffset + pos));
+			if (m_stream->good())
+			{
+				m_stream->read(reinterpret_cast<char*>(buffer(m_spare)), size);
+				m_recorder.read(size);
+				bool read{ !m_stream->fail() };
+				m_stream->clear(); // clear eof, so the next seek succeeds.
+				return read;
+			}
+		}
+		return false;
+	}
+	//! Read bytes of the data chunk into the spare buffer through the ring. Call with m_streamMutex held.
+	/*!
+	* Reads the whole 4096-byte blocks of the file holding the bytes, as O_DIRECT needs, into an aligned buffer, then copies the bytes out.
+	* A read that fails or falls short is tried once more, since an interrupted or short read may not recur. If that fails too, the caller reads the page from the stream,
+	* and only errors that can't go away, such as O_DIRECT alignment being refused, stop the reader using the ring. Both are counted in stats().
+	*/
+	bool fillDirect(size_t pos, size_t size)
+	{
+		const uint64_t alignment{ 4096u };
+		uint64_t at{ m_header.m_dataOffset + pos }, begin{ at / alignment * alignment }, end{ (at + size + alignment - 1u) / alignment * alignment };
+		if (m_direct.size() < (size_t)(end - begin + alignment))
+			m_direct.assign((size_t)(end - begin + alignment), 0u);
+		uint8_t* aligned{ m_direct.data() + (alignment - reinterpret_cast<uintptr_t>(m_direct.data()) % alignment) % alignment };
+		long long needed{ (long long)(at - begin + size) }, read{ m_ring->read(m_directFd, begin, (size_t)(end - begin), aligned) };
+		if (read < needed)
+			read = m_ring->read(m_directFd, begin, (size_t)(end - begin), aligned);
+		if (read < needed)
+		{
+			bool lasting{ read == -EINVAL || read == -EBADF || read == -EOPNOTSUPP || read == -ENOSYS || read == -ESHUTDOWN };
+			if (lasting)
+				m_ring = nullptr;
+			m_recorder.fallback(lasting);
+			return false;
+		}
+		std::memcpy(buffer(m_spare), aligned + (at - begin), size);
+		m_recorder.read(size);
+		return true;
+	}
+	//! Stop reading through the ring, and close the file opened for it.
+	void closeDirect()
+	{
+#if defined(WAVEREAD_POSIX)
+		if (m_directFd >= 0)
+			::close(m_directFd);
+#endif
+		m_directFd = -1;
+		m_ring = nullptr;
+	}
+	//! Having read up to a page, ask the prefetch thread to read ahead if few of the following pages are cached. Call with m_dataMutex held.
+	/*!
+	* Read-ahead covers half of the cache, leaving the other half for pages elsewhere in the file. It is triggered once
+	* the caller has gone m_cacheExtensionThreshold of the way through it, i.e. when fewer than (1 - threshold) of the read-ahead pages remain.
+	*/
+	void readahead(size_t page)
+	{
+		size_t window{ std::max<size_t>(1u, m_pages.size() / 2u) }, ahead{ 0u };
+		while (ahead < window && page + 1u + ahead < m_pageTable.size() && m_pageTable[page + 1u + ahead] >= 0)
+			++ahead;
+		if (ahead < window && page + 1u + ahead < m_pageTable.size() &&
+			(double)ahead <= (1.0 - m_cacheExtensionThreshold) * (double)window)
+			readaheadFrom(page + 1u, window);
+	}
+	//! Ask the I/O thread to read ahead count pages from page, as soon as it can. Ignored while another read-ahead is pending or in progress,
+	//! so that a caller reading on through the cache doesn't queue up a reload for every call.
+	void readaheadFrom(size_t page, size_t count)
+	{
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		if (m_prefetchPending || m_prefetchBusy || m_prefetchStop)
+			return;
+		m_prefetchPending = true;
+		m_prefetchPage = page;
+		m_prefetchCount = count;
+		queue(Job{ std::chrono::steady_clock::now(), 0u, page, count, true, std::function<void()>{} });
+	}
+	//! Queue a task for the I/O thread, to run by a deadline. Dropped once the thread has been stopped, by the destructor or a move.
+	void schedule(std::chrono::steady_clock::time_point deadline, std::function<void()> task)
+	{
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		if (!m_prefetchStop)
+			queue(Job{ deadline, 0u, 0u, 0u, false, std::move(task) });
+	}
+	//! Add a job to the queue of the I/O thread, starting the thread on first use. Call with m_prefetchMutex held.
+	void queue(Job job)
+	{
+		job.sequence = m_jobSequence++;
+		m_jobs.push_back(std::move(job));
+		std::push_heap(m_jobs.begin(), m_jobs.end(), &Job::later);
+		if (!m_prefetcher.joinable())
+			m_prefetcher = std::thread{ &Waveread::prefetchLoop, this };
+		else
+			m_prefetchCondition.notify_one();
+	}
+	//! Drop the read-ahead and prefetch() requests, or stop them between pages if they have started. Tasks of audioAsync() are kept.
+	void cancelPrefetch()
+	{
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		m_prefetchPending = false;
+		++m_prefetchGeneration;
+		m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), [](const Job& job) { return !job.task; }), m_jobs.end());
+		std::make_heap(m_jobs.begin(), m_jobs.end(), &Job::later);
+	}
+	//! Stop the I/O thread, once it has run any audioAsync() tasks still queued. Loads are dropped, and so is anything queued afterwards:
+	//! the reader is being destroyed or moved from, so no thread may start on it again.
+	void stopPrefetcher()
+	{
+		{
+			std::lock_guard<std::mutex> l{ m_prefetchMutex };
+			m_prefetchStop = true;
+			m_prefetchPending = false;
+		}
+		m_prefetchCondition.notify_one();
+		if (m_prefetcher.joinable())
+			m_prefetcher.join();
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		m_jobs.clear();
+	}
+	//! I/O thread: runs jobs in order of deadline, loading pages one at a time. Readers only wait for a page to be swapped in, never for it to be read.
+	/*!
+	* Between pages, a load gives way to any job that has become due before it, and is resumed afterwards.
+	*/
+	void prefetchLoop()
+	{
+		std::unique_lock<std::mutex> l{ m_prefetchMutex };
+		while (true)
+		{
+			m_prefetchCondition.wait(l, [this]() { return m_prefetchStop || !m_jobs.empty(); });
+			if (m_jobs.empty())
+				return; // stopped, with nothing left to run
+			std::pop_heap(m_jobs.begin(), m_jobs.end(), &Job::later);
+			Job job{ std::move(m_jobs.back()) };
+			m_jobs.pop_back();
+			if (job.task)
+			{
+				l.unlock();
+				job.task();
+				l.lock();
+				continue;
+			}
+			if (job.readahead)
+			{
+				m_prefetchPending = false;
+				m_prefetchBusy = !m_prefetchStop;
+			}
+			if (m_prefetchStop)
+				continue;
+			size_t generation{ m_prefetchGeneration }, end{ job.page + job.count };
+			bool yielded{ false };
+			l.unlock();
+			for (; job.page < end; ++job.page)
+			{
+				std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+				{
+					std::lock_guard<std::mutex> pl{ m_prefetchMutex };
+					if (m_prefetchStop || generation != m_prefetchGeneration) // close(), reset() or a new cache layout have cancelled it.
+						break;
+					if (!m_jobs.empty() && Job::later(job, m_jobs.front())) // something more urgent has been queued: let it go first.
+					{
+						yielded = true;
+						break;
+					}
+				}
+				std::unique_lock<std::mutex> lock{ m_dataMutex, std::defer_lock };
+				int slot{ loadLocked(job.page, lock, true) };
+				if (slot < 0)
+					break;
+				if (!job.readahead)
+					m_pages[slot].referenced = true; // asked for by prefetch(): give it a second chance against eviction.
+			}
+			l.lock();
+			if (job.readahead)
+				m_prefetchBusy = false;
+			if (yielded)
+			{
+				if (job.readahead)
+				{
+					if (m_prefetchPending) // superseded by a newer read-ahead
+						continue;
+					m_prefetchPending = true;
+					m_prefetchPage = job.page;
+					m_prefetchCount = end - job.page;
+				}
+				job.count = end - job.page;
+				m_jobs.push_back(std::move(job));
+				std::push_heap(m_jobs.begin(), m_jobs.end(), &Job::later);
+			}
+		}
+	}
+	//! Number of frames audio() gives for a range: truncated to the end of the file, and to at most capacity frames. Opens the file if need be.
+	size_t count(size_t startSample, size_t sampleCount, size_t stride, size_t capacity)
+	{
+		if (!open())
+			return 0u;
+		size_t fileSamples{ this->fileSamples() };
+		if (startSample >= fileSamples)																// read starts out of bounds
+			return 0u;
+		size_t endSample{ startSample + std::min(sampleCount, fileSamples - startSample) };		// read ends out of bounds: truncate it
+		return std::min((endSample - startSample + stride) / (1u + stride), capacity);
+	}
+	//! Audio into a float buffer, as the public audio(), counting cache hits and misses as a way of reading.
+	size_t audio(size_t startSample, size_t sampleCount, float* out, size_t capacity, const int* channels, size_t channelCount, size_t stride, bool interleaved, WAV_CALL call)
+	{
+		if (out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		size_t frames{ count(startSample, sampleCount, stride, capacity / channelCount) };
+		size_t frameStride{ interleaved ? channelCount : 1u }, channelStride{ interleaved ? 1u : frames };
+		size_t written{ decodeRange(startSample, frames, stride, call, [&](const uint8_t* src, size_t first, size_t n) {
+			samples(src, n, stride, channels, channelCount, out + first * frameStride, frameStride, channelStride);
+		}) };
+		return (interleaved || written == frames) ? written : 0u; // a planar result is laid out for all frames, so is useless if cut short.
+	}
+	//! Find the bytes of frames, taking every (1 + stride)th frame from startSample, and decode them with decode(src, first, n), where src holds the n frames from the first.
+	/*!
+	* Reads through the cache unless the file is mapped. Returns the number of frames decoded, fewer than frames only if the stream couldn't be read.
+	* call is the way of reading, for stats(). For ADPCM, src holds 16-bit samples decoded from the blocks, as described by decodedHeader().
+	*/
+	template<typename Decode>
+	size_t decodeRange(size_t startSample, size_t frames, size_t stride, WAV_CALL call, Decode decode)
+	{
+		return m_header.compressed() ? decodeBlocks(startSample, frames, stride, call, decode) : readRange(startSample, frames, stride, call, decode);
+	}
+	//! As decodeRange(), for ADPCM: each block the range touches is found in the block cache, or else its bytes are read with readRange() and decoded into it.
+	template<typename Decode>
+	size_t decodeBlocks(size_t startSample, size_t frames, size_t stride, WAV_CALL call, Decode decode)
+	{
+		if (frames == 0u)
+			return 0u;
+		size_t spb{ (size_t)m_header.m_samplesPerBlock }, nch{ (size_t)m_header.m_22_numChannels }, bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		size_t endSample{ startSample + (frames - 1u) * (1u + stride) + 1u }, written{ 0u };
+		std::vector<int16_t> scratch{};
+		while (written < frames)
+		{
+			size_t sample{ startSample + written * (1u + stride) }, block{ sample / spb }, blockFrames{ 0u };
+			const int16_t* samples{ nullptr };
+			std::unique_lock<std::mutex> lock{ m_blockMutex };
+			int slot{ findBlock(block) };
+			if (slot >= 0)																			// hit: pin the slot, so it stays put while it is converted without the lock
+			{
+				Block& cached{ m_blocks[(size_t)slot] };
+				cached.referenced = true;
+				++cached.pins;
+				samples = &m_blockSamples[(size_t)slot * spb * nch];
+				blockFrames = cached.frames;
+			}
+			else																					// miss: decode the block into scratch, convert from there, and cache a copy
+			{
+				lock.unlock();
+				size_t bytes{ std::min(bpb, (mapped() ? mappedBytes() : (size_t)m_header.m_dataSize) - block * bpb) };
+				scratch.resize(spb * nch);
+				if (readRange(block, 1u, 0u, call, [&](const uint8_t* src, size_t, size_t) { blockFrames = waveread_detail::adpcmBlock(m_header, src, bytes, &scratch[0]); }) == 0u)
+					return written;
+				lock.lock();
+				if (findBlock(block) < 0)															// unless another thread decoded it in the meantime
+				{
+					++m_blocksDecoded;
+					storeBlock(block, blockFrames, scratch);
+				}
+				samples = &scratch[0];
+			}
+			lock.unlock();
+			size_t blockEnd{ std::min(block * spb + blockFrames, endSample) }, n{ 0u };
+			if (sample < blockEnd)
+			{
+				n = std::min(frames - written, (blockEnd - sample + stride) / (1u + stride));
+				decode(reinterpret_cast<const uint8_t*>(samples + (sample - block * spb) * nch), written, n);
+			}
+			if (slot >= 0)
+			{
+				lock.lock();
+				--m_blocks[(size_t)slot].pins;
+				lock.unlock();
+			}
+			if (n == 0u)																			// the block is shorter than the header claims
+				return written;
+			written += n;
+		}
+		return frames;
+	}
+	//! Slot of the block cache holding a block, or -1. Call with m_blockMutex held.
+	int findBlock(size_t block) const { return block < m_blockTable.size() ? m_blockTable[block] : -1; }
+	//! Number of slots of the block cache, for blocks of this many samples: a quarter of the page cache's size, in decoded blocks.
+	size_t blockSlots(size_t samples) const { return std::max<size_t>(4u, std::min<size_t>(1024u, m_cacheSize / 4u / (samples * sizeof(int16_t)))); }
+	//! Number of blocks in the data chunk, the size of the block table.
+	size_t blockCount() const { return ((size_t)m_header.m_dataSize + m_header.m_32_bytesPerBlock - 1u) / m_header.m_32_bytesPerBlock; }
+	//! Put a decoded block into the block cache, evicting one by the CLOCK algorithm, as pages are, and skipping pinned slots. Sizes the cache on first use.
+	/*!
+	* Call with m_blockMutex held. Returns the slot, or -1 if every slot is pinned, in which case the block isn't cached.
+	*/
+	int storeBlock(size_t block, size_t frames, const std::vector<int16_t>& samples)
+	{
+		if (m_blocks.empty())
+		{
+			size_t slots{ blockSlots(samples.size()) };
+			m_blocks.assign(slots, Block{ SIZE_MAX, 0u, false, 0u });
+			m_blockSamples.assign(slots * samples.size(), 0);
+			m_blockTable.assign(blockCount(), -1);
+			m_blockHand = 0u;
+		}
+		for (size_t visited{ 0u }; visited < 2u * m_blocks.size(); ++visited)						// twice round: the first pass may only clear reference bits
+		{
+			size_t slot{ m_blockHand };
+			Block& evicted{ m_blocks[slot] };
+			m_blockHand = (m_blockHand + 1u) % m_blocks.size();
+			if (evicted.pins > 0u)
+				continue;
+			if (evicted.referenced)
+			{
+				evicted.referenced = false;
+				continue;
+			}
+			if (evicted.block < m_blockTable.size())
+				m_blockTable[evicted.block] = -1;
+			evicted = Block{ block, frames, false, 0u };
+			if (block < m_blockTable.size())
+				m_blockTable[block] = (int)slot;
+			std::copy(samples.begin(), samples.end(), m_blockSamples.begin() + slot * samples.size());
+			return (int)slot;
+		}
+		return -1;
+	}
+	//! Read the bytes of a range of frames, through the cache unless the file is mapped, as decodeRange(). For ADPCM, the frames are whole blocks.
+	template<typename Decode>
+	size_t readRange(size_t startSample, size_t frames, size_t stride, WAV_CALL call, Decode decode)
+	{
+		if (frames == 0u)
+			return 0u;
+		uint64_t offset{ (uint64_t)startSample * m_header.m_32_bytesPerBlock }, bytes{ (uint64_t)((frames - 1u) * (1u + stride) + 1u) * m_header.m_32_bytesPerBlock };
+		waveread_detail::Recorder::Time start{ waveread_detail::Recorder::now() };
+		if (mapped())																				// mapped: the whole data chunk is addressable
+		{
+			decode(mappedData() + startSample * m_header.m_32_bytesPerBlock, 0u, frames);
+			m_recorder.span("audio", start, offset, bytes);
+			return frames;
+		}
+
+		// Pages are only looked up and decoded with m_dataMutex held, since the prefetch thread may evict one at any time.
+		std::unique_lock<std::mutex> lock{ m_dataMutex };
+		waveread_detail::Recorder::Time locked{ m_recorder.locked(start, offset, bytes) };
+		if (m_layoutStale)
+		{
+			lock.unlock();
+			cancelPrefetch();
+			std::lock_guard<std::mutex> streamLock{ m_streamMutex };
+			lock.lock();
+			layout();
+		}
+		size_t endSample{ startSample + (frames - 1u) * (1u + stride) + 1u };
+		size_t written{ 0u }, page{ 0u };
+		while (written < frames)
+		{
+			size_t sample{ startSample + written * (1u + stride) };
+			page = sample / m_pageFrames;
+			int slot{ m_pageTable[page] };
+			if (slot >= 0)																			// hit: page is cached
+			{
+				++m_cacheHits;
+				m_recorder.hit(call);
+				if (m_pages[slot].prefetched)
+					m_recorder.lead(m_pages[slot].loaded);
+			}
+			else																					// miss: read the page, evicting another
+			{
+				++m_cacheMisses;
+				m_recorder.miss(call);
+				if (waveread_detail::Recorder::enabled && prefetching(page))
+					m_recorder.late();
+				m_recorder.unlocked(locked);
+				lock.unlock();
+				waveread_detail::Recorder::Time asked{ waveread_detail::Recorder::now() };
+				slot = load(page, lock);
+				locked = m_recorder.loaded(asked, (uint64_t)page * m_pageBytes, m_pageBytes);
+				if (slot < 0)
+				{
+					m_recorder.unlocked(locked);
+					m_recorder.span("audio", start, offset, bytes);
+					return written;
+				}
+			}
+			m_pages[slot].referenced = true;
+			m_pages[slot].prefetched = false;
+			size_t pageEnd{ std::min((page + 1u) * m_pageFrames, endSample) };
+			size_t n{ std::min(frames - written, (pageEnd - sample + stride) / (1u + stride)) };
+			decode(buffer(m_pages[slot].buffer) + (sample - page * m_pageFrames) * m_header.m_32_bytesPerBlock, written, n);
+			written += n;
+		}
+		readahead(page);
+		m_recorder.unlocked(locked);
+		m_recorder.span("audio", start, offset, bytes);
+		return frames;
+	}
+	//! Has the prefetch thread been asked for a page, and not finished reading it? Only used for stats().
+	bool prefetching(size_t page)
+	{
+		std::lock_guard<std::mutex> l{ m_prefetchMutex };
+		return (m_prefetchPending || m_prefetchBusy) && page >= m_prefetchPage && page < m_prefetchPage + m_prefetchCount;
+	}
+	//! Transform cached bytes into floats, as waveread_detail::samples().
+	void samples(
+		const uint8_t* src,
+		size_t frames,
+		size_t stride,
+		const int* channels,
+		size_t channelCount,
+		float* out,
+		size_t frameStride,
+		size_t channelStride) const
+	{
+		waveread_detail::samples(decodedHeader(), src, frames, stride, channels, channelCount, out, frameStride, channelStride);
+	}
+	//! Samples per channel that can be read: those in the data chunk, or as much of it as a mapped file holds.
+	size_t fileSamples() const { return m_header.samples(mapped() ? (uint64_t)mappedBytes() : m_header.m_dataSize); }
+	//! Offset in the data chunk of the frame holding a sample, or for ADPCM of the block holding it.
+	size_t offset(size_t sample) const
+	{
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		return m_header.compressed() ? sample / m_header.m_samplesPerBlock * bpb : sample * bpb;
+	}
+	//! Layout of the bytes passed to the decode function of decodeRange(): the file's header, or for ADPCM that of the 16-bit samples decoded from it.
+	const WAV_HEADER& decodedHeader() const { return m_header.compressed() ? m_blockHeader : m_header; }
+	//! Start of the data chunk in a mapped file.
+	const uint8_t* mappedData() const { return m_mapping.data() + m_header.m_dataOffset; }
+	//! Number of bytes of the data chunk in a mapped file. The file may be shorter than its header claims, so only the bytes actually present are counted.
+	size_t mappedBytes() const
+	{
+		return std::min((size_t)m_header.m_dataSize, m_mapping.size() > m_header.m_dataOffset ? m_mapping.size() - (size_t)m_header.m_dataOffset : 0u);
+	}
+
+	bool m_opened; /*!< Has the file been opened */
+	std::unique_ptr<std::istream> m_stream; /*!< Input stream */
+
+	WAV_HEADER m_header; /*!< Holds structure of header when opened, used in subsequent operations. */
+	std::mutex m_dataMutex; /*!< Mutex to lock the cache while pages are looked up and decoded, or swapped in */
+	size_t m_cachePos; /*!< At what point, from the start of the data chunk (i.e. cachePos == idx - m_header.m_dataOffset), does the most recently loaded page begin. */
+	size_t m_cacheSize; /*!< How big should the cache (all channels) be in bytes */
+	double m_cacheExtensionThreshold; /*!< Within interval [0,1]. When a caller gets audio, how far into the cache should the caller go before the cache is triggered to be extended? */
+	waveread_detail::Mapping m_mapping; /*!< Memory mapping of the whole file, if constructed from a path. When present, it is read in place of the cache. */
+	WAV_ACCESS m_access; /*!< Access pattern hint passed on to the kernel for memory-mapped files */
+
+	size_t m_cachePageSize; /*!< Requested size of a cache page in bytes */
+	std::vector<Page> m_pages; /*!< Cache slots, visited in turn by the clock hand */
+	std::vector<int> m_pageTable; /*!< For each page of the data chunk, its slot in m_pages, or -1 if it isn't cached */
+	std::vector<uint8_t> m_buffers; /*!< Storage for one buffer per slot, and a spare */
+	size_t m_pageFrames; /*!< Number of frames in a page */
+	size_t m_pageBytes; /*!< Number of bytes in a page */
+	size_t m_bufferStride; /*!< Distance between buffers in m_buffers: m_pageBytes rounded up to the alignment */
+	size_t m_spare; /*!< Buffer that isn't in the cache: pages are read into it, then it is swapped with the evicted page's buffer */
+	size_t m_clockHand; /*!< Next slot that the CLOCK algorithm will consider for eviction */
+	size_t m_cacheHits; /*!< Pages found cached by audio() */
+	size_t m_cacheMisses; /*!< Pages read by audio() */
+	bool m_layoutStale; /*!< Has the cache size changed since layout()? */
+
+	std::mutex m_streamMutex; /*!< Mutex to lock the stream and the spare buffer while they are in use. Taken before m_dataMutex. */
+	std::thread m_prefetcher; /*!< I/O thread, which prefetches and runs audioAsync(): started on the first request and stopped by the destructor */
+	std::mutex m_prefetchMutex; /*!< Mutex to lock the read-ahead request and the jobs */
+	std::condition_variable m_prefetchCondition; /*!< Wakes the I/O thread for a new job, or to stop */
+	bool m_prefetchPending; /*!< Is there a request that the prefetch thread hasn't started? */
+	bool m_prefetchBusy; /*!< Is the prefetch thread loading? */
+	size_t m_prefetchPage; /*!< First page of the request */
+	size_t m_prefetchCount; /*!< Number of pages in the request */
+	size_t m_prefetchGeneration; /*!< Incremented to cancel a request in progress */
+	bool m_prefetchStop; /*!< Tells the prefetch thread to finish */
+	std::vector<Job> m_jobs; /*!< Heap of jobs for the I/O thread, earliest deadline first */
+	size_t m_jobSequence; /*!< Number of jobs queued so far */
+	waveread_detail::Recorder m_recorder; /*!< Counters for stats(), and the trace callback */
+
+	std::vector<std::vector<OverviewBlock>> m_overview; /*!< Overview levels, finest first, each holding one entry per channel per run of frames */
+
+	WAV_HEADER m_blockHeader; /*!< ADPCM: the header of the decoded blocks, which hold 16-bit integers */
+	std::mutex m_blockMutex; /*!< Mutex to lock the block cache. Taken after m_dataMutex, and never held while taking it. */
+	std::vector<Block> m_blocks; /*!< Slots of the block cache, sized on first use */
+	std::vector<int> m_blockTable; /*!< For each block of the data chunk, its slot in m_blocks, or -1 if it isn't cached */
+	std::vector<int16_t> m_blockSamples; /*!< Interleaved samples of every slot, m_samplesPerBlock frames each */
+	size_t m_blockHand; /*!< Next slot of the block cache that the CLOCK algorithm will consider for eviction */
+	size_t m_blocksDecoded; /*!< Blocks decoded into the block cache */
+
+	Wavering* m_ring; /*!< Ring that pages are read through, or nullptr to read them from the stream */
+	int m_directFd; /*!< File opened for reads through the ring, with O_DIRECT where it is allowed, or -1 */
+	std::vector<uint8_t> m_direct; /*!< Aligned buffer for reads through the ring. Guarded by m_streamMutex */
+
+	std::mutex m_mixMutex; /*!< Lock on the mix scratch, which mix() only ever tries to take */
+	std::vector<float> m_mixScratch; /*!< Scratch for mix(), sized on first use */
+};
+
+//! Streaming wave reader
+/*!
+  Reads audio from an input stream in a single forward pass, without ever seeking, so that pipes, sockets and decompressing streams can be read.
+  Data passes through a fixed-size ring buffer, so memory use doesn't depend on the length of the file. ADPCM files aren't read: use Waveread.
+*/
+class Wavestream
+{
+public:
+	//! Constructor
+	/*!
+	* \param stream input stream to read a wave file from, positioned at the start of the file.
+	* \param bufferSize size of the ring buffer in bytes. It holds a whole number of frames, and at least one.
+	*/
+	Wavestream(std::unique_ptr<std::istream>&& stream, size_t bufferSize = 65536u)
+		:
+		m_owned{ std::move(stream) },
+		m_stream{ m_owned.get() },
+		m_header{},
+		m_opened{ false },
+		m_bufferSize{ bufferSize },
+		m_ring{},
+		m_head{ 0u },
+		m_count{ 0u },
+		m_remaining{ 0u },
+		m_position{ 0u }
+	{
+		m_header.clear();
+	}
+	//! Constructor, from a stream owned by the caller, such as std::cin. The stream must outlive the reader.
+	explicit Wavestream(std::istream& stream, size_t bufferSize = 65536u)
+		: Wavestream{ std::unique_ptr<std::istream>{}, bufferSize }
+	{
+		m_stream = &stream;
+	}
+	Wavestream(Wavestream&& other) = default;
+	Wavestream& operator=(Wavestream&& other) = default;
+
+	//! Open
+	/*!
+	* Reads the wave header from the stream.
+	*/
+	bool open()
+	{
+		if (!m_opened && m_stream != nullptr && m_header.read(*m_stream, false) && m_header.valid() && !m_header.compressed())
+		{
+			m_opened = true;
+			size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+			m_ring.assign(std::max<size_t>(1u, m_bufferSize / bpb) * bpb, 0u);
+			m_head = 0u;
+			m_count = 0u;
+			m_remaining = m_header.m_dataSize;
+		}
+		return m_opened;
+	}
+	//! Next block
+	/*!
+	* Decode the next frames of the file into memory owned by the caller. Performs no heap allocation once opened.
+	* \param out destination buffer, holding at least capacity floats.
+	* \param capacity number of floats that out can hold. As many whole frames as fit are written, unless the file ends first.
+	* \param channels array of channelCount zero-indexed channels, as in Waveread::audio().
+	* \param channelCount number of entries in channels
+	* \param interleaved true provides {C1S1, C2S1, ..., CMS1, C1S2, ...}, false provides {C1S1, C1S2, ..., C1SN, C2S1, ...} where N is the return value.
+	* \return number of frames written. Fewer than fit in out only at the end of the file.
+	*/
+	size_t next(float* out, size_t capacity, const int* channels, size_t channelCount, bool interleaved = true)
+	{
+		if (!open() || out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock }, frames{ capacity / channelCount }, written{ 0u };
+		if (!interleaved) // a planar block is laid out for all of its frames, so find out how many the data chunk has left
+			frames = (size_t)std::min<uint64_t>(frames, (m_count + m_remaining) / bpb);
+		size_t frameStride{ interleaved ? channelCount : 1u }, channelStride{ interleaved ? 1u : frames };
+		while (written < frames)
+		{
+			if (m_count < bpb && !fill(bpb))
+				break; // the file has ended
+			size_t n{ std::min(frames - written, std::min(m_count, m_ring.size() - m_head) / bpb) }; // frames before the ring wraps
+			waveread_detail::samples(m_header, &m_ring[m_head], n, 0u, channels, channelCount, out + written * frameStride, frameStride, channelStride);
+			m_head = (m_head + n * bpb) % m_ring.size();
+			m_count -= n * bpb;
+			written += n;
+		}
+		if (!interleaved && written < frames) // the stream ended early: close up the gaps between channels
+			for (size_t c{ 1u }; c < channelCount; ++c)
+				std::copy(out + c * frames, out + c * frames + written, out + c * written);
+		m_position += written;
+		return written;
+	}
+	//! Next block
+	/*!
+	* Decode the next frames of the file, as next() above.
+	* \param sampleCount number of samples wanted from each channel
+	* \param channels set of zero-indexed channels.
+	* \param interleaved sample layout, as in Waveread::audio().
+	* \return sampleCount samples from each channel, or fewer at the end of the file.
+	*/
+	std::vector<float> next(size_t sampleCount, const std::set<int>& channels = std::set<int>{ 0,1 }, bool interleaved = true)
+	{
+		std::vector<int> ch{ channels.begin(), channels.end() };
+		if (ch.empty() || !open())
+			return std::vector<float>{};
+		std::vector<float> result(sampleCount * ch.size());
+		result.resize(next(result.data(), result.size(), ch.data(), ch.size(), interleaved) * ch.size());
+		return result;
+	}
+
+	//! Get header
+	const WAV_HEADER& header() const { return m_header; }
+	//! Has the header been read
+	bool opened() const { return m_opened; }
+	//! Get number of frames read so far
+	size_t position() const { return m_position; }
+	//! Has all of the audio been read
+	bool finished() const { return m_opened && m_count < (size_t)m_header.m_32_bytesPerBlock && (m_remaining == 0u || !m_stream->good()); }
+	//! Get size of the ring buffer in bytes, once opened
+	size_t bufferSize() const { return m_ring.size(); }
+
+private:
+	//! Top up the ring buffer from the stream, until it holds at least bytes or is full. Reads stop at the end of the data chunk.
+	/*!
+	* \return false if fewer than bytes are buffered because the stream ended.
+	*/
+	bool fill(size_t bytes)
+	{
+		bytes = std::min(bytes, m_ring.size());
+		while (m_count < bytes && m_remaining > 0u && m_stream->good())
+		{
+			size_t tail{ (m_head + m_count) % m_ring.size() };
+			size_t n{ std::min((size_t)m_remaining, (tail >= m_head ? m_ring.size() : m_head) - tail) }; // free space before the ring wraps, or reaches the head
+			m_stream->read((char*)&m_ring[tail], (std::streamsize)n);
+			size_t got{ (size_t)m_stream->gcount() };
+			m_count += got;
+			m_remaining -= got;
+		}
+		return m_count >= bytes;
+	}
+
+	std::unique_ptr<std::istream> m_owned; /*!< Input stream, if the reader owns it */
+	std::istream* m_stream; /*!< Input stream */
+	WAV_HEADER m_header; /*!< Header, read when opened */
+	bool m_opened; /*!< Has the header been read */
+	size_t m_bufferSize; /*!< Requested size of the ring buffer in bytes */
+	std::vector<uint8_t> m_ring; /*!< Ring buffer of bytes from the data chunk, holding a whole number of frames */
+	size_t m_head; /*!< Offset in the ring of the next byte to decode */
+	size_t m_count; /*!< Number of bytes buffered from the head */
+	uint64_t m_remaining; /*!< Bytes of the data chunk not yet read from the stream */
+	size_t m_position; /*!< Number of frames decoded */
+};
+
+//! Shared wave file
+/*!
+  A wave file opened once, to be read by many threads at the same time through Wavecursor objects, which share its cache.
+
+  The header is read when the file is opened and never changes. Audio is read with positional reads (pread on POSIX systems), so readers
+  never share a file position. The cache is a fixed set of pages, evicted with the CLOCK algorithm. A reader finds a cached page without taking
+  a lock: it pins the page, then checks that the page wasn't evicted in the meantime. A page is only evicted while no reader has it pinned.
+  Misses take a lock to choose a page to evict, but read the file without it, so misses on different pages are read in parallel.
+  ADPCM files aren't read: use Waveread.
+*/
+class Wavefile
+{
+public:
+	//! Constructor
+	/*!
+	* \param path path of a wave file.
+	* \param cacheSize size of the cache shared by every cursor, in bytes. It holds at least two pages.
+	* \param cachePageSize size of each page of the cache, in bytes. Rounded down to a whole number of frames.
+	*/
+	explicit Wavefile(const std::string& path, size_t cacheSize = 1048576u, size_t cachePageSize = 65536u)
+		:
+		m_header{},
+		m_fd{ -1 },
+		m_stream{},
+		m_streamMutex{},
+		m_pageFrames{ 0u },
+		m_pageBytes{ 0u },
+		m_slotCount{ 0u },
+		m_data{},
+		m_slots{},
+		m_pageTable{},
+		m_loading{},
+		m_loadMutex{},
+		m_loadCondition{},
+		m_clockHand{ 0u },
+		m_loads{ 0u }
+	{
+		std::ifstream stream{ path, std::ios::binary };
+		if (!m_header.read(stream) || !m_header.valid() || m_header.compressed())
+		{
+			m_header.clear();
+			return;
+		}
+#if defined(WAVEREAD_POSIX)
+		m_fd = ::open(path.c_str(), O_RDONLY);
+		if (m_fd < 0)
+		{
+			m_header.clear();
+			return;
+		}
+#else
+		m_stream = std::move(stream);
+#endif
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		m_pageFrames = std::max<size_t>(1u, cachePageSize / bpb);
+		m_pageBytes = m_pageFrames * bpb;
+		m_slotCount = std::max<size_t>(2u, cacheSize / m_pageBytes);
+		m_data.assign(m_slotCount * m_pageBytes, 0u);
+		m_slots.reset(new Slot[m_slotCount]);
+		size_t pages{ ((size_t)m_header.m_dataSize + m_pageBytes - 1u) / m_pageBytes };
+		m_pageTable.reset(new std::atomic<int>[pages]);
+		for (size_t p{ 0u }; p < pages; ++p)
+			m_pageTable[p].store(-1, std::memory_order_relaxed);
+		m_loading.assign(pages, false);
+	}
+	~Wavefile()
+	{
+#if defined(WAVEREAD_POSIX)
+		if (m_fd >= 0)
+			::close(m_fd);
+#endif
+	}
+	Wavefile(const Wavefile&) = delete;
+	Wavefile& operator=(const Wavefile&) = delete;
+
+	//! Was the file opened, with a header that waveread can read?
+	bool opened() const { return m_pageBytes != 0u; }
+	//! Get header
+	const WAV_HEADER& header() const { return m_header; }
+	//! Get number of pages in the cache
+	size_t cachePages() const { return m_slotCount; }
+	//! Get size of each page of the cache in bytes: a whole number of frames.
+	size_t cachePageSize() const { return m_pageBytes; }
+	//! Get number of pages read from the file
+	size_t loads() const { return m_loads.load(std::memory_order_relaxed); }
+	//! Audio, decoded across a pool of threads
+	/*!
+	* Decode a range of the file into memory owned by the caller, as Waveread::audio() does with a pool of threads: each thread reads its slabs with positional reads,
+	* and decodes them straight into their place in out. Slabs bypass the cache.
+	* \return number of frames written, or 0 if any part of the range couldn't be read.
+	*/
+	size_t audio(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		Wavethreads& threads,
+		bool interleaved = true
+	)
+	{
+		if (!opened() || out == nullptr || channels == nullptr || channelCount == 0u || startSample >= m_header.samples())
+			return 0u;
+		size_t bpb{ (size_t)m_header.m_32_bytesPerBlock };
+		size_t frames{ std::min(std::min(sampleCount, m_header.samples() - startSample), capacity / channelCount) };
+		if (frames == 0u)
+			return 0u;
+		bool read{ waveread_detail::decodeSlabs(m_header, threads, startSample, frames, out, channels, channelCount, interleaved,
+			[this, bpb](size_t first, size_t n, std::vector<uint8_t>& scratch) -> const uint8_t* {
+				scratch.resize(n * bpb);
+				return this->read(m_header.m_dataOffset + first * bpb, scratch.size(), &scratch[0]) ? &scratch[0] : nullptr;
+			}) };
+		return read ? frames : 0u;
+	}
+
+private:
+	friend class Wavecursor;
+
+	//! Values of Slot::page other than page numbers
+	enum : long long { emptyPage = -1, loadingPage = -2 };
+	//! Page of the cache
+	struct Slot
+	{
+		Slot() : page{ emptyPage }, pins{ 0 }, referenced{ false } {}
+		std::atomic<long long> page; /*!< Page held, emptyPage, or loadingPage while being evicted or read */
+		std::atomic<int> pins; /*!< Number of readers decoding from the page */
+		std::atomic<bool> referenced; /*!< Read since the clock hand last passed */
+	};
+
+	//! Start of the data of a slot
+	uint8_t* slotData(int slot) { return &m_data[(size_t)slot * m_pageBytes]; }
+	//! Bytes of the data chunk in a page
+	size_t pageSize(size_t page) const { return std::min(m_pageBytes, (size_t)m_header.m_dataSize - page * m_pageBytes); }
+	//! Find and pin a cached page, without locking. Returns its slot, or -1 if the page isn't cached.
+	int pin(size_t page)
+	{
+		int slot{ m_pageTable[page].load(std::memory_order_acquire) };
+		if (slot < 0)
+			return -1;
+		Slot& s{ m_slots[slot] };
+		s.pins.fetch_add(1); // sequentially consistent with evict(): either the evictor sees the pin, or this sees the eviction
+		if (s.page.load() != (long long)page)
+		{
+			s.pins.fetch_sub(1);
+			return -1;
+		}
+		s.referenced.store(true, std::memory_order_relaxed);
+		return slot;
+	}
+	//! Release a page pinned by pin() or load()
+	void unpin(int slot) { m_slots[slot].pins.fetch_sub(1, std::memory_order_release); }
+	//! Read a page into the cache, and pin it. Returns its slot, or -1 if the read failed or every page is pinned; the page can then be read with read().
+	int load(size_t page)
+	{
+		int slot{ -1 };
+		{
+			std::unique_lock<std::mutex> lock{ m_loadMutex };
+			while (m_loading[page]) // another reader is reading this page: wait for it
+				m_loadCondition.wait(lock);
+			if ((slot = pin(page)) >= 0)
+				return slot;
+			if ((slot = evict()) < 0)
+				return -1;
+			m_loading[page] = true;
+		}
+		bool read{ this->read(page, slotData(slot)) };
+		m_loads.fetch_add(1u, std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock{ m_loadMutex };
+		if (read)
+		{
+			m_slots[slot].pins.fetch_add(1);
+			m_slots[slot].page.store((long long)page); // publishes the data read into the slot
+			m_pageTable[page].store(slot, std::memory_order_release);
+		}
+		else
+			m_slots[slot].page.store(emptyPage);
+		m_loading[page] = false;
+		m_loadCondition.notify_all();
+		return read ? slot : -1;
+	}
+	//! Choose an unpinned slot with the CLOCK algorithm, and mark it as being read. Call with m_loadMutex held. Returns -1 if every slot stays in use for two turns of the clock.
+	int evict()
+	{
+		for (size_t turn{ 0u }; turn < 2u * m_slotCount; ++turn)
+		{
+			int slot{ (int)m_clockHand };
+			m_clockHand = (m_clockHand + 1u) % m_slotCount;
+			Slot& s{ m_slots[slot] };
+			long long page{ s.page.load() };
+			if (page == loadingPage)
+				continue;
+			if (page == emptyPage) // any reader pinning it will find it doesn't hold their page, and won't read it
+			{
+				s.page.store(loadingPage);
+				return slot;
+			}
+			if (s.referenced.exchange(false, std::memory_order_relaxed))
+				continue; // second chance
+			s.page.store(loadingPage);
+			if (s.pins.load() != 0) // a reader pinned it first: leave it
+			{
+				s.page.store(page);
+				continue;
+			}
+			m_pageTable[(size_t)page].store(-1, std::memory_order_relaxed);
+			return slot;
+		}
+		return -1;
+	}
+	//! Read a page of the data chunk from the file. Safe to call from many threads.
+	bool read(size_t page, uint8_t* to)
+	{
+		return read(m_header.m_dataOffset + (uint64_t)page * m_pageBytes, pageSize(page), to);
+	}
+	//! Read bytes from the file. Safe to call from many threads.
+	bool read(uint64_t offset, size_t size, uint8_t* to)
+	{
+#if defined(WAVEREAD_POSIX)
+		for (size_t done{ 0u }; done < size; )
+		{
+			ssize_t n{ ::pread(m_fd, to + done, size - done, (off_t)(offset + done)) };
+			if (n <= 0)
+				return false;
+			done += (size_t)n;
+		}
+		return true;
+#else
+		std::lock_guard<std::mutex> lock{ m_streamMutex };
+		m_stream.seekg((std::streamoff)offset);
+		m_stream.read(reinterpret_cast<char*>(to), (std::streamsize)size);
+		bool read{ !m_stream.fail() };
+		m_stream.clear();
+		return read;
+#endif
+	}
+
+	WAV_HEADER m_header; /*!< Header, read when opened */
+	int m_fd; /*!< File descriptor, for positional reads */
+	std::ifstream m_stream; /*!< Stream, where positional reads aren't available */
+	std::mutex m_streamMutex; /*!< Lock on m_stream */
+	size_t m_pageFrames; /*!< Frames in a page */
+	size_t m_pageBytes; /*!< Bytes in a page */
+	size_t m_slotCount; /*!< Number of pages in the cache */
+	std::vector<uint8_t> m_data; /*!< Data of every page */
+	std::unique_ptr<Slot[]> m_slots; /*!< State of every page */
+	std::unique_ptr<std::atomic<int>[]> m_pageTable; /*!< For each page of the data chunk, the slot holding it, or -1 */
+	std::vector<bool> m_loading; /*!< For each page of the data chunk, is it being read? Guarded by m_loadMutex */
+	std::mutex m_loadMutex; /*!< Lock on choosing a page to evict, and on m_loading */
+	std::condition_variable m_loadCondition; /*!< Signalled when a read finishes */
+	size_t m_clockHand; /*!< Next slot the clock considers evicting. Guarded by m_loadMutex */
+	std::atomic<size_t> m_loads; /*!< Number of pages read */
+};
+
+//! Cursor on a shared wave file
+/*!
+  Reads audio from a Wavefile, through the cache it shares with every other cursor on the file. Each thread should use its own cursor: cursors are cheap,
+  holding only a position, counters, and a page-sized buffer used when every page of the cache is in use.
+*/
+class Wavecursor
+{
+public:
+	//! Constructor
+	explicit Wavecursor(std::shared_ptr<Wavefile> file)
+		:
+		m_file{ std::move(file) },
+		m_position{ 0u },
+		m_cacheHits{ 0u },
+		m_cacheMisses{ 0u },
+		m_scratch{}
+	{
+	}
+	//! Audio
+	/*!
+	* Get audio from anywhere in the file, as Waveread::audio(). Doesn't move the cursor.
+	*/
+	std::vector<float> audio(
+		size_t startSample,
+		size_t sampleCount,
+		const std::set<int>& channels = std::set<int>{ 0,1 },
+		size_t stride = 0u,
+		bool interleaved = true
+	)
+	{
+		std::vector<int> ch{ channels.begin(), channels.end() };
+		if (ch.empty() || !m_file || !m_file->opened())
+			return std::vector<float>{};
+		size_t fileSamples{ m_file->header().samples() };
+		if (startSample >= fileSamples)
+			return std::vector<float>{};
+		size_t count{ std::min(sampleCount, fileSamples - startSample) };
+		std::vector<float> result(((count + stride) / (1u + stride)) * ch.size());
+		result.resize(audio(startSample, sampleCount, result.data(), result.size(), ch.data(), ch.size(), stride, interleaved) * ch.size());
+		return result;
+	}
+	//! Audio, into a caller-provided buffer
+	/*!
+	* Get audio from anywhere in the file into memory owned by the caller, as Waveread::audio(). Doesn't move the cursor.
+	* Performs no heap allocation once the requested range is cached.
+	* \return number of frames written.
+	*/
+	size_t audio(
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		size_t stride = 0u,
+		bool interleaved = true
+	)
+	{
+		if (!m_file || !m_file->opened() || out == nullptr || channels == nullptr || channelCount == 0u)
+			return 0u;
+		const WAV_HEADER& header{ m_file->header() };
+		size_t fileSamples{ header.samples() };
+		if (startSample >= fileSamples)
+			return 0u;
+		size_t endSample{ startSample + std::min(sampleCount, fileSamples - startSample) };
+		size_t frames{ std::min((endSample - startSample + stride) / (1u + stride), capacity / channelCount) };
+		if (frames == 0u)
+			return 0u;
+		size_t frameStride{ interleaved ? channelCount : 1u }, channelStride{ interleaved ? 1u : frames };
+
+		size_t written{ 0u }, pageFrames{ m_file->m_pageFrames };
+		while (written < frames)
+		{
+			size_t sample{ startSample + written * (1u + stride) }, page{ sample / pageFrames };
+			const uint8_t* data{ nullptr };
+			int slot{ m_file->pin(page) };
+			if (slot >= 0)
+				++m_cacheHits;
+			else
+			{
+				++m_cacheMisses;
+				slot = m_file->load(page);
+				if (slot < 0) // every page is in use, or the read failed: read the page for this cursor alone
+				{
+					m_scratch.resize(m_file->m_pageBytes);
+					if (!m_file->read(page, m_scratch.data()))
+						return interleaved ? written : 0u;
+					data = m_scratch.data();
+				}
+			}
+			if (slot >= 0)
+				data = m_file->slotData(slot);
+			size_t pageEnd{ std::min((page + 1u) * pageFrames, endSample) };
+			size_t n{ std::min(frames - written, (pageEnd - sample + stride) / (1u + stride)) };
+			waveread_detail::samples(header, data + (sample - page * pageFrames) * header.m_32_bytesPerBlock,
+				n, stride, channels, channelCount, out + written * frameStride, frameStride, channelStride);
+			if (slot >= 0)
+				m_file->unpin(slot);
+			written += n;
+		}
+		return frames;
+	}
+	//! Read on
+	/*!
+	* Get the audio at the cursor into memory owned by the caller, and move the cursor past it.
+	* \return number of frames written: fewer than fit in out only at the end of the file.
+	*/
+	size_t read(float* out, size_t capacity, const int* channels, size_t channelCount, bool interleaved = true)
+	{
+		size_t frames{ channelCount == 0u ? 0u : audio(m_position, capacity / channelCount, out, capacity, channels, channelCount, 0u, interleaved) };
+		m_position += frames;
+		return frames;
+	}
+	//! Move the cursor to a sample
+	void seek(size_t sample) { m_position = sample; }
+	//! Get position of the cursor
+	size_t position() const { return m_position; }
+	//! Get the shared file
+	const std::shared_ptr<Wavefile>& file() const { return m_file; }
+	//! Get number of cache pages that this cursor found cached
+	size_t cacheHits() const { return m_cacheHits; }
+	//! Get number of cache pages that this cursor didn't find cached
+	size_t cacheMisses() const { return m_cacheMisses; }
+
+private:
+	std::shared_ptr<Wavefile> m_file; /*!< File, shared with other cursors */
+	size_t m_position; /*!< Position of the cursor, in samples */
+	size_t m_cacheHits; /*!< Number of pages found cached */
+	size_t m_cacheMisses; /*!< Number of pages not found cached */
+	std::vector<uint8_t> m_scratch; /*!< Page read for this cursor alone, when every page of the cache is in use */
+};
+
+//! Sample rate converter
+/*!
+ Reads audio from a Waveread at another sample rate, with a polyphase windowed-sinc filter. The file is decoded a block at a time into a short buffer for each
+ channel, and the filter runs straight over those buffers with the vector dot product, so a range is never held at the file's rate in full. The filter's
+ history and phase are carried from one read() to the next: consecutive reads give exactly the samples of one long read. Reading at the file's own rate
+ gives the file's samples unchanged.
+*/
+class Waveresampler
+{
+public:
+	//! Constructor
+	/*!
+	* \param reader reader of the file to convert. It must outlive the resampler. Others may go on reading from it.
+	* \param rate sample rate to read at
+	* \param channels channels to read, as in Waveread::audio()
+	* \param taps length of the filter in samples of the file, rounded up to a multiple of 8. A longer filter has a sharper cutoff, and costs more. When lowering
+	* the rate, the filter is lengthened in proportion, up to 8 times, so that its cutoff falls below the new Nyquist frequency.
+	*/
+	Waveresampler(Waveread& reader, uint32_t rate, const std::set<int>& channels = std::set<int>{ 0,1 }, size_t taps = 32u)
+		:
+		m_reader{ &reader },
+		m_rate{ rate },
+		m_channels{ channels.begin(), channels.end() },
+		m_requestedTaps{ std::max<size_t>(taps, 8u) },
+		m_up{ 0u },
+		m_down{ 0u },
+		m_phases{ 0u },
+		m_taps{ 0u },
+		m_coefficients{},
+		m_position{ 0u },
+		m_inputFrame{ 0u },
+		m_phase{ 0u },
+		m_buffer{},
+		m_planes{},
+		m_capacity{ 0u },
+		m_bufferStart{ 0 },
+		m_bufferFrames{ 0u },
+		m_dot{ waveread_detail::dotKernel() }
+	{
+	}
+	//! Open
+	/*!
+	* Opens the reader, and designs the filter. Called by read() if need be.
+	*/
+	bool open()
+	{
+		if (m_taps != 0u)
+			return true;
+		if (!m_reader->open() || m_rate == 0u || m_channels.empty() || m_reader->header().m_24_sampleRate <= 0)
+			return false;
+		uint64_t from{ (uint64_t)m_reader->header().m_24_sampleRate }, divisor{ m_rate };
+		for (uint64_t a{ from }; a != 0u;)
+		{
+			uint64_t r{ divisor % a };
+			divisor = a;
+			a = r;
+		}
+		m_up = m_rate / divisor;
+		m_down = from / divisor;
+		m_phases = (size_t)std::min<uint64_t>(m_up, (uint64_t)maxPhases);
+		size_t stretch{ (size_t)std::min<uint64_t>((m_down + m_up - 1u) / m_up, 8u) };
+		m_taps = (m_requestedTaps * stretch + 7u) / 8u * 8u;
+		design();
+		m_capacity = m_taps + blockFrames;
+		m_buffer.assign(m_capacity * m_channels.size(), 0.f);
+		m_planes.resize(m_channels.size());
+		m_bufferStart = 0;
+		m_bufferFrames = 0u;
+		return true;
+	}
+	//! Read on
+	/*!
+	* Get the next frames at the new rate, interleaved, into memory owned by the caller.
+	* \param out destination buffer, holding at least capacity floats
+	* \param capacity number of floats that out can hold: as many whole frames as fit are read.
+	* \return number of frames written: fewer than fit in out only at the end of the file.
+	*/
+	size_t read(float* out, size_t capacity)
+	{
+		if (out == nullptr || !open())
+			return 0u;
+		size_t channelCount{ m_channels.size() };
+		size_t wanted{ (size_t)std::min<uint64_t>(capacity / channelCount, frames() > m_position ? frames() - m_position : 0u) };
+		int64_t back{ (int64_t)m_taps / 2 - 1 };
+		size_t written{ 0u };
+		while (written < wanted)
+		{
+			int64_t first{ (int64_t)m_inputFrame - back };
+			if (first < m_bufferStart || first + (int64_t)m_taps > m_bufferStart + (int64_t)m_bufferFrames)
+				fill(first);
+			for (; written < wanted; ++written)
+			{
+				first = (int64_t)m_inputFrame - back;
+				if (first + (int64_t)m_taps > m_bufferStart + (int64_t)m_bufferFrames)
+					break;
+				const float* coefficients{ &m_coefficients[(size_t)(m_phase * m_phases / m_up) * m_taps] };
+				const float* history{ &m_buffer[(size_t)(first - m_bufferStart)] };
+				for (size_t c{ 0u }; c < channelCount; ++c)
+					out[written * channelCount + c] = m_dot(coefficients, history + c * m_capacity, m_taps);
+				m_phase += m_down;
+				m_inputFrame += m_phase / m_up;
+				m_phase %= m_up;
+			}
+		}
+		m_position += written;
+		return written;
+	}
+	//! Read on
+	/*!
+	* Get the next frames at the new rate, interleaved.
+	*/
+	std::vector<float> read(size_t frameCount)
+	{
+		std::vector<float> result(frameCount * m_channels.size());
+		if (!result.empty())
+			result.resize(read(&result[0], result.size()) * m_channels.size());
+		return result;
+	}
+	//! Move to a frame at the new rate
+	/*!
+	* Reading on from here gives the same samples as reading on to here would have.
+	*/
+	void seek(uint64_t frame)
+	{
+		m_position = frame;
+		if (!open())
+			return;
+		m_inputFrame = frame / m_up * m_down + (frame % m_up) * m_down / m_up;
+		m_phase = (frame % m_up) * m_down % m_up;
+	}
+	//! Get position, in frames at the new rate
+	uint64_t position() const { return m_position; }
+	//! Get number of frames of the file at the new rate
+	uint64_t frames() const { return m_up == 0u ? 0u : ((uint64_t)m_reader->header().samples() * m_up + m_down - 1u) / m_down; }
+	//! Get the rate read at
+	uint32_t rate() const { return m_rate; }
+	//! Get length of the filter, in samples of the file, once opened
+	size_t taps() const { return m_taps; }
+
+private:
+	static const size_t maxPhases{ 4096u }; /*!< Phases of the filter kept: ratios with more are rounded to the nearest phase below */
+	static const size_t blockFrames{ 4096u }; /*!< Frames of the file decoded at a time */
+
+	//! Zeroth order modified Bessel function of the first kind, for the Kaiser window
+	static double bessel0(double x)
+	{
+		double sum{ 1.0 }, term{ 1.0 };
+		for (int k{ 1 }; k < 64 && term > sum * 1e-12; ++k)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+	//! Fill the coefficient table: one row of m_taps for each phase, each row normalised to unit gain at DC.
+	void design()
+	{
+		const double pi{ 3.14159265358979323846 }, beta{ 8.6 };
+		double cutoff{ m_up == m_down ? 1.0 : 0.95 * std::min(1.0, (double)m_up / (double)m_down) }; // as a fraction of the file's Nyquist frequency
+		double half{ (double)(m_taps / 2u) };
+		m_coefficients.assign(m_phases * m_taps, 0.f);
+		for (size_t p{ 0u }; p < m_phases; ++p)
+		{
+			std::vector<double> row(m_taps);
+			double sum{ 0.0 };
+			for (size_t j{ 0u }; j < m_taps; ++j)
+			{
+				double d{ (double)p / (double)m_phases + half - 1.0 - (double)j }; // distance of tap j from the output instant, in samples of the file
+				double x{ d / half };
+				double window{ std::abs(x) <= 1.0 ? bessel0(beta * std::sqrt(1.0 - x * x)) / bessel0(beta) : 0.0 };
+				double sinc{ d == 0.0 ? 1.0 : std::sin(pi * cutoff * d) / (pi * cutoff * d) };
+				row[j] = m_up == m_down ? (d == 0.0 ? 1.0 : 0.0) : cutoff * sinc * window; // at the file's rate, exactly the file's samples
+				sum += row[j];
+			}
+			for (size_t j{ 0u }; j < m_taps; ++j)
+				m_coefficients[p * m_taps + j] = (float)(row[j] / sum);
+		}
+	}
+	//! Decode the file from frame first onward into the buffers, keeping what they already hold of it
+	void fill(int64_t first)
+	{
+		size_t kept{ 0u };
+		if (first >= m_bufferStart && first < m_bufferStart + (int64_t)m_bufferFrames)
+		{
+			size_t from{ (size_t)(first - m_bufferStart) };
+			kept = m_bufferFrames - from;
+			for (size_t c{ 0u }; c < m_channels.size(); ++c)
+				std::memmove(&m_buffer[c * m_capacity], &m_buffer[c * m_capacity + from], kept * sizeof(float));
+		}
+		m_bufferStart = first;
+		m_bufferFrames = m_capacity;
+		size_t at{ kept };
+		if (first + (int64_t)at < 0) // before the start of the file: silence
+		{
+			size_t silent{ (size_t)std::min<int64_t>(-(first + (int64_t)at), (int64_t)(m_capacity - at)) };
+			for (size_t c{ 0u }; c < m_channels.size(); ++c)
+				std::fill_n(&m_buffer[c * m_capacity + at], silent, 0.f);
+			at += silent;
+		}
+		if (at < m_capacity)
+		{
+			for (size_t c{ 0u }; c < m_channels.size(); ++c)
+				m_planes[c] = &m_buffer[c * m_capacity + at];
+			size_t got{ m_reader->audio((size_t)(first + (int64_t)at), m_capacity - at, m_planes.data(), m_capacity - at, m_channels.data(), m_channels.size()) };
+			for (size_t c{ 0u }; c < m_channels.size(); ++c) // past the end of the file: silence
+				std::fill(m_planes[c] + got, &m_buffer[0] + (c + 1u) * m_capacity, 0.f);
+		}
+	}
+
+	Waveread* m_reader; /*!< Reader of the file */
+	uint32_t m_rate; /*!< Rate read at */
+	std::vector<int> m_channels; /*!< Channels read */
+	size_t m_requestedTaps; /*!< Filter length asked for */
+	uint64_t m_up; /*!< Ratio of the rates in lowest terms: m_up frames out for every m_down of the file */
+	uint64_t m_down; /*!< See m_up */
+	size_t m_phases; /*!< Rows in the coefficient table */
+	size_t m_taps; /*!< Length of the filter, a multiple of 8. Zero until opened */
+	std::vector<float> m_coefficients; /*!< m_phases rows of m_taps coefficients, applied to the file's frames oldest first */
+	uint64_t m_position; /*!< Next frame at the new rate */
+	uint64_t m_inputFrame; /*!< Frame of the file at or just before the next output */
+	uint64_t m_phase; /*!< Position of the next output past m_inputFrame, in 1/m_up of a frame */
+	std::vector<float> m_buffer; /*!< The file's frames from m_bufferStart, one run of m_capacity for each channel */
+	std::vector<float*> m_planes; /*!< Pointers into m_buffer, one per channel, to decode into */
+	size_t m_capacity; /*!< Frames that each channel's run of m_buffer holds */
+	int64_t m_bufferStart; /*!< Frame of the file at the start of the buffer: negative before the start of the file */
+	size_t m_bufferFrames; /*!< Frames held in the buffer: m_capacity once filled */
+	waveread_detail::Dot m_dot; /*!< Dot product kernel */
+};
+
+//! Pool of readers for a library of files
+/*!
+ Holds a Waveread for each of many files, of which only the most recently used are kept open. Files are opened when first used, and their headers kept once read.
+ The pool keeps at most maxOpen files open, and at most cacheBudget bytes of cache across them, by closing the least recently used reader when another must
+ open: its cache is freed and its file closed. The next read from a closed file opens it again. Readers in use by a call are never closed under it, so
+ while more calls are in flight than the limit, the limit is exceeded until they return. The pool can be used from many threads at once.
+*/
+class Wavepool
+{
+public:
+	//! Constructor
+	/*!
+	* \param cacheBudget bytes of memory to share among open readers: each is charged its Waveread::footprint(), so its spare page, page table and any ADPCM block cache count too
+	* \param maxOpen number of files to keep open at once
+	* \param cacheSize bytes of cache for each reader, as in Waveread
+	* \param cachePageSize bytes per page of each reader's cache, as in Waveread
+	*/
+	explicit Wavepool(size_t cacheBudget = 64u * 1048576u, size_t maxOpen = 256u, size_t cacheSize = 262144u, size_t cachePageSize = 65536u)
+		:
+		m_cacheBudget{ cacheBudget },
+		m_maxOpen{ maxOpen },
+		m_cacheSize{ cacheSize },
+		m_cachePageSize{ cachePageSize },
+		m_mutex{},
+		m_openDone{},
+		m_entries{},
+		m_recent{},
+		m_open{ 0u },
+		m_bytes{ 0u },
+		m_reopens{ 0u },
+		m_evictions{ 0u }
+	{
+	}
+	Wavepool(const Wavepool&) = delete;
+	Wavepool& operator=(const Wavepool&) = delete;
+
+	//! Add a file
+	/*!
+	* The file isn't opened until it is used.
+	* \return id of the file in the pool
+	*/
+	size_t add(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_entries.emplace_back();
+		m_entries.back().path = path;
+		return m_entries.size() - 1u;
+	}
+	//! Get number of files in the pool
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_entries.size();
+	}
+	//! Header
+	/*!
+	* Opens the file, if its header hasn't been read before.
+	* \return header of the file, or a cleared header if it can't be opened
+	*/
+	WAV_HEADER header(size_t id)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_mutex };
+			if (id < m_entries.size() && m_entries[id].known)
+				return m_entries[id].header;
+		}
+		Lease lease{ *this, id };
+		return lease.reader != nullptr ? lease.reader->header() : WAV_HEADER{};
+	}
+	//! Audio
+	/*!
+	* Get audio from a file, as Waveread::audio(). Opens the file if it isn't open.
+	*/
+	std::vector<float> audio(
+		size_t id,
+		size_t startSample,
+		size_t sampleCount,
+		const std::set<int>& channels = std::set<int>{ 0,1 },
+		size_t stride = 0u,
+		bool interleaved = true
+	)
+	{
+		Lease lease{ *this, id };
+		return lease.reader != nullptr ? lease.reader->audio(startSample, sampleCount, channels, stride, interleaved) : std::vector<float>{};
+	}
+	//! Audio, into a caller-provided buffer
+	/*!
+	* Get audio from a file, as Waveread::audio(). Opens the file if it isn't open.
+	* \return number of frames written, or 0 if the file can't be opened
+	*/
+	size_t audio(
+		size_t id,
+		size_t startSample,
+		size_t sampleCount,
+		float* out,
+		size_t capacity,
+		const int* channels,
+		size_t channelCount,
+		size_t stride = 0u,
+		bool interleaved = true
+	)
+	{
+		Lease lease{ *this, id };
+		return lease.reader != nullptr ? lease.reader->audio(startSample, sampleCount, out, capacity, channels, channelCount, stride, interleaved) : 0u;
+	}
+	//! Get number of files that may be open at once: the lesser of maxOpen and the number of readers that fit in the budget, as estimated before they open, but at least one.
+	//! Readers with a larger footprint, such as those of long or ADPCM files, fit fewer.
+	size_t limit() const { return std::max<size_t>(1u, std::min(m_maxOpen, m_cacheBudget / estimate())); }
+	//! Get bytes of memory held by the open readers, counted as Waveread::footprint(): no more than the budget, unless a single reader needs more.
+	size_t memoryUsed() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_bytes;
+	}
+	//! Get number of files open now
+	size_t openReaders() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_open;
+	}
+	//! Get number of times a file was opened again after being closed
+	size_t reopens() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_reopens;
+	}
+	//! Get number of times a file was closed to make room for another
+	size_t evictions() const
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		return m_evictions;
+	}
+
+private:
+	//! A file of the pool
+	struct Entry
+	{
+		std::string path{}; /*!< Path of the file */
+		WAV_HEADER header{}; /*!< Header, once read */
+		bool known{ false }; /*!< Has the header been read? */
+		bool opening{ false }; /*!< Is a thread opening the file now? */
+		std::unique_ptr<Waveread> reader{}; /*!< Reader, while open */
+		std::list<size_t>::iterator recent{}; /*!< Place in m_recent, while open */
+		size_t users{ 0u }; /*!< Calls using the reader now: it isn't closed while there are any */
+		size_t bytes{ 0u }; /*!< Footprint of the reader, while open or opening */
+	};
+	//! A reader in use by a call, open for as long as the lease is held
+	struct Lease
+	{
+		Lease(Wavepool& owner, size_t file) : pool(owner), id(file), reader(owner.acquire(file)) {}
+		~Lease() { if (reader != nullptr) pool.release(id); }
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+		Wavepool& pool;
+		size_t id;
+		Waveread* reader;
+	};
+
+	//! Open a file if it isn't open, and mark it in use, closing others if need be. Readers closed are moved to closing, to be destroyed once the lock is released.
+	/*!
+	* If there isn't room for another reader until some in use are released, waits for them, so neither limit is exceeded. Calls hold one lease at a time, so the wait ends.
+	*/
+	Waveread* acquire(size_t id)
+	{
+		std::vector<std::unique_ptr<Waveread>> closing{}; // destroyed after the lock is released: a reader joins its prefetch thread when destroyed
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		if (id >= m_entries.size())
+			return nullptr;
+		Entry& entry{ m_entries[id] }; // entries are only ever added to the back of the deque, so the reference stays valid while the lock is released
+		++entry.users;
+		m_openDone.wait(lock, [&entry]() { return !entry.opening; });
+		if (entry.reader)
+		{
+			m_recent.splice(m_recent.end(), m_recent, entry.recent);
+			return entry.reader.get();
+		}
+		entry.opening = true;
+		while (trim(1u, estimate(), closing) && m_open > 0u)
+			m_openDone.wait(lock); // every reader that could make room is in use: wait for one to be released
+		++m_open; // counted while it opens, so that others make room for it
+		entry.bytes = estimate();
+		m_bytes += entry.bytes;
+		std::string path{ entry.path };
+		lock.unlock();
+		closing.clear();
+		std::unique_ptr<Waveread> reader{ new Waveread{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } }, m_cacheSize, 0.5, m_cachePageSize } };
+		bool opened{ reader->open() };
+		size_t bytes{ opened ? reader->footprint() : 0u };
+		lock.lock();
+		entry.opening = false;
+		m_openDone.notify_all();
+		m_bytes -= entry.bytes;
+		entry.bytes = bytes;
+		m_bytes += bytes;
+		if (!opened)
+		{
+			--m_open;
+			--entry.users;
+			closing.push_back(std::move(reader));
+			return nullptr;
+		}
+		if (entry.known)
+			++m_reopens;
+		entry.known = true;
+		entry.header = reader->header();
+		entry.reader = std::move(reader);
+		entry.recent = m_recent.insert(m_recent.end(), id);
+		trim(0u, 0u, closing); // its footprint may be larger than estimated
+		return entry.reader.get();
+	}
+	//! Mark a file no longer in use by a call, and close files if more are open than the limit
+	void release(size_t id)
+	{
+		std::vector<std::unique_ptr<Waveread>> closing{};
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		--m_entries[id].users;
+		trim(0u, 0u, closing);
+		m_openDone.notify_all(); // a reader waiting for room may now close this one
+	}
+	//! Close the least recently used readers not in use, until room more readers of roomBytes can open within both limits. Call with m_mutex locked.
+	//! Returns true if there still isn't room, because the readers left are in use.
+	bool trim(size_t room, size_t roomBytes, std::vector<std::unique_ptr<Waveread>>& closing)
+	{
+		auto full = [&]() { return m_open + room > m_maxOpen || m_bytes + roomBytes > m_cacheBudget; };
+		std::list<size_t>::iterator it{ m_recent.begin() };
+		while (full() && it != m_recent.end())
+		{
+			Entry& entry{ m_entries[*it] };
+			if (entry.users != 0u)
+			{
+				++it;
+				continue;
+			}
+			closing.push_back(std::move(entry.reader));
+			it = m_recent.erase(it);
+			--m_open;
+			m_bytes -= entry.bytes;
+			entry.bytes = 0u;
+			++m_evictions;
+		}
+		return full();
+	}
+	//! Footprint charged to a reader while it opens, before its own is known: its cache, with a spare page and alignment.
+	size_t estimate() const { return std::max<size_t>(1u, m_cacheSize + m_cachePageSize + 4096u); }
+
+	size_t m_cacheBudget; /*!< Bytes of cache to share among open readers */
+	size_t m_maxOpen; /*!< Files to keep open at once */
+	size_t m_cacheSize; /*!< Bytes of cache of each reader */
+	size_t m_cachePageSize; /*!< Bytes per page of each reader's cache */
+	mutable std::mutex m_mutex; /*!< Guards everything below */
+	std::condition_variable m_openDone; /*!< Signalled when a file has been opened, or failed to */
+	std::deque<Entry> m_entries; /*!< Files, by id */
+	std::list<size_t> m_recent; /*!< Ids of open files, least recently used first */
+	size_t m_open; /*!< Files open, or being opened */
+	size_t m_bytes; /*!< Footprints of the readers open, or being opened */
+	size_t m_reopens; /*!< Files opened again after being closed */
+	size_t m_evictions; /*!< Files closed to make room for others */
 };
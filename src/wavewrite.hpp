@@ -0,0 +1,791 @@
+#pragma once
+#include "waveread.hpp"
+
+//! Output path of a Wavewrite
+enum class WAV_OUTPUT
+{
+	buffered, /*!< Samples are encoded into a large buffer, written to the file each time it fills */
+	mapped /*!< Samples are encoded straight into a memory mapping of the file, a window at a time. Where mapping isn't available, buffered is used instead */
+};
+//! Dither added when samples are quantised to fewer bits
+enum class WAV_DITHER
+{
+	none, /*!< Samples are rounded to the nearest step */
+	triangular /*!< Noise with a triangular distribution of one step either side is added before rounding, so that the error is independent of the signal */
+};
+
+/*!
+ Encoding kernels, the counterparts of the conversion kernels in waveread.hpp. Each takes floats in (-1,1), scales them to the range of the format, adds
+ any dither noise, clamps and rounds to the nearest integer, ties to even. The vector kernels do the same operations in the same order as the scalar ones,
+ so produce the same bytes. Samples read from a file by Waveread, and written at the same bit depth, are written back exactly.
+*/
+namespace waveread_detail
+{
+	//! Range of an integer format, as floats
+	template<int Bits> struct PcmRange
+	{
+		static float scale() { return (float)(1u << (Bits - 1)); }
+		static float lowest() { return -scale(); }
+		static float highest() { return scale() - 1.f; }
+	};
+	template<> struct PcmRange<32>
+	{
+		static float scale() { return 2147483648.f; }
+		static float lowest() { return -2147483648.f; }
+		static float highest() { return 2147483520.f; } // the largest float below 2^31, which would overflow
+	};
+	//! Scale, dither, clamp and round one sample, in the order the vector kernels do
+	template<int Bits> inline int32_t quantise(float v, const float* noise, size_t i)
+	{
+		float x{ v * PcmRange<Bits>::scale() };
+		if (noise != nullptr)
+			x += noise[i];
+		x = x > PcmRange<Bits>::lowest() ? x : PcmRange<Bits>::lowest(); // NaN becomes the lowest sample, as with maxps
+		x = x < PcmRange<Bits>::highest() ? x : PcmRange<Bits>::highest();
+		return (int32_t)std::lrintf(x);
+	}
+	//! Store the low Bits of an integer sample, as the file holds it
+	template<int Bits> inline void store(int32_t q, uint8_t* d)
+	{
+		if (Bits == 8)
+			d[0] = (uint8_t)(q + 128); // unsigned, so offset by 2^7
+		else
+			for (int b{ 0 }; b < Bits / 8; ++b)
+				d[b] = (uint8_t)((uint32_t)q >> (8 * b));
+	}
+	template<int Bits> inline void encodePcm(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i)
+			store<Bits>(quantise<Bits>(src[i], noise, i), dst + i * (Bits / 8));
+	}
+	inline void encodeIeee32(const float* src, const float*, uint8_t* dst, size_t count)
+	{
+		std::memcpy(dst, src, count * 4u);
+	}
+	inline void encodeIeee64(const float* src, const float*, uint8_t* dst, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i)
+		{
+			double v{ src[i] };
+			std::memcpy(dst + 8u * i, &v, 8u);
+		}
+	}
+#if defined(WAVEREAD_X86)
+	//! Scale, dither, clamp and round four samples
+	template<int Bits> WAVEREAD_TARGET_SSE2 inline __m128i quantise_sse2(const float* src, const float* noise, size_t i)
+	{
+		__m128 x{ _mm_mul_ps(_mm_loadu_ps(src + i), _mm_set1_ps(PcmRange<Bits>::scale())) };
+		if (noise != nullptr)
+			x = _mm_add_ps(x, _mm_loadu_ps(noise + i));
+		x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(PcmRange<Bits>::lowest())), _mm_set1_ps(PcmRange<Bits>::highest()));
+		return _mm_cvtps_epi32(x);
+	}
+	template<int Bits> WAVEREAD_TARGET_AVX2 inline __m256i quantise_avx2(const float* src, const float* noise, size_t i)
+	{
+		__m256 x{ _mm256_mul_ps(_mm256_loadu_ps(src + i), _mm256_set1_ps(PcmRange<Bits>::scale())) };
+		if (noise != nullptr)
+			x = _mm256_add_ps(x, _mm256_loadu_ps(noise + i));
+		x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(PcmRange<Bits>::lowest())), _mm256_set1_ps(PcmRange<Bits>::highest()));
+		return _mm256_cvtps_epi32(x);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode8_sse2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			__m128i q{ _mm_packs_epi32(quantise_sse2<8>(src, noise, i), quantise_sse2<8>(src, noise, i + 4u)) };
+			q = _mm_add_epi16(q, _mm_set1_epi16(128));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(q, q));
+		}
+		encodePcm<8>(src + i, noise != nullptr ? noise + i : nullptr, dst + i, count - i);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode16_sse2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2u * i), _mm_packs_epi32(quantise_sse2<16>(src, noise, i), quantise_sse2<16>(src, noise, i + 4u)));
+		encodePcm<16>(src + i, noise != nullptr ? noise + i : nullptr, dst + 2u * i, count - i);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode24_sse2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		alignas(16) int32_t q[4];
+		for (; i + 4u <= count; i += 4u)
+		{
+			_mm_store_si128(reinterpret_cast<__m128i*>(q), quantise_sse2<24>(src, noise, i));
+			for (size_t k{ 0u }; k < 4u; ++k)
+				store<24>(q[k], dst + 3u * (i + k));
+		}
+		encodePcm<24>(src + i, noise != nullptr ? noise + i : nullptr, dst + 3u * i, count - i);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode32_sse2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 4u <= count; i += 4u)
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4u * i), quantise_sse2<32>(src, noise, i));
+		encodePcm<32>(src + i, noise != nullptr ? noise + i : nullptr, dst + 4u * i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void encode16_avx2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 16u <= count; i += 16u)
+		{
+			__m256i q{ _mm256_packs_epi32(quantise_avx2<16>(src, noise, i), quantise_avx2<16>(src, noise, i + 8u)) }; // packs within each 128-bit lane
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2u * i), _mm256_permute4x64_epi64(q, 0xD8));
+		}
+		encode16_sse2(src + i, noise != nullptr ? noise + i : nullptr, dst + 2u * i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void encode24_avx2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		const __m128i pack{ _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) }; // the low three bytes of each sample
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+		{
+			__m256i q{ quantise_avx2<24>(src, noise, i) };
+			__m128i halves[2]{ _mm_shuffle_epi8(_mm256_castsi256_si128(q), pack), _mm_shuffle_epi8(_mm256_extracti128_si256(q, 1), pack) };
+			for (size_t h{ 0u }; h < 2u; ++h)
+			{
+				uint8_t* d{ dst + 3u * (i + 4u * h) };
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(d), halves[h]);
+				uint32_t tail{ (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(halves[h], 8)) };
+				std::memcpy(d + 8u, &tail, 4u);
+			}
+		}
+		encodePcm<24>(src + i, noise != nullptr ? noise + i : nullptr, dst + 3u * i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void encode32_avx2(const float* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		for (; i + 8u <= count; i += 8u)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4u * i), quantise_avx2<32>(src, noise, i));
+		encodePcm<32>(src + i, noise != nullptr ? noise + i : nullptr, dst + 4u * i, count - i);
+	}
+#endif
+	typedef void(*Encoder)(const float* src, const float* noise, uint8_t* dst, size_t count);
+	//! Get the encoder for a format and an instruction set, or the best this CPU supports. Returns nullptr if the format can't be written. noise may be nullptr.
+	inline Encoder encoder(int bitsPerSample, Simd simd = Simd::avx2, uint16_t format = WAV_FORMAT_PCM)
+	{
+		if (simd > simdSupported())
+			simd = simdSupported();
+		if (format == WAV_FORMAT_IEEE_FLOAT)
+			switch (bitsPerSample)
+			{
+			case 32: return &encodeIeee32;
+			case 64: return &encodeIeee64;
+			default: return nullptr;
+			}
+		if (format != WAV_FORMAT_PCM)
+			return nullptr;
+		switch (bitsPerSample)
+		{
+#if defined(WAVEREAD_X86)
+		case 8: return simd != Simd::none ? &encode8_sse2 : &encodePcm<8>;
+		case 16: return simd == Simd::avx2 ? &encode16_avx2 : simd == Simd::sse2 ? &encode16_sse2 : &encodePcm<16>;
+		case 24: return simd == Simd::avx2 ? &encode24_avx2 : simd == Simd::sse2 ? &encode24_sse2 : &encodePcm<24>;
+		case 32: return simd == Simd::avx2 ? &encode32_avx2 : simd == Simd::sse2 ? &encode32_sse2 : &encodePcm<32>;
+#else
+		case 8: return &encodePcm<8>;
+		case 16: return &encodePcm<16>;
+		case 24: return &encodePcm<24>;
+		case 32: return &encodePcm<32>;
+#endif
+		default: return nullptr;
+		}
+	}
+	//! Full scale of a sample type written by Wavewrite: integers are scaled by it to (-1,1)
+	template<typename T> inline double fullScale() { return 1.0; }
+	template<> inline double fullScale<int16_t>() { return 32768.0; }
+	template<> inline double fullScale<int32_t>() { return 2147483648.0; }
+	//! Encode integers or doubles to an integer format: scaled to the format in double, which is exact for every input, then dithered, clamped and rounded as floats are.
+	/*!
+	* noise is given only where samples lose bits: integers narrower than the format are shifted up exactly, and never need it.
+	*/
+	template<typename T, int Bits> inline void encodePcmAs(const T* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		const double scale{ std::ldexp(1.0, Bits - 1) }, factor{ scale / fullScale<T>() }; // powers of two, so v * factor is exact
+		for (size_t i{ 0u }; i < count; ++i)
+		{
+			double x{ (double)src[i] * factor };
+			if (noise != nullptr)
+				x += (double)noise[i];
+			x = x > -scale ? x : -scale;
+			x = x < scale - 1.0 ? x : scale - 1.0;
+			store<Bits>((int32_t)std::lrint(x), dst + i * (Bits / 8));
+		}
+	}
+	//! Encode integers or doubles to floating point, of 32 or 64 bits
+	template<typename T, typename Ieee> inline void encodeIeeeAs(const T* src, const float*, uint8_t* dst, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i)
+		{
+			Ieee v{ (Ieee)((double)src[i] / fullScale<T>()) };
+			std::memcpy(dst + i * sizeof(Ieee), &v, sizeof(Ieee));
+		}
+	}
+	//! Shift integers up to a wider format, which holds them exactly, as encodePcmAs() would
+	template<typename T, int Bits> inline void encodeWidenAs(const T* src, const float*, uint8_t* dst, size_t count)
+	{
+		for (size_t i{ 0u }; i < count; ++i)
+			store<Bits>((int32_t)((uint32_t)(int32_t)src[i] << ((int)(8u * sizeof(T)) < Bits ? Bits - 8 * (int)sizeof(T) : 0)), dst + i * (Bits / 8));
+	}
+	//! Copy integers to a format of the same width, which holds them as they are
+	template<typename T> inline void encodeCopyAs(const T* src, const float*, uint8_t* dst, size_t count)
+	{
+		std::memcpy(dst, src, count * sizeof(T));
+	}
+#if defined(WAVEREAD_X86)
+	//! Shift 32-bit integers right by Shift bits, rounding to nearest, ties to even as lrint() does, and clamping the one case that rounds past the top of the format
+	template<int Shift> WAVEREAD_TARGET_SSE2 inline __m128i roundShift_sse2(__m128i v)
+	{
+		const __m128i mask{ _mm_set1_epi32((1 << Shift) - 1) }, half{ _mm_set1_epi32(1 << (Shift - 1)) }, one{ _mm_set1_epi32(1) };
+		const __m128i highest{ _mm_set1_epi32((int32_t)(0x7FFFFFFFu >> Shift)) };
+		__m128i r{ _mm_srai_epi32(v, Shift) }, rem{ _mm_and_si128(v, mask) };
+		__m128i up{ _mm_or_si128(_mm_cmpgt_epi32(rem, half), _mm_and_si128(_mm_cmpeq_epi32(rem, half), _mm_cmpeq_epi32(_mm_and_si128(r, one), one))) };
+		r = _mm_sub_epi32(r, up); // up is -1 where rounding up
+		return _mm_add_epi32(r, _mm_cmpgt_epi32(r, highest));
+	}
+	template<int Shift> WAVEREAD_TARGET_AVX2 inline __m256i roundShift_avx2(__m256i v)
+	{
+		const __m256i mask{ _mm256_set1_epi32((1 << Shift) - 1) }, half{ _mm256_set1_epi32(1 << (Shift - 1)) }, one{ _mm256_set1_epi32(1) };
+		const __m256i highest{ _mm256_set1_epi32((int32_t)(0x7FFFFFFFu >> Shift)) };
+		__m256i r{ _mm256_srai_epi32(v, Shift) }, rem{ _mm256_and_si256(v, mask) };
+		__m256i up{ _mm256_or_si256(_mm256_cmpgt_epi32(rem, half), _mm256_and_si256(_mm256_cmpeq_epi32(rem, half), _mm256_cmpeq_epi32(_mm256_and_si256(r, one), one))) };
+		r = _mm256_sub_epi32(r, up);
+		return _mm256_min_epi32(r, highest);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode32to16_sse2(const int32_t* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		if (noise == nullptr)
+			for (; i + 8u <= count; i += 8u)
+			{
+				__m128i lo{ roundShift_sse2<16>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))) };
+				__m128i hi{ roundShift_sse2<16>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4u))) };
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2u * i), _mm_packs_epi32(lo, hi));
+			}
+		encodePcmAs<int32_t, 16>(src + i, noise != nullptr ? noise + i : nullptr, dst + 2u * i, count - i);
+	}
+	WAVEREAD_TARGET_SSE2 inline void encode32to24_sse2(const int32_t* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		alignas(16) int32_t q[4];
+		if (noise == nullptr)
+			for (; i + 4u <= count; i += 4u)
+			{
+				_mm_store_si128(reinterpret_cast<__m128i*>(q), roundShift_sse2<8>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+				for (size_t k{ 0u }; k < 4u; ++k)
+					store<24>(q[k], dst + 3u * (i + k));
+			}
+		encodePcmAs<int32_t, 24>(src + i, noise != nullptr ? noise + i : nullptr, dst + 3u * i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void encode32to16_avx2(const int32_t* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		size_t i{ 0u };
+		if (noise == nullptr)
+			for (; i + 16u <= count; i += 16u)
+			{
+				__m256i lo{ roundShift_avx2<16>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))) };
+				__m256i hi{ roundShift_avx2<16>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8u))) };
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2u * i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8));
+			}
+		encode32to16_sse2(src + i, noise != nullptr ? noise + i : nullptr, dst + 2u * i, count - i);
+	}
+	WAVEREAD_TARGET_AVX2 inline void encode32to24_avx2(const int32_t* src, const float* noise, uint8_t* dst, size_t count)
+	{
+		const __m128i pack{ _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1) };
+		size_t i{ 0u };
+		if (noise == nullptr)
+			for (; i + 8u <= count; i += 8u)
+			{
+				__m256i q{ roundShift_avx2<8>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))) };
+				__m128i halves[2]{ _mm_shuffle_epi8(_mm256_castsi256_si128(q), pack), _mm_shuffle_epi8(_mm256_extracti128_si256(q, 1), pack) };
+				for (size_t h{ 0u }; h < 2u; ++h)
+				{
+					uint8_t* d{ dst + 3u * (i + 4u * h) };
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(d), halves[h]);
+					uint32_t tail{ (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(halves[h], 8)) };
+					std::memcpy(d + 8u, &tail, 4u);
+				}
+			}
+		encodePcmAs<int32_t, 24>(src + i, noise != nullptr ? noise + i : nullptr, dst + 3u * i, count - i);
+	}
+#endif
+	//! Encoder of integer or double samples, as Encoder is of floats
+	template<typename T> struct TypedEncoder { typedef void(*type)(const T* src, const float* noise, uint8_t* dst, size_t count); };
+	//! Get the vector encoder of a sample type to an integer format, for an instruction set, if there is one: int32_t to 16 and 24 bits.
+	template<typename T> inline typename TypedEncoder<T>::type vectorEncoder(int, Simd) { return nullptr; }
+	template<> inline TypedEncoder<int32_t>::type vectorEncoder<int32_t>(int bitsPerSample, Simd simd)
+	{
+#if defined(WAVEREAD_X86)
+		if (simd != Simd::none && (bitsPerSample == 16 || bitsPerSample == 24))
+			return bitsPerSample == 16 ? (simd == Simd::avx2 ? &encode32to16_avx2 : &encode32to16_sse2) : (simd == Simd::avx2 ? &encode32to24_avx2 : &encode32to24_sse2);
+#else
+		(void)bitsPerSample;
+		(void)simd;
+#endif
+		return nullptr;
+	}
+	//! Get the encoder of integer or double samples for a format and an instruction set, or the best this CPU supports. Returns nullptr if the format can't be written.
+	/*!
+	* Integers of the format's width are copied, narrower integers are shifted up, and int32_t is narrowed to 16 or 24 bits with vector kernels. All give the same bytes as encodePcmAs().
+	*/
+	template<typename T> inline typename TypedEncoder<T>::type typedEncoder(int bitsPerSample, Simd simd = Simd::avx2, uint16_t format = WAV_FORMAT_PCM)
+	{
+		if (simd > simdSupported())
+			simd = simdSupported();
+		if (format == WAV_FORMAT_IEEE_FLOAT)
+			switch (bitsPerSample)
+			{
+			case 32: return &encodeIeeeAs<T, float>;
+			case 64: return &encodeIeeeAs<T, double>;
+			default: return nullptr;
+			}
+		if (format != WAV_FORMAT_PCM)
+			return nullptr;
+		if (!SampleType<T>::ieee && (int)(8u * sizeof(T)) == bitsPerSample)
+			return &encodeCopyAs<T>;
+		if (!SampleType<T>::ieee && (int)(8u * sizeof(T)) < bitsPerSample)
+			return bitsPerSample == 24 ? &encodeWidenAs<T, 24> : &encodeWidenAs<T, 32>; // only int16_t is narrower than a format
+		if (typename TypedEncoder<T>::type k = vectorEncoder<T>(bitsPerSample, simd))
+			return k;
+		switch (bitsPerSample)
+		{
+		case 8: return &encodePcmAs<T, 8>;
+		case 16: return &encodePcmAs<T, 16>;
+		case 24: return &encodePcmAs<T, 24>;
+		case 32: return &encodePcmAs<T, 32>;
+		default: return nullptr;
+		}
+	}
+}
+
+//! Wave writer
+/*!
+ Writes a wave file, the counterpart of Waveread. Audio is given in blocks, as int16_t, int32_t, float or double, interleaved or one buffer per channel,
+ and encoded with vector kernels into a large buffer, or straight into a memory mapping of the file. The sizes in the header are written when the file is
+ closed. Space for a ds64 chunk is kept in a JUNK chunk, so that when the audio passes 4GB, the file is made RF64 in place on closing.
+
+ Audio read with Waveread and written at the same format is written back exactly: floats from 8, 16 and 24-bit files, and from 32-bit float files;
+ int32_t from any integer file; double from 64-bit float files.
+*/
+class Wavewrite
+{
+public:
+	//! Constructor
+	/*!
+	* \param path file to write. It is created, or emptied if it exists, when opened.
+	* \param sampleRate samples per second of each channel
+	* \param channels number of channels
+	* \param bitsPerSample 8, 16, 24 or 32 for integer samples; 32 or 64 for floating point samples
+	* \param format WAV_FORMAT_PCM for integer samples, or WAV_FORMAT_IEEE_FLOAT
+	* \param output whether to write through a buffer, or a memory mapping
+	* \param dither noise to add when samples are rounded to fewer bits
+	* \param bufferSize bytes of the buffer, or of each window of the mapping
+	*/
+	Wavewrite(
+		const std::string& path,
+		uint32_t sampleRate,
+		uint16_t channels,
+		uint16_t bitsPerSample = 24u,
+		uint16_t format = WAV_FORMAT_PCM,
+		WAV_OUTPUT output = WAV_OUTPUT::buffered,
+		WAV_DITHER dither = WAV_DITHER::none,
+		size_t bufferSize = 4u * 1048576u
+	)
+		:
+		m_path{ path },
+		m_sampleRate{ sampleRate },
+		m_channels{ channels },
+		m_bitsPerSample{ bitsPerSample },
+		m_format{ format },
+		m_output{ output },
+		m_dither{ dither },
+		m_bufferSize{ std::max<size_t>(bufferSize, 65536u) },
+		m_blockAlign{ (size_t)channels * (bitsPerSample / 8u) },
+		m_encoder{ waveread_detail::encoder(bitsPerSample, waveread_detail::Simd::avx2, format) },
+		m_state{ State::closed },
+		m_alwaysRF64{ false },
+		m_dataBytes{ 0u },
+		m_file{},
+		m_buffer{},
+		m_used{ 0u },
+		m_fd{ -1 },
+		m_window{ nullptr },
+		m_windowStart{ 0u },
+		m_windowSize{ 0u },
+		m_fileSize{ 0u },
+		m_noise{},
+		m_staging{},
+		m_frame{},
+		m_seeds{}
+	{
+		for (size_t k{ 0u }; k < lanes; ++k)
+			m_seeds[k] = 0x9E3779B9u * (uint32_t)(k + 1u);
+	}
+	Wavewrite(const Wavewrite&) = delete;
+	Wavewrite& operator=(const Wavewrite&) = delete;
+	~Wavewrite() { close(); }
+
+	//! Open
+	/*!
+	* Creates the file, and writes a header for no audio. Called by write() if need be.
+	* \return true if the file is open for writing
+	*/
+	bool open()
+	{
+		if (m_state != State::closed)
+			return m_state == State::open;
+		m_state = State::failed;
+		if (m_encoder == nullptr || m_channels == 0u || m_sampleRate == 0u)
+			return false;
+		m_dataBytes = 0u;
+		m_noise.resize((chunkFrames * m_channels + lanes - 1u) / lanes * lanes);
+		m_staging.resize(chunkFrames * m_channels * sizeof(double) + alignof(double)); // room for a chunk of the widest sample type, aligned
+		m_frame.resize(m_blockAlign);
+		uint8_t header[headerSize];
+		writeHeader(header, 0u);
+#if defined(WAVEREAD_MMAP)
+		if (m_output == WAV_OUTPUT::mapped)
+		{
+			m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (m_fd < 0 || ::pwrite(m_fd, header, headerSize, 0) != (ssize_t)headerSize)
+				return false;
+			size_t page{ (size_t)::sysconf(_SC_PAGESIZE) };
+			m_windowSize = (m_bufferSize + page - 1u) / page * page;
+			m_fileSize = headerSize;
+			m_state = State::open;
+			return true;
+		}
+#endif
+		m_output = WAV_OUTPUT::buffered;
+		m_file.rdbuf()->pubsetbuf(nullptr, 0); // unbuffered: whole buffers are written at once
+		m_file.open(m_path, std::ios::binary | std::ios::trunc);
+		if (!m_file.good())
+			return false;
+		m_buffer.resize(std::max(m_bufferSize / m_blockAlign, (size_t)1u) * m_blockAlign + headerSize);
+		std::memcpy(m_buffer.data(), header, headerSize);
+		m_used = headerSize;
+		m_state = State::open;
+		return true;
+	}
+	//! Write interleaved audio
+	/*!
+	* \param samples frames * channels samples: {C1S1, C2S1, ..., CMS1, C1S2, ...}. Integers are taken as full scale for their width, as Waveread gives them.
+	* \param frames number of frames to write
+	* \return number of frames written: all of them, or 0 if the file couldn't be written.
+	*/
+	template<typename T>
+	typename std::enable_if<waveread_detail::SampleType<T>::supported, size_t>::type write(const T* samples, size_t frames) // enabled only for sample types, so that T* const* selects the planar write() below
+	{
+		if (samples == nullptr || !open())
+			return 0u;
+		for (size_t done{ 0u }; done < frames;)
+		{
+			size_t n{ std::min(frames - done, (size_t)chunkFrames) };
+			if (!encode(samples + done * m_channels, n))
+				return fail();
+			done += n;
+		}
+		return frames;
+	}
+	//! Write audio from one buffer per channel
+	/*!
+	* \param channels array of as many buffers as the file has channels, each holding frames samples
+	* \return number of frames written: all of them, or 0 if the file couldn't be written.
+	*/
+	template<typename T>
+	size_t write(const T* const* channels, size_t frames)
+	{
+		static_assert(waveread_detail::SampleType<T>::supported, "Wavewrite encodes int16_t, int32_t, float or double.");
+		if (channels == nullptr || !open())
+			return 0u;
+		T* interleaved{ staging<T>() };
+		for (size_t done{ 0u }; done < frames;)
+		{
+			size_t n{ std::min(frames - done, (size_t)chunkFrames) };
+			for (size_t c{ 0u }; c < m_channels; ++c)
+			{
+				const T* plane{ channels[c] + done };
+				for (size_t f{ 0u }; f < n; ++f)
+					interleaved[f * m_channels + c] = plane[f];
+			}
+			if (!encode(interleaved, n))
+				return fail();
+			done += n;
+		}
+		return frames;
+	}
+	//! Write interleaved audio. Returns 0 without writing anything if the writer has no channels, which open() refuses.
+	size_t write(const std::vector<float>& interleaved) { return m_channels == 0u ? write(interleaved.data(), 0u) : write(interleaved.data(), interleaved.size() / m_channels); }
+	//! Close
+	/*!
+	* Writes what is left of the audio, and the sizes into the header: as RF64 if the file has grown past 4GB.
+	* \return true if the whole file was written
+	*/
+	bool close()
+	{
+		if (m_state == State::closed)
+			return true;
+		bool ok{ m_state == State::open };
+		uint64_t dataBytes{ m_dataBytes };
+		if (ok && (dataBytes & 1u) != 0u) // chunks are padded to an even size
+		{
+			uint8_t pad{ 0u };
+			ok = append(&pad, 1u);
+		}
+		uint8_t header[headerSize];
+		writeHeader(header, dataBytes);
+		m_dataBytes = dataBytes;
+#if defined(WAVEREAD_MMAP)
+		if (m_fd >= 0)
+		{
+			unmap();
+			ok = ok && ::ftruncate(m_fd, (off_t)(headerSize + dataBytes + (dataBytes & 1u))) == 0;
+			ok = ok && ::pwrite(m_fd, header, headerSize, 0) == (ssize_t)headerSize;
+			ok = ::close(m_fd) == 0 && ok;
+			m_fd = -1;
+		}
+#endif
+		if (m_file.is_open())
+		{
+			ok = ok && flush();
+			m_file.seekp(0);
+			m_file.write(reinterpret_cast<const char*>(header), (std::streamsize)headerSize);
+			ok = ok && m_file.good();
+			m_file.close();
+			m_buffer = std::vector<uint8_t>{};
+		}
+		m_state = State::closed;
+		return ok;
+	}
+	//! Write the file as RF64 even if it is smaller than 4GB. Call before closing.
+	void setRF64(bool always) { m_alwaysRF64 = always; }
+	//! Get number of frames written
+	uint64_t frames() const { return m_blockAlign == 0u ? 0u : m_dataBytes / m_blockAlign; }
+	//! Is the file open, with every write so far successful?
+	bool good() const { return m_state == State::open; }
+	//! Get the output path in use: mapped only once opened, if mapping is available.
+	WAV_OUTPUT output() const { return m_output; }
+
+private:
+	enum class State { closed, open, failed };
+	static const size_t headerSize{ 80u }; /*!< RIFF header, JUNK (or ds64) chunk of 28 bytes, 16-byte fmt chunk, and the data chunk's header */
+	static const size_t chunkFrames{ 4096u }; /*!< Frames converted at a time: the size of the noise and staging buffers */
+	static const size_t lanes{ 8u }; /*!< Independent noise generators, one per vector lane */
+
+	//! Fill a header for a number of bytes of audio
+	void writeHeader(uint8_t* h, uint64_t dataBytes) const
+	{
+		uint64_t riff{ headerSize - 8u + dataBytes + (dataBytes & 1u) };
+		bool rf64{ m_alwaysRF64 || riff > 0xFFFFFFFFu };
+		size_t at{ 0u };
+		auto put = [&h, &at](uint64_t value, size_t bytes) {
+			for (size_t i{ 0u }; i < bytes; ++i)
+				h[at++] = (uint8_t)(value >> (8u * i));
+		};
+		auto id = [&h, &at](const char* four) {
+			std::memcpy(h + at, four, 4u);
+			at += 4u;
+		};
+		id(rf64 ? "RF64" : "RIFF");
+		put(rf64 ? 0xFFFFFFFFu : riff, 4u);
+		id("WAVE");
+		id(rf64 ? "ds64" : "JUNK");
+		put(28u, 4u);
+		put(rf64 ? riff : 0u, 8u);
+		put(rf64 ? dataBytes : 0u, 8u);
+		put(rf64 ? dataBytes / m_blockAlign : 0u, 8u);
+		put(0u, 4u); // no table of other chunk sizes
+		id("fmt ");
+		put(16u, 4u);
+		put(m_format, 2u);
+		put(m_channels, 2u);
+		put(m_sampleRate, 4u);
+		put((uint64_t)m_sampleRate * m_blockAlign, 4u);
+		put(m_blockAlign, 2u);
+		put(m_bitsPerSample, 2u);
+		id("data");
+		put(rf64 ? 0xFFFFFFFFu : dataBytes, 4u);
+	}
+	//! Fill the noise buffer with triangular noise of one step either side, from eight xorshift generators, which the compiler can vectorise
+	void fillNoise(size_t count)
+	{
+		float* noise{ m_noise.data() }; // a whole number of lanes long
+		uint32_t seeds[lanes];
+		std::copy(m_seeds, m_seeds + lanes, seeds);
+		for (size_t i{ 0u }; i < count; i += lanes)
+			for (size_t k{ 0u }; k < lanes; ++k)
+			{
+				uint32_t a{ seeds[k] };
+				a ^= a << 13; a ^= a >> 17; a ^= a << 5;
+				uint32_t b{ a };
+				b ^= b << 13; b ^= b >> 17; b ^= b << 5;
+				seeds[k] = b;
+				noise[i + k] = (float)((int32_t)(a >> 8) - (int32_t)(b >> 8)) * (1.f / 16777216.f); // exact in a float
+			}
+		std::copy(seeds, seeds + lanes, m_seeds);
+	}
+	//! Get the staging buffer, aligned for samples of type T
+	template<typename T>
+	T* staging()
+	{
+		static_assert(sizeof(T) <= sizeof(double) && alignof(T) <= alignof(double), "The staging buffer holds a chunk of samples no wider than double.");
+		uintptr_t base{ reinterpret_cast<uintptr_t>(m_staging.data()) };
+		return reinterpret_cast<T*>(m_staging.data() + (alignof(double) - base % alignof(double)) % alignof(double));
+	}
+	//! Get memory for the next bytes of the file: at least one frame, except at the end of a window of the mapping. Returns nullptr if the file couldn't be written.
+	uint8_t* region(size_t& bytes)
+	{
+#if defined(WAVEREAD_MMAP)
+		if (m_fd >= 0)
+		{
+			uint64_t position{ headerSize + m_dataBytes };
+			if (m_window == nullptr || position >= m_windowStart + m_windowSize)
+				if (!map(position))
+					return nullptr;
+			bytes = (size_t)(m_windowStart + m_windowSize - position);
+			return m_window + (position - m_windowStart);
+		}
+#endif
+		if (m_buffer.size() - m_used < m_blockAlign && !flush())
+			return nullptr;
+		bytes = m_buffer.size() - m_used;
+		return m_buffer.data() + m_used;
+	}
+	//! Count bytes written into the memory from region()
+	void commit(size_t bytes)
+	{
+		m_dataBytes += bytes;
+		if (m_fd < 0)
+			m_used += bytes;
+	}
+	//! Copy bytes to the file, across windows of the mapping if need be
+	bool append(const uint8_t* bytes, size_t size)
+	{
+		while (size > 0u)
+		{
+			size_t room{ 0u };
+			uint8_t* dst{ region(room) };
+			if (dst == nullptr)
+				return false;
+			size_t n{ std::min(room, size) };
+			std::memcpy(dst, bytes, n);
+			commit(n);
+			bytes += n;
+			size -= n;
+		}
+		return true;
+	}
+	//! Encode up to chunkFrames interleaved frames of floats with the vector kernels
+	bool encode(const float* samples, size_t frames)
+	{
+		bool dither{ m_dither == WAV_DITHER::triangular && m_format == WAV_FORMAT_PCM };
+		return encode(m_encoder, samples, frames, dither);
+	}
+	//! Encode up to chunkFrames interleaved frames of integers or doubles with the encoder for their type
+	template<typename T>
+	bool encode(const T* samples, size_t frames)
+	{
+		bool dither{ m_dither == WAV_DITHER::triangular && m_format == WAV_FORMAT_PCM &&
+			(waveread_detail::SampleType<T>::ieee || 8u * sizeof(T) > m_bitsPerSample) }; // only where samples lose bits
+		return encode(waveread_detail::typedEncoder<T>(m_bitsPerSample, waveread_detail::Simd::avx2, m_format), samples, frames, dither);
+	}
+	//! Encode up to chunkFrames interleaved frames with a kernel, straight into each region of the buffer or mapping, with noise if dithered
+	template<typename T, typename Encode>
+	bool encode(Encode kernel, const T* samples, size_t frames, bool dither)
+	{
+		const float* noise{ nullptr };
+		if (dither)
+		{
+			fillNoise(frames * m_channels);
+			noise = m_noise.data();
+		}
+		for (size_t done{ 0u }; done < frames;)
+		{
+			size_t room{ 0u };
+			uint8_t* dst{ region(room) };
+			if (dst == nullptr)
+				return false;
+			size_t n{ std::min(frames - done, room / m_blockAlign) };
+			size_t first{ done * m_channels };
+			if (n == 0u) // the frame straddles the end of a window: encode it aside, and copy it across
+			{
+				kernel(samples + first, noise != nullptr ? noise + first : nullptr, m_frame.data(), m_channels);
+				if (!append(m_frame.data(), m_blockAlign))
+					return false;
+				++done;
+				continue;
+			}
+			kernel(samples + first, noise != nullptr ? noise + first : nullptr, dst, n * m_channels);
+			commit(n * m_blockAlign);
+			done += n;
+		}
+		return true;
+	}
+	//! Write the buffer to the file
+	bool flush()
+	{
+		if (m_used > 0u)
+			m_file.write(reinterpret_cast<const char*>(m_buffer.data()), (std::streamsize)m_used);
+		m_used = 0u;
+		return m_file.good();
+	}
+	//! Stop writing after a failure
+	size_t fail()
+	{
+		m_state = State::failed;
+		return 0u;
+	}
+#if defined(WAVEREAD_MMAP)
+	//! Map the window of the file holding a position, growing the file to hold it
+	bool map(uint64_t position)
+	{
+		unmap();
+		size_t page{ (size_t)::sysconf(_SC_PAGESIZE) };
+		m_windowStart = position - position % page;
+		if (m_windowStart + m_windowSize > m_fileSize)
+		{
+			m_fileSize = m_windowStart + m_windowSize;
+			if (::ftruncate(m_fd, (off_t)m_fileSize) != 0)
+				return false;
+		}
+		void* window{ ::mmap(nullptr, m_windowSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, (off_t)m_windowStart) };
+		if (window == MAP_FAILED)
+			return false;
+		m_window = static_cast<uint8_t*>(window);
+		return true;
+	}
+	void unmap()
+	{
+		if (m_window != nullptr)
+			::munmap(m_window, m_windowSize);
+		m_window = nullptr;
+	}
+#endif
+
+	std::string m_path; /*!< File to write */
+	uint32_t m_sampleRate; /*!< Samples per second of each channel */
+	uint16_t m_channels; /*!< Number of channels */
+	uint16_t m_bitsPerSample; /*!< Bits per sample */
+	uint16_t m_format; /*!< WAV_FORMAT_PCM or WAV_FORMAT_IEEE_FLOAT */
+	WAV_OUTPUT m_output; /*!< Output path */
+	WAV_DITHER m_dither; /*!< Dither added when rounding to fewer bits */
+	size_t m_bufferSize; /*!< Bytes of the buffer, or of a window of the mapping */
+	size_t m_blockAlign; /*!< Bytes per frame */
+	waveread_detail::Encoder m_encoder; /*!< Kernel encoding floats, or nullptr if the format can't be written */
+	State m_state; /*!< Is the file open, and has every write succeeded? */
+	bool m_alwaysRF64; /*!< Write RF64 even below 4GB */
+	uint64_t m_dataBytes; /*!< Bytes of audio written */
+	std::ofstream m_file; /*!< File, when buffered */
+	std::vector<uint8_t> m_buffer; /*!< Bytes waiting to be written to m_file */
+	size_t m_used; /*!< Bytes of m_buffer filled */
+	int m_fd; /*!< File, when mapped */
+	uint8_t* m_window; /*!< Window of the mapping, or nullptr */
+	uint64_t m_windowStart; /*!< Position of the window in the file, a multiple of the page size */
+	size_t m_windowSize; /*!< Bytes of each window */
+	uint64_t m_fileSize; /*!< Size the mapped file has been grown to */
+	std::vector<float> m_noise; /*!< Dither noise for a chunk of samples */
+	std::vector<uint8_t> m_staging; /*!< Planar samples, interleaved: bytes for chunkFrames frames of any sample type, see staging() */
+	std::vector<uint8_t> m_frame; /*!< One frame, encoded aside */
+	uint32_t m_seeds[lanes]; /*!< State of each noise generator */
+};
@@ -0,0 +1,561 @@
+// Decode benchmarks on synthetic WAVE files. Build in Release for meaningful numbers.
+//
+//   waveread_bench [--max-size bytes] [--time seconds] [--dir directory] > results.json
+//
+// Files are generated in the directory given (the working directory by default), and removed after use. Every bit depth and format, G.711 included, is read with
+// 1 to 64 channels, and 24-bit stereo files from 64KB up to --max-size (256MB by default; pass 4294967296 to cover RF64-sized reads).
+// Writing is timed for every format, buffered and mapped, with and without dither. Readers sharing a Wavering read through io_uring, where the kernel allows it.
+// Results are written to stdout as one JSON object, so runs can be compared for regressions.
+#define WAVEREAD_IO_URING
+#include <waveread.hpp>
+#include <wavewrite.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <sstream>
+
+static std::atomic<size_t> allocations{ 0u }; // counts every global operator new, plain, array and aligned, for allocations per call.
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline)) // so that the compiler doesn't pair malloc() in one operator with free() in another, and warn of a mismatch
+#else
+#define NOINLINE
+#endif
+NOINLINE static void* allocate(std::size_t size)
+{
+	++allocations;
+	if (void* p = std::malloc(size ? size : 1u))
+		return p;
+	throw std::bad_alloc{};
+}
+NOINLINE static void deallocate(void* p) noexcept { std::free(p); }
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+#if defined(__cpp_aligned_new)
+NOINLINE static void* allocate(std::size_t size, std::align_val_t alignment)
+{
+	++allocations;
+	std::size_t align{ std::max(sizeof(void*), (std::size_t)alignment) };
+#if defined(_MSC_VER)
+	void* p{ _aligned_malloc(size ? size : 1u, align) };
+#else
+	void* p{ nullptr };
+	if (posix_memalign(&p, align, size ? size : 1u) != 0)
+		p = nullptr;
+#endif
+	if (p != nullptr)
+		return p;
+	throw std::bad_alloc{};
+}
+NOINLINE static void deallocate(void* p, std::align_val_t) noexcept
+{
+#if defined(_MSC_VER)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void operator delete(void* p, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete[](void* p, std::size_t, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+#endif
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const char* simdName(waveread_detail::Simd simd)
+	{
+		switch (simd)
+		{
+		case waveread_detail::Simd::avx2: return "avx2";
+		case waveread_detail::Simd::sse2: return "sse2";
+		default: return "scalar";
+		}
+	}
+
+	double minimumSeconds{ 0.25 };
+
+	//! Repeat f until at least minimumSeconds have passed, returning the mean number of seconds per call.
+	template<typename F>
+	double timed(F f)
+	{
+		f(); // warm up
+		size_t calls{ 0u };
+		Clock::time_point start{ Clock::now() };
+		double elapsed{ 0.0 };
+		do
+		{
+			f();
+			++calls;
+			elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (elapsed < minimumSeconds);
+		return elapsed / (double)calls;
+	}
+
+	//! One JSON object, with fields in the order they are added.
+	class Record
+	{
+	public:
+		Record& operator()(const char* key, const std::string& value) { return field(key, "\"" + value + "\""); }
+		Record& operator()(const char* key, const char* value) { return (*this)(key, std::string{ value }); }
+		Record& operator()(const char* key, double value)
+		{
+			char text[32];
+			std::snprintf(text, sizeof(text), "%.6g", value);
+			return field(key, text);
+		}
+		Record& operator()(const char* key, size_t value) { return field(key, std::to_string(value)); }
+		const std::string& str() const { return m_text; }
+	private:
+		Record& field(const char* key, const std::string& value)
+		{
+			m_text += (m_text.empty() ? "{ \"" : ", \"") + std::string{ key } + "\": " + value;
+			return *this;
+		}
+		std::string m_text;
+	};
+	//! Named arrays of records, written as one JSON object.
+	class Results
+	{
+	public:
+		void add(const std::string& section, const Record& record)
+		{
+			for (auto& s : m_sections)
+				if (s.first == section)
+				{
+					s.second.push_back(record.str() + " }");
+					return;
+				}
+			m_sections.push_back({ section, { record.str() + " }" } });
+		}
+		void write(std::FILE* out) const
+		{
+			std::fprintf(out, "{\n");
+			for (size_t i{ 0u }; i < m_sections.size(); ++i)
+			{
+				std::fprintf(out, "  \"%s\": [\n", m_sections[i].first.c_str());
+				for (size_t j{ 0u }; j < m_sections[i].second.size(); ++j)
+					std::fprintf(out, "    %s%s\n", m_sections[i].second[j].c_str(), j + 1u < m_sections[i].second.size() ? "," : "");
+				std::fprintf(out, "  ]%s\n", i + 1u < m_sections.size() ? "," : "");
+			}
+			std::fprintf(out, "}\n");
+		}
+	private:
+		std::vector<std::pair<std::string, std::vector<std::string>>> m_sections;
+	};
+
+	//! Kind of sample in a synthetic file
+	struct Format
+	{
+		uint16_t tag;
+		uint16_t bits;
+		const char* name;
+	};
+	const Format formats[]{ { WAV_FORMAT_PCM, 8u, "pcm8" }, { WAV_FORMAT_PCM, 16u, "pcm16" }, { WAV_FORMAT_PCM, 24u, "pcm24" }, { WAV_FORMAT_PCM, 32u, "pcm32" },
+		{ WAV_FORMAT_IEEE_FLOAT, 32u, "float32" }, { WAV_FORMAT_IEEE_FLOAT, 64u, "float64" }, { WAV_FORMAT_ALAW, 8u, "alaw" }, { WAV_FORMAT_MULAW, 8u, "mulaw" } };
+
+	std::string le(uint64_t value, size_t bytes)
+	{
+		std::string result{};
+		for (size_t i{ 0u }; i < bytes; ++i)
+			result.push_back((char)(value >> (8u * i)));
+		return result;
+	}
+
+	//! Write a WAV file of noise, with at least dataBytes of audio, returning the number of frames. Files over 4GB are RF64.
+	size_t writeWav(const std::string& path, const Format& format, uint16_t channels, uint64_t dataBytes, std::mt19937& rng)
+	{
+		uint16_t blockAlign{ (uint16_t)(channels * (format.bits / 8u)) };
+		uint64_t frames{ std::max<uint64_t>(1u, dataBytes / blockAlign) }, size{ frames * blockAlign };
+		bool rf64{ size + 36u > 0xFFFFFFFFu };
+		std::string fmt{ le(format.tag, 2u) + le(channels, 2u) + le(48000u, 4u) + le(48000u * blockAlign, 4u) + le(blockAlign, 2u) + le(format.bits, 2u) };
+		std::string head{ rf64 ?
+			"RF64" + le(0xFFFFFFFFu, 4u) + "WAVE" + "ds64" + le(28u, 4u) + le(72u + size, 8u) + le(size, 8u) + le(frames, 8u) + le(0u, 4u) :
+			"RIFF" + le(36u + size, 4u) + "WAVE" };
+		head += "fmt " + le(16u, 4u) + fmt + "data" + le(rf64 ? 0xFFFFFFFFu : size, 4u);
+
+		std::FILE* file{ std::fopen(path.c_str(), "wb") };
+		if (file == nullptr)
+			return 0u;
+		std::fwrite(head.data(), 1u, head.size(), file);
+		std::vector<uint8_t> block(1u << 20);
+		std::uniform_real_distribution<double> uniform{ -1.0, 1.0 };
+		for (uint64_t written{ 0u }; written < size; written += block.size())
+		{
+			size_t n{ (size_t)std::min<uint64_t>(block.size(), size - written) };
+			if (format.tag != WAV_FORMAT_IEEE_FLOAT)
+				for (size_t i{ 0u }; i + 4u <= block.size(); i += 4u)
+				{
+					uint32_t r{ (uint32_t)rng() };
+					std::memcpy(&block[i], &r, 4u);
+				}
+			else if (format.bits == 32u) // random bytes would include NaNs and denormals, which are slower to convert
+				for (size_t i{ 0u }; i + 4u <= block.size(); i += 4u)
+				{
+					float v{ (float)uniform(rng) };
+					std::memcpy(&block[i], &v, 4u);
+				}
+			else
+				for (size_t i{ 0u }; i + 8u <= block.size(); i += 8u)
+				{
+					double v{ uniform(rng) };
+					std::memcpy(&block[i], &v, 8u);
+				}
+			std::fwrite(block.data(), 1u, n, file);
+		}
+		std::fclose(file);
+		return (size_t)frames;
+	}
+
+	std::string sizeName(uint64_t bytes)
+	{
+		return bytes >= (1u << 30) ? std::to_string(bytes >> 30) + "GB" : bytes >= (1u << 20) ? std::to_string(bytes >> 20) + "MB" : std::to_string(bytes >> 10) + "KB";
+	}
+
+	//! All channels of a file, in file order
+	std::vector<int> allChannels(const WAV_HEADER& header)
+	{
+		std::vector<int> channels((size_t)header.m_22_numChannels);
+		std::iota(channels.begin(), channels.end(), 0);
+		return channels;
+	}
+
+	//! Read a whole file from start to end in blocks, as a player or an analysis pass would.
+	template<typename Reader>
+	size_t pass(Reader& reader, size_t frames, const std::vector<int>& channels, std::vector<float>& buffer)
+	{
+		size_t block{ buffer.size() / channels.size() }, total{ 0u };
+		for (size_t start{ 0u }; start < frames; start += block)
+			total += reader.audio(start, block, buffer.data(), buffer.size(), channels.data(), channels.size());
+		return total;
+	}
+
+	//! Sequential throughput of each source, reading every channel of a file.
+	void sequential(Results& results, const std::string& path, const Format& format, uint16_t channels, size_t frames)
+	{
+		uint64_t bytes{ (uint64_t)frames * channels * (format.bits / 8u) };
+		static Wavering ring{};
+		for (const char* source : { "stream", "mapped", "wavefile", "ring" })
+		{
+			std::unique_ptr<Waveread> wr{ std::strcmp(source, "stream") == 0 ?
+				new Waveread{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } } } :
+				std::strcmp(source, "ring") == 0 ? new Waveread{ path, ring } :
+				new Waveread{ path, WAV_ACCESS::sequential } };
+			std::unique_ptr<Wavecursor> cursor{ std::strcmp(source, "wavefile") == 0 ? new Wavecursor{ std::make_shared<Wavefile>(path) } : nullptr };
+			if (!wr->open() || (cursor != nullptr && !cursor->file()->opened()))
+				continue;
+			std::vector<int> ch{ allChannels(wr->header()) };
+			std::vector<float> buffer(std::max<size_t>(1u, 65536u / ch.size()) * ch.size());
+			size_t read{ 0u };
+			double seconds{ timed([&]() { read = cursor != nullptr ? pass(*cursor, frames, ch, buffer) : pass(*wr, frames, ch, buffer); }) };
+			if (read != frames)
+				std::fprintf(stderr, "%s: read %zu of %zu frames from %s\n", source, read, frames, path.c_str());
+			results.add("sequential", Record{}("format", format.name)("channels", (size_t)channels)("size", sizeName(bytes))("bytes", (size_t)bytes)("source", source)
+				("gb_per_second", (double)bytes / seconds / 1e9)("samples_per_second", (double)frames * channels / seconds));
+		}
+	}
+
+	//! Throughput of a mixdown of every channel to stereo with gains: mix() in one pass, against audio() of every channel then a second pass to mix it.
+	void mixdown(Results& results, const std::string& path, const Format& format, uint16_t channels, size_t frames)
+	{
+		uint64_t bytes{ (uint64_t)frames * channels * (format.bits / 8u) };
+		Waveread wr{ path, WAV_ACCESS::sequential };
+		if (!wr.open())
+			return;
+		std::vector<int> ch{ allChannels(wr.header()) };
+		std::vector<float> matrix(2u * ch.size()), gains{ 0.5f, 0.5f };
+		for (size_t c{ 0u }; c < ch.size(); ++c)
+			matrix[(c % 2u) * ch.size() + c] = 1.f; // odd channels to the right, even to the left
+		const size_t block{ 4096u };
+		std::vector<float> decoded(block * ch.size()), mixed(block * 2u);
+		for (const char* method : { "audio_then_mix", "mix" })
+		{
+			bool fused{ std::strcmp(method, "mix") == 0 };
+			size_t read{ 0u };
+			double seconds{ timed([&]() {
+				read = 0u;
+				for (size_t start{ 0u }; start < frames; start += block)
+					if (fused)
+						read += wr.mix(start, block, mixed.data(), mixed.size(), matrix.data(), 2u, gains.data());
+					else
+					{
+						size_t n{ wr.audio(start, block, decoded.data(), decoded.size(), ch.data(), ch.size()) };
+						for (size_t f{ 0u }; f < n; ++f)
+							for (size_t o{ 0u }; o < 2u; ++o)
+							{
+								float sum{ 0.f };
+								for (size_t c{ 0u }; c < ch.size(); ++c)
+									sum += matrix[o * ch.size() + c] * decoded[f * ch.size() + c];
+								mixed[f * 2u + o] = sum * gains[o];
+							}
+						read += n;
+					}
+			}) };
+			if (read != frames)
+				std::fprintf(stderr, "%s: read %zu of %zu frames from %s\n", method, read, frames, path.c_str());
+			results.add("mixdown", Record{}("format", format.name)("channels", (size_t)channels)("outputs", (size_t)2u)("method", method)
+				("gb_per_second", (double)bytes / seconds / 1e9)("samples_per_second", (double)frames * channels / seconds));
+		}
+	}
+
+	//! Latency of short reads from random places in a file, through the default cache.
+	void randomAccess(Results& results, const std::string& path, const Format& format, uint16_t channels, size_t frames, std::mt19937& rng)
+	{
+		const size_t reads{ 2000u }, length{ 256u };
+		uint64_t bytes{ (uint64_t)frames * channels * (format.bits / 8u) };
+		// "uniform": anywhere in the file; "local": within a window smaller than the cache, as when scrubbing around one place.
+		for (const char* pattern : { "uniform", "local" })
+			for (const char* source : { "stream", "wavefile" })
+			{
+				Waveread wr{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } } };
+				std::shared_ptr<Wavefile> file{ std::make_shared<Wavefile>(path) };
+				Wavecursor cursor{ file };
+				bool stream{ std::strcmp(source, "stream") == 0 };
+				if (!wr.open() || !file->opened())
+					return;
+				std::vector<int> ch{ allChannels(wr.header()) };
+				std::vector<float> buffer(length * ch.size());
+				size_t window{ std::strcmp(pattern, "local") == 0 ? std::min(frames, (size_t)(512u * 1024u) / wr.header().m_32_bytesPerBlock) : frames };
+				std::uniform_int_distribution<size_t> place{ 0u, window - 1u };
+				std::vector<double> latencies(reads);
+				for (size_t i{ 0u }; i < reads; ++i)
+				{
+					size_t start{ place(rng) };
+					Clock::time_point before{ Clock::now() };
+					if (stream)
+						wr.audio(start, length, buffer.data(), buffer.size(), ch.data(), ch.size());
+					else
+						cursor.audio(start, length, buffer.data(), buffer.size(), ch.data(), ch.size());
+					latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - before).count();
+				}
+				std::sort(latencies.begin(), latencies.end());
+				auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1u, (size_t)(p * (double)latencies.size()))]; };
+				size_t hits{ stream ? wr.cacheHits() : cursor.cacheHits() }, misses{ stream ? wr.cacheMisses() : cursor.cacheMisses() };
+				results.add("random_access", Record{}("format", format.name)("channels", (size_t)channels)("size", sizeName(bytes))("source", source)("pattern", pattern)
+					("frames_per_read", length)("p50_us", percentile(0.5))("p90_us", percentile(0.9))("p99_us", percentile(0.99))("max_us", latencies.back())
+					("cache_hit_rate", hits + misses > 0u ? (double)hits / (double)(hits + misses) : 0.0));
+			}
+	}
+
+	//! Heap allocations per call of each way of reading, once the audio is cached.
+	void allocationsPerCall(Results& results, const std::string& path)
+	{
+		const size_t calls{ 1000u };
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } } };
+		Waveread mapped{ path };
+		std::shared_ptr<Wavefile> file{ std::make_shared<Wavefile>(path) };
+		Wavecursor cursor{ file };
+		const int channels[2]{ 0,1 };
+		std::vector<float> buffer(512u);
+		std::vector<int16_t> integers(512u);
+		auto count = [&](const char* call, std::function<void(size_t)> f) {
+			f(0u); // opens the file and fills the cache
+			size_t before{ allocations.load() };
+			for (size_t i{ 0u }; i < calls; ++i)
+				f(i % 64u);
+			results.add("allocations", Record{}("call", call)("per_call", (double)(allocations.load() - before) / (double)calls));
+		};
+		count("Waveread::audio() to vector", [&](size_t i) { wr.audio(i, 256u, { 0,1 }); });
+		count("Waveread::audio() to buffer", [&](size_t i) { wr.audio(i, 256u, buffer.data(), buffer.size(), channels, 2u); });
+		count("Waveread::audio() to int16_t buffer", [&](size_t i) { wr.audio(i, 256u, integers.data(), integers.size(), channels, 2u); });
+		count("Waveread::audio() to buffer, mapped", [&](size_t i) { mapped.audio(i, 256u, buffer.data(), buffer.size(), channels, 2u); });
+		count("Wavecursor::audio() to buffer", [&](size_t i) { cursor.audio(i, 256u, buffer.data(), buffer.size(), channels, 2u); });
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace waveread_detail;
+	uint64_t maxSize{ 256u << 20 };
+	std::string directory{ "." };
+	for (int i{ 1 }; i + 1 < argc; i += 2)
+		if (std::strcmp(argv[i], "--max-size") == 0)
+			maxSize = std::strtoull(argv[i + 1], nullptr, 10);
+		else if (std::strcmp(argv[i], "--time") == 0)
+			minimumSeconds = std::atof(argv[i + 1]);
+		else if (std::strcmp(argv[i], "--dir") == 0)
+			directory = argv[i + 1];
+	std::mt19937 rng{ 1u };
+	Results results{};
+	results.add("system", Record{}("simd", simdName(simdSupported()))("threads", (size_t)std::thread::hardware_concurrency()));
+
+	// Conversion kernels, on a buffer small enough to stay in cache: measures conversion, not memory bandwidth.
+	const size_t samples{ 64u * 1024u };
+	std::vector<uint8_t> pcm(samples * 8u);
+	for (auto& b : pcm)
+		b = (uint8_t)rng();
+	std::vector<float> out(samples);
+	for (const Format& format : formats)
+	{
+		if (format.tag == WAV_FORMAT_IEEE_FLOAT)
+		{
+			std::vector<double> doubles(samples, 0.5);
+			if (format.bits == 32u)
+				std::fill(reinterpret_cast<float*>(pcm.data()), reinterpret_cast<float*>(pcm.data()) + samples, 0.5f);
+			else
+				std::memcpy(pcm.data(), doubles.data(), samples * 8u);
+		}
+		for (Simd simd : { Simd::none, Simd::sse2, Simd::avx2 })
+		{
+			if (simd > simdSupported())
+				continue;
+			Kernel k{ kernel(format.bits, simd, format.tag) };
+			double seconds{ timed([&]() { k(pcm.data(), out.data(), samples); }) };
+			results.add("kernels", Record{}("format", format.name)("simd", simdName(simd))
+				("gb_per_second", (double)(samples * (size_t)(format.bits / 8u)) / seconds / 1e9)("samples_per_second", (double)samples / seconds));
+		}
+	}
+
+	// Every format, with 1 to 64 channels.
+	const uint64_t gridSize{ std::min<uint64_t>(maxSize, 16u << 20) };
+	for (const Format& format : formats)
+		for (uint16_t channels : { 1u, 2u, 6u, 8u, 16u, 64u })
+		{
+			std::string path{ directory + "/waveread_bench.wav" };
+			size_t frames{ writeWav(path, format, channels, gridSize, rng) };
+			if (frames == 0u)
+				return 1;
+			sequential(results, path, format, channels, frames);
+			if (channels >= 6u)
+				mixdown(results, path, format, channels, frames);
+			if (channels == 2u)
+				randomAccess(results, path, format, channels, frames, rng);
+			std::remove(path.c_str());
+		}
+
+	// 24-bit stereo, from kilobytes to gigabytes.
+	const Format& pcm24{ formats[2] };
+	for (uint64_t size{ 64u << 10 }; size <= maxSize; size *= 16u)
+	{
+		std::string path{ directory + "/waveread_bench.wav" };
+		size_t frames{ writeWav(path, pcm24, 2u, size, rng) };
+		if (frames == 0u)
+			return 1;
+		sequential(results, path, pcm24, 2u, frames);
+		randomAccess(results, path, pcm24, 2u, frames, rng);
+		if (size == (1u << 20))
+			allocationsPerCall(results, path);
+		std::remove(path.c_str());
+	}
+
+	// Many files streamed at once, one reader and thread each, reading their streams or sharing a ring. Ring reads bypass the page cache, so the stream
+	// readers have the advantage of files written moments before.
+	{
+		const size_t files{ 16u };
+		std::vector<std::string> paths{};
+		std::vector<size_t> frames{};
+		for (size_t f{ 0u }; f < files; ++f)
+		{
+			paths.push_back(directory + "/waveread_bench_" + std::to_string(f) + ".wav");
+			frames.push_back(writeWav(paths.back(), pcm24, 2u, gridSize / 4u, rng));
+			if (frames.back() == 0u)
+				return 1;
+		}
+		Wavering ring{};
+		for (size_t readers : { 1u, 4u, 16u })
+			for (const char* source : { "stream", "ring" })
+			{
+				double seconds{ timed([&]() {
+					std::vector<std::thread> threads{};
+					for (size_t r{ 0u }; r < readers; ++r)
+						threads.emplace_back([&, r]() {
+							std::unique_ptr<Waveread> wr{ std::strcmp(source, "ring") == 0 ? new Waveread{ paths[r], ring } :
+								new Waveread{ std::unique_ptr<std::istream>{ new std::ifstream{ paths[r], std::ios::binary } } } };
+							std::vector<int> ch{ 0, 1 };
+							std::vector<float> buffer(65536u);
+							pass(*wr, frames[r], ch, buffer);
+						});
+					for (std::thread& thread : threads)
+						thread.join();
+				}) };
+				double bytes{ (double)readers * (double)frames[0] * 6.0 };
+				results.add("concurrent_readers", Record{}("format", "pcm24")("readers", readers)("source", source)("asynchronous", ring.asynchronous() ? "yes" : "no")
+					("gb_per_second", bytes / seconds / 1e9));
+			}
+		for (const std::string& path : paths)
+			std::remove(path.c_str());
+	}
+
+	// Writing, through a buffer and through a mapping, from interleaved floats.
+	{
+		const size_t frames{ (size_t)(gridSize / 6u) };
+		std::vector<float> audio(frames * 2u);
+		std::uniform_real_distribution<float> uniform{ -1.f, 1.f };
+		for (float& s : audio)
+			s = uniform(rng);
+		std::string path{ directory + "/waveread_bench.wav" };
+		for (const Format& format : formats)
+			for (WAV_OUTPUT output : { WAV_OUTPUT::buffered, WAV_OUTPUT::mapped })
+				for (WAV_DITHER dither : { WAV_DITHER::none, WAV_DITHER::triangular })
+				{
+					if (format.tag == WAV_FORMAT_ALAW || format.tag == WAV_FORMAT_MULAW || (dither == WAV_DITHER::triangular && format.tag != WAV_FORMAT_PCM))
+						continue; // G.711 isn't written
+					double seconds{ timed([&]() {
+						Wavewrite ww{ path, 48000u, 2u, format.bits, format.tag, output, dither };
+						ww.write(audio.data(), frames);
+					}) };
+					results.add("write", Record{}("format", format.name)("output", output == WAV_OUTPUT::mapped ? "mapped" : "buffered")
+						("dither", dither == WAV_DITHER::triangular ? "triangular" : "none")("gb_per_second", (double)frames * 2.0 * (double)(format.bits / 8u) / seconds / 1e9)
+						("samples_per_second", (double)frames * 2.0 / seconds));
+				}
+		// from integers, as read from a file as int16_t or int32_t
+		std::vector<int32_t> wide(audio.size());
+		std::vector<int16_t> narrow(audio.size());
+		for (size_t i{ 0u }; i < audio.size(); ++i)
+		{
+			wide[i] = (int32_t)rng();
+			narrow[i] = (int16_t)(wide[i] >> 16);
+		}
+		for (const Format& format : formats)
+			for (const char* input : { "int16", "int32" })
+			{
+				if (format.tag != WAV_FORMAT_PCM || format.bits == 8u)
+					continue;
+				bool shorts{ std::strcmp(input, "int16") == 0 };
+				double seconds{ timed([&]() {
+					Wavewrite ww{ path, 48000u, 2u, format.bits, format.tag };
+					if (shorts)
+						ww.write(narrow.data(), frames);
+					else
+						ww.write(wide.data(), frames);
+				}) };
+				results.add("write", Record{}("format", format.name)("output", "buffered")("dither", "none")("input", input)
+					("gb_per_second", (double)frames * 2.0 * (double)(format.bits / 8u) / seconds / 1e9)("samples_per_second", (double)frames * 2.0 / seconds));
+			}
+		std::remove(path.c_str());
+	}
+
+	// Decoding across a thread pool.
+	{
+		const uint32_t frames{ 16u * 1024u * 1024u };
+		std::string file{ "RIFF" + le(36u + frames * 6u, 4u) + "WAVE" + "fmt " + le(16u, 4u) + le(WAV_FORMAT_PCM, 2u) + le(2u, 2u) + le(48000u, 4u) + le(48000u * 6u, 4u) +
+			le(6u, 2u) + le(24u, 2u) + "data" + le(frames * 6u, 4u) };
+		for (uint32_t i{ 0u }; i < frames * 6u; ++i)
+			file.push_back((char)rng());
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::istringstream{ file } } };
+		const int channels[2]{ 0,1 };
+		std::vector<float> audio((size_t)frames * 2u);
+		for (size_t n : { 1u, 2u, 4u, 8u })
+		{
+			if (n > 1u && n > std::thread::hardware_concurrency())
+				break;
+			Wavethreads threads{ n };
+			double seconds{ timed([&]() { wr.audio(0u, (size_t)frames, audio.data(), audio.size(), channels, 2u, threads); }) };
+			results.add("thread_pool", Record{}("format", "pcm24")("channels", (size_t)2u)("threads", n)
+				("gb_per_second", (double)frames * 6.0 / seconds / 1e9)("samples_per_second", (double)frames * 2.0 / seconds));
+		}
+	}
+
+	results.write(stdout);
+	return 0;
+}
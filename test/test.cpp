@@ -1,32 +1,168 @@
 #define CATCH_CONFIG_MAIN
+#define WAVEREAD_STATS
+#define WAVEREAD_IO_URING
 #include <catch2/catch.hpp>
 #include <waveread.hpp>
+#include <wavewrite.hpp>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+#include <cstring>
+#include <sstream>
+
+static std::atomic<size_t> allocations{ 0u }; // counts every global operator new, plain, array and aligned, see "heap allocation" test.
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline)) // so that the compiler doesn't pair malloc() in one operator with free() in another, and warn of a mismatch
+#else
+#define NOINLINE
+#endif
+NOINLINE static void* allocate(std::size_t size)
+{
+	++allocations;
+	if (void* p = std::malloc(size ? size : 1u))
+		return p;
+	throw std::bad_alloc{};
+}
+NOINLINE static void deallocate(void* p) noexcept { std::free(p); }
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+#if defined(__cpp_aligned_new)
+NOINLINE static void* allocate(std::size_t size, std::align_val_t alignment)
+{
+	++allocations;
+	std::size_t align{ std::max(sizeof(void*), (std::size_t)alignment) };
+#if defined(_MSC_VER)
+	void* p{ _aligned_malloc(size ? size : 1u, align) };
+#else
+	void* p{ nullptr };
+	if (posix_memalign(&p, align, size ? size : 1u) != 0)
+		p = nullptr;
+#endif
+	if (p != nullptr)
+		return p;
+	throw std::bad_alloc{};
+}
+NOINLINE static void deallocate(void* p, std::align_val_t) noexcept
+{
+#if defined(_MSC_VER)
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void operator delete(void* p, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete[](void* p, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+void operator delete[](void* p, std::size_t, std::align_val_t alignment) noexcept { deallocate(p, alignment); }
+#endif
+
+// A pipe-like stream: hands out a file a few bytes at a time, and fails any attempt to seek.
+class PipeBuffer : public std::streambuf
+{
+public:
+	explicit PipeBuffer(const std::string& path) : m_file{ path, std::ios::binary } {}
+protected:
+	int_type underflow() override
+	{
+		m_file.read(m_chunk, sizeof(m_chunk));
+		if (m_file.gcount() == 0)
+			return traits_type::eof();
+		setg(m_chunk, m_chunk, m_chunk + m_file.gcount());
+		return traits_type::to_int_type(m_chunk[0]);
+	}
+private:
+	std::ifstream m_file;
+	char m_chunk[7];
+};
+
+// A stream over a string that counts how many times it is sought.
+class CountingBuffer : public std::stringbuf
+{
+public:
+	explicit CountingBuffer(const std::string& data) : std::stringbuf{ data, std::ios::in }, seeks{ 0u } {}
+	size_t seeks;
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override { ++seeks; return std::stringbuf::seekoff(off, dir, which); }
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override { ++seeks; return std::stringbuf::seekpos(pos, which); }
+};
+class CountingStream : public std::istream
+{
+public:
+	explicit CountingStream(const std::string& data) : std::istream{ nullptr }, buffer{ data } { rdbuf(&buffer); }
+	CountingBuffer buffer;
+};
+
+// Little-endian bytes of a value, and a RIFF chunk with a body, padded to an even size.
+static std::string le(uint64_t value, size_t bytes)
+{
+	std::string result{};
+	for (size_t i{ 0u }; i < bytes; ++i)
+		result.push_back((char)(value >> (8u * i)));
+	return result;
+}
+static std::string riffChunk(const std::string& id, const std::string& body, uint32_t size)
+{
+	return id + le(size, 4u) + body + ((body.size() & 1u) ? std::string(1u, '\0') : std::string{});
+}
+
+// A 32-bit float stereo file of a sum of sines, one list of frequencies per channel.
+static std::string sineFile(uint32_t rate, size_t frames, const std::vector<double>& left, const std::vector<double>& right)
+{
+	std::string data{};
+	for (size_t f{ 0u }; f < frames; ++f)
+		for (const std::vector<double>* tones : { &left, &right })
+		{
+			double v{ 0.0 };
+			for (double hz : *tones)
+				v += 0.4 * std::sin(2.0 * 3.14159265358979323846 * hz * (double)f / (double)rate);
+			float s{ (float)v };
+			uint32_t bits{};
+			std::memcpy(&bits, &s, 4u);
+			data += le(bits, 4u);
+		}
+	std::string fmt{ le(WAV_FORMAT_IEEE_FLOAT, 2u) + le(2u, 2u) + le(rate, 4u) + le(rate * 8u, 4u) + le(8u, 2u) + le(32u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	return "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks;
+}
 
 constexpr char assetPath[8] = "assets/";
-constexpr std::array<char[255], 5> supportedFiles = {
+constexpr std::array<char[255], 11> supportedFiles = {
 	"8-bit_unsigned_Sine_Stereo.wav",
 	"8-bit_Sine_Stereo.wav",
 	"16-bit_signed_Sine_Stereo.wav",
 	"24-bit_signed_Sine_Stereo.wav",
 	"32-bit_signed_Sine_Stereo.wav",
-};
-constexpr std::array<char[255], 6> unsupportedFiles = {
 	"32-bit_float_Sine_Stereo.wav",
 	"64-bit_float_Sine_Stereo.wav",
 	"A-Law_Sine_Stereo.wav",
+	"U-Law_Sine_Stereo.wav",
 	"IMA_ADPCM_Sine_Stereo.wav",
 	"MS_ADPCM_Sine_Stereo.wav",
-	"U-Law_Sine_Stereo.wav",
+};
+// fmt chunks of stereo files that waveread can't read: MPEG layer 3, and IMA ADPCM whose samples per block disagree with its block align.
+static const std::array<std::string, 2> unsupportedFormats = {
+	le(0x55u, 2u) + le(2u, 2u) + le(44100u, 4u) + le(16000u, 4u) + le(1u, 2u) + le(0u, 2u),
+	le(0x11u, 2u) + le(2u, 2u) + le(44100u, 4u) + le(88200u, 4u) + le(512u, 2u) + le(4u, 2u) + le(2u, 2u) + le(1000u, 2u),
 };
 
 
 TEST_CASE("Check that unsupported files are stated as unsupported.")
 {
-	for (auto unsupported : unsupportedFiles)
+	for (const std::string& format : unsupportedFormats)
 	{
-		std::string name{ assetPath + std::string{unsupported} };
-		std::unique_ptr<std::istream> fileStream{ new std::ifstream{name} };
+		std::string data(1024u, '\0'), body{ "WAVE" + riffChunk("fmt ", format, (uint32_t)format.size()) + riffChunk("data", data, (uint32_t)data.size()) };
+		std::unique_ptr<std::istream> fileStream{ new std::istringstream{ riffChunk("RIFF", body, (uint32_t)body.size()) } };
 		Waveread waveReader{ std::move(fileStream),2048u,0.5};
 
 		bool opened{ waveReader.open() };
@@ -137,4 +273,1431 @@ TEST_CASE("Does closing and and resetting the wavereader work correctly?")
 		REQUIRE(audio_initial == audio_reset);
 		REQUIRE(audio_initial == audio_closed);
 	}
-}
\ No newline at end of file
+}
+TEST_CASE("Does audio() into a caller-provided buffer produce the same audio as audio() into a vector?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+
+		const int channels[2]{ 0,1 };
+		std::vector<float> buffer(256u);
+		for (bool interleaved : { true, false })
+			for (size_t stride : { 0u, 1u, 3u })
+			{
+				std::vector<float> expected{ wr.audio(32u, 64u, { 0,1 }, stride, interleaved) };
+				size_t frames{ wr.audio(32u, 64u, buffer.data(), buffer.size(), channels, 2u, stride, interleaved) };
+				REQUIRE(frames * 2u == expected.size());
+				REQUIRE(std::equal(expected.begin(), expected.end(), buffer.begin()));
+			}
+
+		// a buffer that is too small is filled with whole frames, and no more.
+		std::fill(buffer.begin(), buffer.end(), 2.f);
+		REQUIRE(wr.audio(0u, 64u, buffer.data(), 7u, channels, 2u) == 3u);
+		REQUIRE(buffer[5] != 2.f);
+		REQUIRE(buffer[6] == 2.f);
+	}
+}
+
+TEST_CASE("Does audio() as integers, doubles, or one buffer per channel produce the same audio as audio() as floats?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+
+		const int channels[2]{ 1,0 };
+		for (size_t stride : { 0u, 3u })
+		{
+			std::vector<float> expected{ wr.audio(32u, 300u, { 0,1 }, stride, false) };
+			size_t frames{ expected.size() / 2u };
+			std::reverse(expected.begin(), expected.end() - frames); // as {C0, C1} reversed to {C1, C0}: swap the halves
+			std::reverse(expected.begin() + frames, expected.end());
+			std::reverse(expected.begin(), expected.end());
+
+			std::vector<double> doubles(frames * 2u);
+			REQUIRE(wr.audio(32u, 300u, doubles.data(), doubles.size(), channels, 2u, stride) == frames);
+			std::vector<int16_t> left(frames), right(frames);
+			int16_t* planar[2]{ left.data(), right.data() };
+			REQUIRE(wr.audio(32u, 300u, planar, frames, channels, 2u, stride) == frames);
+			std::vector<int32_t> wide(frames * 2u);
+			REQUIRE(wr.audio(32u, 300u, wide.data(), wide.size(), channels, 2u, stride) == frames);
+
+			bool same{ true };
+			for (size_t f{ 0u }; f < frames; ++f)
+				for (size_t c{ 0u }; c < 2u; ++c)
+				{
+					float sample{ expected[c * frames + f] };
+					same = same && (float)doubles[f * 2u + c] == sample;
+					same = same && std::abs((double)wide[f * 2u + c] / 2147483648.0 - sample) < 1e-6;
+					same = same && std::abs((int)planar[c][f] - sample * 32768.f) <= 1.f;
+				}
+			REQUIRE(same);
+		}
+	}
+
+	// integers are shifted, not scaled: 16-bit samples come back exactly as stored, and floating point samples are clipped.
+	std::unique_ptr<std::istream> stream{ new std::ifstream{ assetPath + std::string{supportedFiles[2]} } };
+	Waveread wr{ std::move(stream) };
+	REQUIRE(wr.open());
+	std::vector<int16_t> actual(64u);
+	const int channel[1]{ 0 };
+	REQUIRE(wr.audio(0u, 64u, actual.data(), actual.size(), channel, 1u) == 64u);
+	std::ifstream raw{ assetPath + std::string{supportedFiles[2]}, std::ios::binary };
+	raw.seekg((std::streamoff)wr.header().m_dataOffset);
+	std::vector<int16_t> stored(128u);
+	raw.read(reinterpret_cast<char*>(stored.data()), 256);
+	for (size_t i{ 0u }; i < 64u; ++i)
+		REQUIRE(actual[i] == stored[i * 2u]);
+
+	REQUIRE(waveread_detail::fromReal<int16_t>(1.5) == 32767);
+	REQUIRE(waveread_detail::fromReal<int16_t>(-1.5) == -32768);
+	REQUIRE(waveread_detail::fromReal<int32_t>(1.0) == 2147483647);
+}
+
+TEST_CASE("Does every selection of channels, in any order, give the samples of those channels?")
+{
+	std::mt19937 rng{ 6u };
+	const size_t nch{ 6u }, totalFrames{ 1000u };
+	std::string data(totalFrames * nch * 3u, '\0'); // 24-bit, six channels
+	for (char& b : data)
+		b = (char)rng();
+	std::string fmt{ le(WAV_FORMAT_PCM, 2u) + le(nch, 2u) + le(48000u, 4u) + le(48000u * nch * 3u, 4u) + le(nch * 3u, 2u) + le(24u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	std::unique_ptr<std::istream> stream{ new std::istringstream{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks } };
+	Waveread wr{ std::move(stream) };
+	auto stored = [&data, nch](size_t frame, int channel) {
+		const uint8_t* s{ reinterpret_cast<const uint8_t*>(data.data()) + (frame * nch + (size_t)channel % nch) * 3u };
+		return (int32_t)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24));
+	};
+
+	const std::vector<std::vector<int>> selections{ { 0 }, { 3 }, { 4,1 }, { 1,1 }, { 5,2,0 }, { 0,1,2,3,4,5 }, { 0,1,2,3,4,5,7 }, { 5,4,3,2,1,0 } };
+	for (const std::vector<int>& channels : selections)
+		for (size_t stride : { 0u, 2u })
+		{
+			const size_t start{ 17u }, frames{ (totalFrames - start + stride) / (1u + stride) }, count{ channels.size() };
+			std::vector<float> interleaved(frames * count), planar(frames * count);
+			std::vector<int32_t> integers(frames * count);
+			REQUIRE(wr.audio(start, totalFrames, interleaved.data(), interleaved.size(), channels.data(), count, stride) == frames);
+			REQUIRE(wr.audio(start, totalFrames, planar.data(), planar.size(), channels.data(), count, stride, false) == frames);
+			REQUIRE(wr.audio(start, totalFrames, integers.data(), integers.size(), channels.data(), count, stride) == frames);
+			bool same{ true };
+			for (size_t f{ 0u }; f < frames; ++f)
+				for (size_t c{ 0u }; c < count; ++c)
+				{
+					int32_t expected{ stored(start + f * (1u + stride), channels[c]) };
+					same = same && integers[f * count + c] == expected;
+					same = same && interleaved[f * count + c] == (float)expected / 2147483648.f;
+					same = same && planar[c * frames + f] == (float)expected / 2147483648.f;
+				}
+			REQUIRE(same);
+		}
+}
+
+TEST_CASE("Does audio() into a caller-provided buffer avoid heap allocation?")
+{
+	std::string name{ assetPath + std::string{supportedFiles[2]} };
+	std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+	Waveread wr{ std::move(stream) };
+
+	const int channels[2]{ 0,1 };
+	float buffer[128]{};
+	REQUIRE(wr.audio(0u, 64u, buffer, 128u, channels, 2u) == 64u); // opens the file and fills the cache
+
+	size_t before{ allocations.load() };
+	size_t frames{ 0u };
+	for (size_t i{ 0u }; i < 64u; ++i)
+	{
+		frames += wr.audio(i, 64u, buffer, 128u, channels, 2u);
+		frames += wr.audio(i, 32u, buffer, 128u, channels + 1, 1u, 1u, false);
+	}
+	size_t after{ allocations.load() };
+
+	REQUIRE(frames == 64u * (64u + 16u));
+	REQUIRE(after == before);
+
+	// arrays, and objects aligned beyond what malloc() promises, are counted too: otherwise allocations through them would go unseen.
+	std::unique_ptr<float[]> array{ new float[4] };
+#if defined(__cpp_aligned_new)
+	struct alignas(64) Line { float samples[16]; };
+	std::unique_ptr<Line> line{ new Line{} };
+	REQUIRE(allocations.load() == after + 2u);
+	REQUIRE(reinterpret_cast<uintptr_t>(line.get()) % 64u == 0u);
+#else
+	REQUIRE(allocations.load() == after + 1u);
+#endif
+	REQUIRE(array != nullptr);
+}
+
+TEST_CASE("Are all samples between -1 and 1?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+
+		std::vector<float> f{ wr.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) };
+		REQUIRE(!f.empty());
+		REQUIRE(*std::min_element(f.begin(), f.end()) >= -1.f);
+		REQUIRE(*std::max_element(f.begin(), f.end()) < 1.f);
+		REQUIRE(*std::min_element(f.begin(), f.end()) < 0.f); // sine: so both signs should be present
+	}
+}
+
+TEST_CASE("Do the vectorised conversion kernels produce exactly the same samples as the scalar kernels?")
+{
+	using namespace waveread_detail;
+	std::mt19937 rng{ 1234u };
+	std::vector<uint8_t> bytes(4u * 4099u);
+	for (auto& b : bytes)
+		b = (uint8_t)rng();
+
+	for (int bits : { 8, 16, 24, 32 })
+		for (Simd simd : { Simd::sse2, Simd::avx2 })
+			for (size_t count : { 0u, 1u, 5u, 9u, 15u, 16u, 17u, 31u, 33u, 67u, 4099u })
+			{
+				std::vector<float> expected(count + 1u, 0.f), actual(count + 1u, 0.f);
+				kernel(bits, Simd::none)(bytes.data(), expected.data(), count);
+				kernel(bits, simd)(bytes.data(), actual.data(), count);
+				REQUIRE(std::memcmp(expected.data(), actual.data(), (count + 1u) * sizeof(float)) == 0);
+			}
+
+	for (uint16_t format : { WAV_FORMAT_ALAW, WAV_FORMAT_MULAW })
+		for (size_t count : { 0u, 1u, 7u, 8u, 9u, 17u, 4099u })
+		{
+			std::vector<float> expected(count + 1u, 0.f), actual(count + 1u, 0.f);
+			kernel(8, Simd::none, format)(bytes.data(), expected.data(), count);
+			kernel(8, Simd::avx2, format)(bytes.data(), actual.data(), count);
+			REQUIRE(std::memcmp(expected.data(), actual.data(), (count + 1u) * sizeof(float)) == 0);
+		}
+
+	// 64-bit floats, including some that round to float denormals, or overflow to infinity.
+	std::uniform_real_distribution<double> uniform{ -2.0, 2.0 };
+	std::vector<double> doubles(4099u);
+	for (size_t i{ 0u }; i < doubles.size(); ++i)
+		doubles[i] = uniform(rng) * (i % 7u == 3u ? 1e-40 : i % 11u == 5u ? 1e40 : 1.0);
+	const uint8_t* src{ reinterpret_cast<const uint8_t*>(doubles.data()) };
+	for (Simd simd : { Simd::sse2, Simd::avx2 })
+		for (size_t count : { 0u, 1u, 3u, 4u, 5u, 9u, 15u, 16u, 17u, 4099u })
+		{
+			std::vector<float> expected(count + 1u, 0.f), actual(count + 1u, 0.f);
+			kernel(64, Simd::none, WAV_FORMAT_IEEE_FLOAT)(src, expected.data(), count);
+			kernel(64, simd, WAV_FORMAT_IEEE_FLOAT)(src, actual.data(), count);
+			REQUIRE(std::memcmp(expected.data(), actual.data(), (count + 1u) * sizeof(float)) == 0);
+		}
+}
+
+TEST_CASE("Do floating point files produce the same audio as integer files?")
+{
+	std::unique_ptr<std::istream> intStream{ new std::ifstream{ assetPath + std::string{supportedFiles[4]} } };
+	Waveread integer{ std::move(intStream) };
+	for (auto floating : { supportedFiles[5], supportedFiles[6] })
+	{
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ assetPath + std::string{floating} } };
+		Waveread wr{ std::move(stream) };
+		REQUIRE(wr.open());
+		REQUIRE(wr.header().format() == WAV_FORMAT_IEEE_FLOAT);
+		for (size_t stride : { 0u, 3u })
+			for (bool interleaved : { true, false })
+				for (const std::set<int>& channels : { std::set<int>{ 0,1 }, std::set<int>{ 1 } })
+				{
+					std::vector<float> expected{ integer.audio(0, std::numeric_limits<size_t>::max(), channels, stride, interleaved) },
+						actual{ wr.audio(0, std::numeric_limits<size_t>::max(), channels, stride, interleaved) };
+					REQUIRE(actual.size() == expected.size());
+					for (size_t i{ 0u }; i < actual.size(); ++i)
+						REQUIRE(actual[i] == Approx(expected[i]).margin(1e-6));
+				}
+	}
+}
+
+TEST_CASE("Does a memory-mapped wavereader produce the same audio as a stream wavereader?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread streamed{ std::move(stream), 256u };
+		Waveread mapped{ name, WAV_ACCESS::random };
+		REQUIRE(mapped.open());
+#if defined(WAVEREAD_MMAP)
+		REQUIRE(mapped.mapped());
+#endif
+		for (size_t start : { 0u, 17u, 200u, 400u })
+			for (size_t stride : { 0u, 2u })
+				REQUIRE(mapped.audio(start, 64u, { 0,1 }, stride) == streamed.audio(start, 64u, { 0,1 }, stride));
+		REQUIRE(mapped.audio(0, std::numeric_limits<size_t>::max(), { 1 }) == streamed.audio(0, std::numeric_limits<size_t>::max(), { 1 }));
+
+		Waveread moved{ std::move(mapped) };
+		moved.setAccess(WAV_ACCESS::sequential);
+		REQUIRE(moved.audio(8u, 8u, { 0,1 }) == streamed.audio(8u, 8u, { 0,1 }));
+		moved.close();
+		REQUIRE(moved.audio(8u, 8u, { 0,1 }) == streamed.audio(8u, 8u, { 0,1 }));
+	}
+
+	Waveread missing{ assetPath + std::string{ "missing.wav" } };
+	REQUIRE(!missing.mapped());
+	REQUIRE(!missing.open());
+}
+
+TEST_CASE("Does reading on through a small cache, which is extended in the background, produce the same audio as a large cache?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread large{ std::move(stream) };
+		std::vector<float> expected{ large.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) };
+
+		for (double threshold : { 0.0, 0.25, 1.0 })
+		{
+			std::unique_ptr<std::istream> smallStream{ new std::ifstream{ name } };
+			std::vector<Waveread> readers{};
+			readers.emplace_back(std::move(smallStream), 256u, threshold);
+			std::vector<float> actual{};
+			for (size_t start{ 0u }; start < 441u; start += 8u)
+			{
+				std::vector<float> block{ readers.back().audio(start, 8u, { 0,1 }) };
+				actual.insert(actual.end(), block.begin(), block.end());
+				if (start == 200u) // a reader that may be prefetching can still be moved.
+					readers.push_back(std::move(readers.back()));
+			}
+			REQUIRE(actual == expected);
+		}
+	}
+}
+
+TEST_CASE("Are reads that span many cache pages the same as reads from one large cache?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread large{ std::move(stream) };
+		std::unique_ptr<std::istream> pagedStream{ new std::ifstream{ name } };
+		Waveread paged{ std::move(pagedStream), 300u, 0.5, 100u }; // pages round down to whole frames, and the cache to whole pages
+
+		for (size_t start : { 0u, 11u, 97u, 430u })
+			for (size_t stride : { 0u, 1u, 5u })
+				for (bool interleaved : { true, false })
+					REQUIRE(paged.audio(start, 120u, { 0,1 }, stride, interleaved) == large.audio(start, 120u, { 0,1 }, stride, interleaved));
+
+		paged.setCacheSize(64u);
+		paged.setCachePageSize(16u);
+		REQUIRE(paged.audio(0, std::numeric_limits<size_t>::max(), { 1,0 }) == large.audio(0, std::numeric_limits<size_t>::max(), { 1,0 }));
+	}
+}
+
+TEST_CASE("Does the cache keep pages from distant parts of a file, reading each only once?")
+{
+	std::string name{ assetPath + std::string{supportedFiles[4]} };
+	std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+	Waveread wr{ std::move(stream), 2048u, 0.5, 128u }; // 16 pages of 16 frames: room for both regions and their read-ahead.
+	REQUIRE(wr.open()); // reads the first page
+
+	for (size_t i{ 0u }; i < 20u; ++i)
+	{
+		REQUIRE(wr.audio(i % 4u, 8u, { 0,1 }).size() == 16u); // overlapping reads at the start
+		REQUIRE(wr.audio(400u, 8u, { 0,1 }).size() == 16u); // and at the end
+	}
+	REQUIRE(wr.cacheMisses() == 1u);
+	REQUIRE(wr.cacheHits() == 39u);
+}
+
+TEST_CASE("Do the stats of a reader count its hits, misses, reads and prefetches, and trace them?")
+{
+	std::mt19937 rng{ 16u };
+	std::string data(64u * 4096u, '\0'); // 16-bit stereo: 64 pages of 4KB
+	for (char& b : data)
+		b = (char)rng();
+	std::string fmt{ le(WAV_FORMAT_PCM, 2u) + le(2u, 2u) + le(48000u, 4u) + le(48000u * 4u, 4u) + le(4u, 2u) + le(16u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	std::unique_ptr<std::istream> stream{ new std::istringstream{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks } };
+	Waveread wr{ std::move(stream), 16u * 4096u, 0.5, 4096u }; // 16 pages, reading ahead 8 at a time
+
+	std::mutex traceMutex{};
+	std::set<std::string> traced{};
+	wr.setTrace([&](const WAV_SPAN& span) {
+		std::lock_guard<std::mutex> l{ traceMutex };
+		traced.insert(span.name);
+	});
+	REQUIRE(wr.open()); // loads page 0
+	const int channels[2]{ 0,1 };
+	std::vector<float> buffer(2048u);
+	std::vector<int16_t> integers(2048u);
+	REQUIRE(wr.audio(40u * 1024u, 1024u, { 0,1 }).size() == 2048u); // page 40: a miss, which asks for pages 41 to 48 to be prefetched
+	for (size_t wait{ 0u }; wait < 500u && wr.stats().prefetchLoads < 8u; ++wait)
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	REQUIRE(wr.stats().prefetchLoads == 8u);
+	REQUIRE(wr.audio(41u * 1024u, 1024u, buffer.data(), buffer.size(), channels, 2u) == 1024u); // hits on prefetched pages
+	REQUIRE(wr.audio(42u * 1024u, 1024u, integers.data(), integers.size(), channels, 2u) == 1024u);
+	REQUIRE(wr.readBatch({ { 10u * 1024u, 10u } }).size() == 1u); // read from the stream, bypassing the cache
+
+	WAV_STATS stats{ wr.stats() };
+	REQUIRE(stats.misses[(size_t)WAV_CALL::vector] == 1u);
+	REQUIRE(stats.hits[(size_t)WAV_CALL::buffer] == 1u);
+	REQUIRE(stats.hits[(size_t)WAV_CALL::typed] == 1u);
+	REQUIRE(stats.loads == 2u); // page 0 on open, and page 40
+	REQUIRE(stats.bytesRead == (2u + 8u) * 4096u + 10u * 4u);
+	REQUIRE(stats.lockHeldNanoseconds > 0u);
+	REQUIRE(stats.loadNanoseconds > 0u);
+	size_t early{ 0u };
+	for (size_t i{ 1u }; i < WAV_STATS::leadBuckets; ++i)
+		early += stats.prefetchLead[i];
+	REQUIRE(early == 2u); // pages 41 and 42
+	{
+		std::lock_guard<std::mutex> l{ traceMutex };
+		REQUIRE(traced == std::set<std::string>{ "audio", "wait", "load", "prefetch", "read" });
+	}
+
+	// counting by every call adds up to the cache counters
+	for (size_t i{ 0u }; i < 64u; i += 3u)
+		wr.audio(i * 1024u, 100u, { 1 });
+	stats = wr.stats();
+	size_t hits{ 0u }, misses{ 0u };
+	for (size_t i{ 0u }; i < (size_t)WAV_CALL::count; ++i)
+	{
+		hits += stats.hits[i];
+		misses += stats.misses[i];
+	}
+	REQUIRE(hits == wr.cacheHits());
+	REQUIRE(misses == wr.cacheMisses());
+
+	wr.resetStats();
+	REQUIRE(wr.stats().bytesRead == 0u);
+	REQUIRE(wr.stats().hits[(size_t)WAV_CALL::vector] == 0u);
+}
+
+TEST_CASE("Does audio read in the background, in order of deadline, match audio read in the foreground?")
+{
+	std::string name{ assetPath + std::string{supportedFiles[3]} };
+	std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+	Waveread wr{ std::move(stream), 2048u, 0.5, 256u };
+	std::unique_ptr<std::istream> expectedStream{ new std::ifstream{ name } };
+	Waveread expected{ std::move(expectedStream) };
+
+	std::future<std::vector<float>> future{ wr.audioAsync(100u, 200u, { 0,1 }) };
+	REQUIRE(future.get() == expected.audio(100u, 200u, { 0,1 }));
+
+	// hold up the I/O thread, then queue reads due in the reverse order to their queueing: they run in order of deadline.
+	std::mutex mutex{};
+	std::condition_variable condition{};
+	bool held{ false }, released{ false };
+	std::vector<size_t> order{};
+	wr.audioAsync(0u, 1u, [&](std::vector<float>) {
+		std::unique_lock<std::mutex> l{ mutex };
+		held = true;
+		condition.notify_all();
+		condition.wait(l, [&]() { return released; });
+	});
+	{
+		std::unique_lock<std::mutex> l{ mutex };
+		condition.wait(l, [&]() { return held; });
+	}
+	std::chrono::steady_clock::time_point now{ std::chrono::steady_clock::now() };
+	std::vector<std::vector<float>> results(3u);
+	for (size_t i{ 0u }; i < 3u; ++i)
+		wr.audioAsync(i * 100u, 50u, [&, i](std::vector<float> audio) {
+			std::lock_guard<std::mutex> l{ mutex };
+			order.push_back(i);
+			results[i] = std::move(audio);
+		}, { 1 }, 0u, true, now + std::chrono::seconds{ 3 - (int)i });
+	const int channels[2]{ 0,1 };
+	std::vector<float> buffer(64u);
+	std::promise<size_t> frames{};
+	wr.audioAsync(10u, 32u, buffer.data(), buffer.size(), channels, 2u, [&frames](size_t n) { frames.set_value(n); }, 0u, true, now + std::chrono::seconds{ 10 });
+	{
+		std::lock_guard<std::mutex> l{ mutex };
+		released = true;
+	}
+	condition.notify_all();
+	REQUIRE(frames.get_future().get() == 32u);
+	REQUIRE(buffer == expected.audio(10u, 32u, { 0,1 }));
+	std::lock_guard<std::mutex> l{ mutex };
+	REQUIRE(order == std::vector<size_t>{ 2u, 1u, 0u });
+	for (size_t i{ 0u }; i < 3u; ++i)
+		REQUIRE(results[i] == expected.audio(i * 100u, 50u, { 1 }));
+
+	// a reader that hasn't been opened yet is opened by audioAsync() on this thread, not by the I/O thread while this one reads.
+	for (size_t i{ 0u }; i < 8u; ++i)
+	{
+		Waveread unopened{ std::unique_ptr<std::istream>{ new std::ifstream{ assetPath + std::string{supportedFiles[i % supportedFiles.size()]} } }, 2048u, 0.5, 256u };
+		Waveread reference{ std::unique_ptr<std::istream>{ new std::ifstream{ assetPath + std::string{supportedFiles[i % supportedFiles.size()]} } } };
+		std::future<std::vector<float>> background{ unopened.audioAsync(50u, 100u, { 0,1 }) };
+		std::vector<float> foreground{ unopened.audio(200u, 100u, { 0,1 }) };
+		REQUIRE(foreground == reference.audio(200u, 100u, { 0,1 }));
+		REQUIRE(background.get() == reference.audio(50u, 100u, { 0,1 }));
+	}
+}
+
+TEST_CASE("Does prefetch() read a range into the cache before it is needed, and does a reader run its queued reads before it is destroyed?")
+{
+	std::mt19937 rng{ 17u };
+	std::string data(64u * 4096u, '\0'); // 16-bit stereo: 64 pages of 4KB
+	for (char& b : data)
+		b = (char)rng();
+	std::string fmt{ le(WAV_FORMAT_PCM, 2u) + le(2u, 2u) + le(48000u, 4u) + le(48000u * 4u, 4u) + le(4u, 2u) + le(16u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	std::string bytes{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks };
+	std::unique_ptr<std::istream> stream{ new std::istringstream{ bytes } };
+	Waveread wr{ std::move(stream), 16u * 4096u, 0.5, 4096u };
+	REQUIRE(wr.open());
+
+	wr.prefetch(30u * 1024u, 4u * 1024u, std::chrono::steady_clock::now() + std::chrono::milliseconds{ 100 }); // pages 30 to 33
+	for (size_t wait{ 0u }; wait < 500u && wr.stats().prefetchLoads < 4u; ++wait)
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	REQUIRE(wr.stats().prefetchLoads == 4u);
+	size_t misses{ wr.cacheMisses() };
+	for (size_t page{ 30u }; page < 34u; ++page)
+		REQUIRE(wr.audio(page * 1024u, 1024u, { 0,1 }).size() == 2048u);
+	REQUIRE(wr.cacheMisses() == misses);
+
+	std::vector<float> expected{ wr.audio(5000u, 100u, { 0,1 }) };
+	std::future<std::vector<float>> future{};
+	std::vector<float> called{};
+	{
+		std::unique_ptr<std::istream> other{ new std::istringstream{ bytes } };
+		Waveread reader{ std::move(other) };
+		future = reader.audioAsync(5000u, 100u, { 0,1 });
+		reader.audioAsync(5000u, 100u, [&called](std::vector<float> audio) { called = std::move(audio); });
+	}
+	REQUIRE(future.get() == expected);
+	REQUIRE(called == expected);
+}
+
+TEST_CASE("Does an overview give the same peaks and RMS as the audio, and survive saving and loading?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+		std::vector<float> samples{ wr.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) };
+		size_t frames{ samples.size() / 2u };
+		REQUIRE(!wr.hasOverview());
+
+		for (size_t pixels : { (size_t)1u, (size_t)7u, frames }) // one pixel is read from the overview, the rest from the audio
+		{
+			std::vector<WAV_PEAK> peaks{ wr.overview(0, frames, pixels, { 0,1 }) };
+			REQUIRE(peaks.size() == pixels * 2u);
+			for (size_t p{ 0u }; p < pixels; ++p)
+				for (size_t c{ 0u }; c < 2u; ++c)
+				{
+					size_t s0{ (p * frames) / pixels }, s1{ ((p + 1u) * frames) / pixels };
+					float min{ 1.f }, max{ -1.f }, squares{ 0.f };
+					for (size_t s{ s0 }; s < s1; ++s)
+					{
+						float v{ samples[s * 2u + c] };
+						min = std::min(min, v);
+						max = std::max(max, v);
+						squares += v * v;
+					}
+					REQUIRE(peaks[p * 2u + c].min == min);
+					REQUIRE(peaks[p * 2u + c].max == max);
+					REQUIRE(peaks[p * 2u + c].rms == Approx(std::sqrt(squares / (float)(s1 - s0))).epsilon(1e-4));
+				}
+		}
+		REQUIRE(wr.hasOverview());
+
+		std::stringstream sidecar{};
+		REQUIRE(wr.saveOverview(sidecar));
+		std::unique_ptr<std::istream> reopenedStream{ new std::ifstream{ name } };
+		Waveread reopened{ std::move(reopenedStream) };
+		REQUIRE(reopened.loadOverview(sidecar));
+		std::vector<WAV_PEAK> expected{ wr.overview(0, frames, 1u, { 1 }) }, actual{ reopened.overview(0, frames, 1u, { 1 }) };
+		REQUIRE(actual.size() == 1u);
+		REQUIRE(actual[0].min == expected[0].min);
+		REQUIRE(actual[0].max == expected[0].max);
+		REQUIRE(actual[0].rms == expected[0].rms);
+	}
+
+	// an overview saved from one file is refused by another
+	std::unique_ptr<std::istream> stream8{ new std::ifstream{ assetPath + std::string{supportedFiles[0]} } };
+	std::unique_ptr<std::istream> stream16{ new std::ifstream{ assetPath + std::string{supportedFiles[2]} } };
+	Waveread wr8{ std::move(stream8) }, wr16{ std::move(stream16) };
+	std::stringstream sidecar{};
+	REQUIRE(wr8.saveOverview(sidecar));
+	REQUIRE(!wr16.loadOverview(sidecar));
+	REQUIRE(!wr16.hasOverview());
+
+	// and so is one from another version, or with a number of levels or entries that doesn't match the file
+	const std::string saved{ sidecar.str() };
+	for (size_t offset : { (size_t)4u, (size_t)24u, (size_t)28u }) // version, levels, entries of the first level
+	{
+		std::string tampered{ saved };
+		tampered[offset + 3u] = (char)0x7f;
+		std::istringstream in{ tampered };
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::ifstream{ assetPath + std::string{supportedFiles[0]} } } };
+		REQUIRE(!wr.loadOverview(in));
+		REQUIRE(!wr.hasOverview());
+	}
+
+	// sums of squares over millions of samples keep their precision at the coarsest level
+	Waveread wr{ std::unique_ptr<std::istream>{ new std::istringstream{ sineFile(44100u, 1u << 21, { 440.0 }, { 997.0, 31.0 }) } } };
+	std::vector<float> samples{ wr.audio(0u, 1u << 21, { 0,1 }) };
+	std::vector<WAV_PEAK> peaks{ wr.overview(0u, 1u << 21, 1u, { 0,1 }) };
+	REQUIRE(peaks.size() == 2u);
+	for (size_t c{ 0u }; c < 2u; ++c)
+	{
+		double squares{ 0.0 };
+		for (size_t f{ 0u }; f < samples.size() / 2u; ++f)
+			squares += (double)samples[f * 2u + c] * samples[f * 2u + c];
+		REQUIRE(peaks[c].rms == Approx(std::sqrt(squares / (double)(1u << 21))).epsilon(1e-6));
+	}
+}
+
+TEST_CASE("Does a streaming wavereader produce the same audio as a wavereader, from a stream that can't seek?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+		std::vector<float> expected{ wr.audio(0, std::numeric_limits<size_t>::max(), { 1,0 }) };
+		if (wr.header().compressed()) // ADPCM is only read by Waveread
+		{
+			PipeBuffer pipe{ name };
+			std::istream in{ &pipe };
+			REQUIRE(!Wavestream{ in }.open());
+			continue;
+		}
+
+		for (size_t bufferSize : { 1u, 100u, 65536u }) // smaller than a frame, not a whole number of frames, and larger than the file
+		{
+			PipeBuffer pipe{ name };
+			std::istream in{ &pipe };
+			Wavestream ws{ in, bufferSize };
+			REQUIRE(ws.open());
+			REQUIRE(ws.bufferSize() % ws.header().m_32_bytesPerBlock == 0u);
+			REQUIRE(ws.bufferSize() <= std::max<size_t>(bufferSize, ws.header().m_32_bytesPerBlock));
+
+			std::vector<float> actual{};
+			while (!ws.finished())
+			{
+				std::vector<float> block{ ws.next(13u, { 1,0 }) };
+				actual.insert(actual.end(), block.begin(), block.end());
+			}
+			REQUIRE(actual == expected);
+			REQUIRE(ws.position() == expected.size() / 2u);
+			REQUIRE(ws.next(13u, { 1,0 }).empty());
+		}
+
+		// planar blocks, from a stream the reader owns
+		std::unique_ptr<std::istream> owned{ new std::ifstream{ name } };
+		Wavestream planar{ std::move(owned), 200u };
+		std::vector<float> first{ planar.next(300u, { 0,1 }, false) }, second{ planar.next(300u, { 0,1 }, false) };
+		REQUIRE(first == wr.audio(0, 300u, { 0,1 }, 0u, false));
+		REQUIRE(second == wr.audio(300u, 300u, { 0,1 }, 0u, false));
+	}
+}
+
+TEST_CASE("Are files with other chunks, WAVE_FORMAT_EXTENSIBLE or RF64 sizes read the same as the plain file?")
+{
+	std::string name{ assetPath + std::string{supportedFiles[3]} };
+	std::ifstream file{ name, std::ios::binary };
+	std::string plain{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+	std::unique_ptr<std::istream> plainStream{ new std::istringstream{ plain } };
+	Waveread reference{ std::move(plainStream) };
+	std::vector<float> expected{ reference.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) };
+	REQUIRE(reference.header().m_dataOffset == WAV_HEADER_DEFAULT_SIZE);
+	REQUIRE(reference.header().m_chunks.size() == 2u);
+
+	std::string fmt{ plain.substr(20u, 16u) }, data{ plain.substr(44u) };
+	std::string extensible{ le(WAV_FORMAT_EXTENSIBLE, 2u) + fmt.substr(2u) + le(22u, 2u) + le(24u, 2u) + le(3u, 4u) + le(WAV_FORMAT_PCM, 2u) +
+		std::string{ "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14u } };
+	std::string info{ riffChunk("INFO" "ISFT", "waveread", 8u) };
+
+	std::string chunks{ riffChunk("JUNK", std::string(27u, '\0'), 27u) + riffChunk("fmt ", fmt + le(0u, 2u), 18u) + riffChunk("LIST", info, (uint32_t)info.size()) +
+		riffChunk("data", data, (uint32_t)data.size()) + riffChunk("LIST", info, (uint32_t)info.size()) };
+	std::string rf64{ riffChunk("ds64", le(4u + 36u + 40u + 8u + data.size(), 8u) + le(data.size(), 8u) + le(data.size() / 6u, 8u) + le(0u, 4u), 28u) +
+		riffChunk("fmt ", extensible, 40u) + riffChunk("data", data, 0xFFFFFFFFu) };
+	std::vector<std::string> files{
+		"RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks,
+		"RIFF" + le(4u + 48u + 8u + data.size(), 4u) + "WAVE" + riffChunk("fmt ", extensible, 40u) + riffChunk("data", data, (uint32_t)data.size()),
+		"RF64" + le(0xFFFFFFFFu, 4u) + "WAVE" + rf64,
+	};
+	for (uint32_t size : { 40000u, 70000u }) // fmt chunks too large for the 16-bit size field of the header
+		files.push_back("RIFF" + le(4u + 8u + size + 8u + data.size(), 4u) + "WAVE" + riffChunk("fmt ", fmt + std::string(size - 16u, '\0'), size) + riffChunk("data", data, (uint32_t)data.size()));
+	for (const std::string& variant : files)
+	{
+		std::unique_ptr<std::istream> stream{ new std::istringstream{ variant } };
+		Waveread wr{ std::move(stream) };
+		REQUIRE(wr.open());
+		REQUIRE(wr.header().m_dataSize == data.size());
+		REQUIRE(wr.header().samples() == expected.size() / 2u);
+		REQUIRE(std::string{ variant, (size_t)wr.header().m_dataOffset, data.size() } == data);
+		REQUIRE(wr.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) == expected);
+
+		std::istringstream forward{ variant };
+		Wavestream ws{ forward };
+		REQUIRE(ws.next(expected.size() / 2u, { 0,1 }) == expected);
+	}
+
+	Waveread chunked{ std::unique_ptr<std::istream>{ new std::istringstream{ files[0] } } };
+	REQUIRE(chunked.open());
+	REQUIRE(chunked.header().m_chunks.size() == 5u);
+	const WAV_CHUNK* list{ chunked.header().chunk("LIST") };
+	REQUIRE(list != nullptr);
+	REQUIRE(files[0].substr((size_t)list->m_offset, 8u) == "INFOISFT");
+
+	Waveread wide{ std::unique_ptr<std::istream>{ new std::istringstream{ files[2] } } };
+	REQUIRE(wide.open());
+	REQUIRE(wide.header().m_40_dataSubchunkSize == -1);
+	REQUIRE(wide.header().m_factSamples == data.size() / 6u);
+	REQUIRE(wide.header().m_subFormat == WAV_FORMAT_PCM);
+	REQUIRE(wide.header().m_validBitsPerSample == 24u);
+
+	Waveread padded{ std::unique_ptr<std::istream>{ new std::istringstream{ files[4] } } };
+	REQUIRE(padded.open());
+	REQUIRE(padded.header().m_16_subchunk1Size == INT16_MAX);
+	REQUIRE(padded.header().chunk("fmt ")->m_size == 70000u);
+}
+
+TEST_CASE("Does a batch of scattered ranges give the same audio as reading each range, with one read for each cluster?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::ifstream file{ name, std::ios::binary };
+		std::string bytes{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+
+		std::vector<WAV_RANGE> ranges{};
+		for (size_t k{ 0u }; k < 6u; ++k) // four clusters, given out of order. Ranges in a cluster overlap or lie a few frames apart.
+			for (size_t cluster : { 2u, 0u, 3u, 1u })
+				ranges.push_back(WAV_RANGE{ 60u + cluster * 120u + k * 3u, 2u + k });
+		ranges.push_back(WAV_RANGE{ 435u, 100u }); // runs past the end
+		ranges.push_back(WAV_RANGE{ 500u, 4u }); // outside the file
+
+		for (bool interleaved : { true, false })
+		{
+			std::unique_ptr<std::istream> stream{ new std::istringstream{ bytes } };
+			Waveread each{ std::move(stream) };
+			std::vector<std::vector<float>> expected{};
+			for (const WAV_RANGE& range : ranges)
+				expected.push_back(each.audio(range.startSample, range.sampleCount, { 1,0 }, 0u, interleaved));
+
+			CountingStream* counted{ new CountingStream{ bytes } };
+			Waveread batch{ std::unique_ptr<std::istream>{ counted }, 1024u, 0.5, 128u }; // ranges in a cluster are less than a page apart
+			REQUIRE(batch.open());
+			size_t seeks{ counted->buffer.seeks };
+			REQUIRE(batch.readBatch(ranges, { 1,0 }, interleaved) == expected);
+			if (!batch.header().compressed()) // ADPCM blocks are read through the cache
+				REQUIRE(counted->buffer.seeks - seeks == 4u);
+		}
+	}
+}
+
+TEST_CASE("Do cursors on a shared file, reading from many threads through a small cache, produce the same audio as a wavereader?")
+{
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+		Waveread wr{ std::move(stream) };
+		std::vector<float> expected{ wr.audio(0, std::numeric_limits<size_t>::max(), { 0,1 }) };
+		size_t frames{ expected.size() / 2u };
+
+		std::shared_ptr<Wavefile> file{ std::make_shared<Wavefile>(name, 256u, 64u) }; // four small pages, so pages are evicted while others are read
+		if (wr.header().compressed()) // ADPCM is only read by Waveread
+		{
+			REQUIRE(!file->opened());
+			continue;
+		}
+		REQUIRE(file->opened());
+		REQUIRE(file->cachePages() == 4u);
+
+		std::atomic<size_t> mismatches{ 0u };
+		std::vector<std::thread> threads{};
+		for (unsigned t{ 0u }; t < 8u; ++t)
+			threads.emplace_back([&, t]() {
+				Wavecursor cursor{ file };
+				std::mt19937 rng{ t };
+				std::vector<float> block(64u);
+				const int channels[2]{ 0,1 };
+				for (size_t i{ 0u }; i < 300u; ++i)
+				{
+					size_t start{ rng() % frames }, count{ 1u + rng() % 32u };
+					size_t n{ cursor.audio(start, count, block.data(), block.size(), channels, 2u) };
+					if (n != std::min(count, frames - start) || !std::equal(block.begin(), block.begin() + n * 2u, expected.begin() + start * 2u))
+						++mismatches;
+				}
+				std::vector<float> all{};
+				while (size_t n = cursor.read(block.data(), block.size(), channels, 2u))
+					all.insert(all.end(), block.begin(), block.begin() + n * 2u);
+				if (all != expected || cursor.position() != frames)
+					++mismatches;
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+		REQUIRE(mismatches == 0u);
+		REQUIRE(file->loads() > 0u);
+
+		Wavecursor cursor{ file };
+		REQUIRE(cursor.audio(0, std::numeric_limits<size_t>::max(), { 1 }, 2u, false) == wr.audio(0, std::numeric_limits<size_t>::max(), { 1 }, 2u, false));
+	}
+}
+
+TEST_CASE("Does a thread pool run every task exactly once?")
+{
+	for (size_t size : { 1u, 3u, 8u })
+	{
+		Wavethreads threads{ size };
+		REQUIRE(threads.size() == size);
+		for (size_t tasks : { 0u, 1u, 7u, 1000u })
+		{
+			std::vector<std::atomic<int>> runs(tasks);
+			std::vector<std::atomic<int>> busy(size);
+			std::atomic<bool> overlapped{ false };
+			threads.run(tasks, [&](size_t task, size_t thread) {
+				if (busy[thread]++ != 0)
+					overlapped = true;
+				++runs[task];
+				--busy[thread];
+			});
+			REQUIRE(!overlapped);
+			for (std::atomic<int>& r : runs)
+				REQUIRE(r == 1);
+		}
+	}
+}
+
+TEST_CASE("Does decoding across a thread pool produce the same audio as decoding on one thread?")
+{
+	std::mt19937 rng{ 99u };
+	std::string data(3u * WAV_SLAB_SIZE + 6u * 1001u, '\0'); // several slabs of 24-bit stereo, and a partial one
+	for (char& b : data)
+		b = (char)rng();
+	std::string fmt{ le(WAV_FORMAT_PCM, 2u) + le(2u, 2u) + le(48000u, 4u) + le(48000u * 6u, 4u) + le(6u, 2u) + le(24u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	std::string bytes{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks };
+	const std::string name{ "parallel.wav" };
+	{
+		std::ofstream file{ name, std::ios::binary };
+		file.write(bytes.data(), (std::streamsize)bytes.size());
+	}
+	size_t frames{ data.size() / 6u };
+
+	std::unique_ptr<std::istream> stream{ new std::istringstream{ bytes } };
+	Waveread serial{ std::move(stream) };
+	Waveread mapped{ name };
+	std::unique_ptr<std::istream> parallelStream{ new std::istringstream{ bytes } };
+	Waveread streamed{ std::move(parallelStream) };
+	Wavefile file{ name };
+	Wavethreads threads{ 4u };
+	const int channels[2]{ 0,1 };
+	for (bool interleaved : { true, false })
+		for (size_t start : { 0u, 12345u })
+		{
+			std::vector<float> expected{ serial.audio(start, frames, { 0,1 }, 0u, interleaved) };
+			std::vector<float> actual(expected.size(), 0.f);
+			for (int source{ 0 }; source < 3; ++source)
+			{
+				std::fill(actual.begin(), actual.end(), 0.f);
+				size_t n{ source == 0 ? mapped.audio(start, frames, actual.data(), actual.size(), channels, 2u, threads, interleaved) :
+					source == 1 ? streamed.audio(start, frames, actual.data(), actual.size(), channels, 2u, threads, interleaved) :
+					file.audio(start, frames, actual.data(), actual.size(), channels, 2u, threads, interleaved) };
+				REQUIRE(n == frames - start);
+				bool same{ actual == expected }; // not compared in REQUIRE, which would print every sample if they differ
+				REQUIRE(same);
+			}
+		}
+	std::remove(name.c_str());
+}
+
+TEST_CASE("Does a resampler give the same audio read in pieces, after a seek, or at the file's own rate, as read all at once?")
+{
+	std::string name{ assetPath + std::string{ supportedFiles[3] } };
+	std::unique_ptr<std::istream> stream{ new std::ifstream{ name } };
+	Waveread wr{ std::move(stream) };
+	REQUIRE(wr.open());
+	size_t fileFrames{ wr.header().samples() };
+	Waveresampler same{ wr, (uint32_t)wr.header().m_24_sampleRate };
+	REQUIRE(same.open());
+	REQUIRE(same.frames() == fileFrames);
+	bool identical{ same.read(fileFrames + 10u) == wr.audio(0u, fileFrames) };
+	REQUIRE(identical);
+
+	std::mt19937 rng{ 18u };
+	for (uint32_t rate : { 48000u, 22050u, 96000u, 44101u })
+	{
+		Waveresampler whole{ wr, rate };
+		std::vector<float> expected{ whole.read(1000000u) };
+		REQUIRE(expected.size() == 2u * whole.frames());
+		REQUIRE(whole.read(1u).empty());
+
+		Waveresampler pieces{ wr, rate };
+		std::vector<float> actual{};
+		for (std::vector<float> piece{ pieces.read(1u) }; !piece.empty(); piece = pieces.read(rng() % 97u))
+			actual.insert(actual.end(), piece.begin(), piece.end());
+		bool joined{ actual == expected };
+		REQUIRE(joined);
+
+		for (uint64_t at : { (uint64_t)0u, (uint64_t)5u, whole.frames() / 3u, whole.frames() - 1u })
+		{
+			pieces.seek(at);
+			std::vector<float> after{ pieces.read(50u) };
+			REQUIRE(pieces.position() == std::min<uint64_t>(at + 50u, whole.frames()));
+			bool sought{ std::equal(after.begin(), after.end(), expected.begin() + 2u * at) };
+			REQUIRE(sought);
+		}
+	}
+}
+
+TEST_CASE("Does a resampler keep tones below the new Nyquist frequency, and remove those above it?")
+{
+	std::unique_ptr<std::istream> up{ new std::istringstream{ sineFile(44100u, 44100u, { 1000.0 }, { 15000.0 }) } };
+	Waveread cd{ std::move(up) };
+	Waveresampler toDat{ cd, 48000u };
+	std::vector<float> dat{ toDat.read(48000u) };
+	REQUIRE(dat.size() == 96000u);
+	double worst{ 0.0 };
+	for (size_t k{ 100u }; k + 100u < 48000u; ++k)
+		for (size_t c{ 0u }; c < 2u; ++c)
+		{
+			double expected{ 0.4 * std::sin(2.0 * 3.14159265358979323846 * (c == 0u ? 1000.0 : 15000.0) * (double)k / 48000.0) };
+			worst = std::max(worst, std::abs((double)dat[2u * k + c] - expected));
+		}
+	REQUIRE(worst < 1e-4);
+
+	std::unique_ptr<std::istream> down{ new std::istringstream{ sineFile(192000u, 96000u, { 1000.0 }, { 30000.0 }) } };
+	Waveread hires{ std::move(down) };
+	Waveresampler toDvd{ hires, 48000u };
+	std::vector<float> dvd{ toDvd.read(24000u) };
+	REQUIRE(dvd.size() == 48000u);
+	double kept{ 0.0 }, removed{ 0.0 };
+	for (size_t k{ 200u }; k + 200u < 24000u; ++k)
+	{
+		kept = std::max(kept, (double)std::abs(dvd[2u * k]));
+		removed = std::max(removed, (double)std::abs(dvd[2u * k + 1u]));
+	}
+	REQUIRE(kept > 0.39);
+	REQUIRE(kept < 0.41);
+	REQUIRE(removed < 1e-4);
+}
+
+TEST_CASE("Does a pool of readers give the same audio as a reader for each file, keeping no more open than its limits allow?")
+{
+	const size_t fileCount{ 12u };
+	std::vector<std::string> names{}, bytes{};
+	for (size_t i{ 0u }; i < fileCount; ++i)
+	{
+		names.push_back("pool" + std::to_string(i) + ".wav");
+		bytes.push_back(sineFile(44100u, 20000u, { 100.0 * (double)(i + 1u) }, { 37.0 * (double)(i + 1u) }));
+		std::ofstream file{ names.back(), std::ios::binary };
+		file.write(bytes.back().data(), (std::streamsize)bytes.back().size());
+	}
+	std::vector<std::unique_ptr<Waveread>> direct{};
+	for (const std::string& b : bytes)
+		direct.emplace_back(new Waveread{ std::unique_ptr<std::istream>{ new std::istringstream{ b } } });
+
+	Wavepool byHandles{ 1024u * 1048576u, 3u, 65536u, 16384u };
+	const size_t budget{ 4u * (65536u + 16384u + 4096u) + 100u }; // four caches, with their spare pages and alignment
+	Wavepool byMemory{ budget, 100u, 65536u, 16384u };
+	REQUIRE(byHandles.limit() == 3u);
+	REQUIRE(byMemory.limit() == 4u);
+	for (Wavepool* pool : { &byHandles, &byMemory })
+	{
+		for (const std::string& name : names)
+			pool->add(name);
+		size_t missing{ pool->add("no such file.wav") };
+		REQUIRE(pool->openReaders() == 0u);
+		REQUIRE(pool->header(5u).samples() == 20000u); // opens only the file asked about
+		REQUIRE(pool->openReaders() == 1u);
+		REQUIRE(!pool->header(missing).valid());
+		REQUIRE(pool->audio(missing, 0u, 10u).empty());
+		REQUIRE(pool->openReaders() == 1u);
+
+		std::mt19937 rng{ 19u };
+		bool same{ true }, withinLimit{ true };
+		for (size_t n{ 0u }; n < 300u; ++n)
+		{
+			size_t id{ rng() % fileCount }, start{ rng() % 20000u }, count{ rng() % 3000u };
+			same = same && pool->audio(id, start, count) == direct[id]->audio(start, count);
+			withinLimit = withinLimit && pool->openReaders() <= pool->limit() && (pool == &byHandles || pool->memoryUsed() <= budget);
+		}
+		REQUIRE(same);
+		REQUIRE(withinLimit);
+		REQUIRE(pool->reopens() > 0u);
+		REQUIRE(pool->evictions() >= pool->reopens());
+
+		std::vector<std::thread> threads{};
+		std::atomic<bool> threadsSame{ true }, threadsWithinBudget{ true };
+		for (unsigned t{ 0u }; t < 4u; ++t)
+			threads.emplace_back([&, t]() {
+				std::mt19937 local{ t };
+				float buffer[2u * 500u];
+				const int channels[2]{ 0,1 };
+				for (size_t n{ 0u }; n < 100u; ++n)
+				{
+					size_t id{ local() % fileCount }, start{ local() % 19000u };
+					size_t frames{ pool->audio(id, start, 500u, buffer, 1000u, channels, 2u) };
+					std::vector<float> expected{ direct[id]->audio(start, 500u) };
+					if (frames != 500u || !std::equal(expected.begin(), expected.end(), buffer))
+						threadsSame = false;
+					if (pool == &byMemory && pool->memoryUsed() > budget) // four threads, but room for three readers: one waits for another to finish
+						threadsWithinBudget = false;
+				}
+			});
+		for (std::thread& t : threads)
+			t.join();
+		REQUIRE(threadsSame);
+		REQUIRE(threadsWithinBudget);
+		REQUIRE(pool->openReaders() <= pool->limit());
+		REQUIRE(pool->memoryUsed() > 0u);
+	}
+	for (const std::string& name : names)
+		std::remove(name.c_str());
+
+	// a reader's footprint counts its spare page, and for ADPCM, its block cache before it is filled
+	Waveread pcm{ std::unique_ptr<std::istream>{ new std::ifstream{ assetPath + std::string{supportedFiles[2]}, std::ios::binary } }, 65536u };
+	Waveread adpcm{ std::unique_ptr<std::istream>{ new std::ifstream{ assetPath + std::string{supportedFiles[9]}, std::ios::binary } }, 65536u };
+	REQUIRE(pcm.footprint() == 0u);
+	REQUIRE(pcm.open());
+	REQUIRE(adpcm.open());
+	REQUIRE(pcm.footprint() > 65536u);
+	REQUIRE(adpcm.footprint() > pcm.footprint() + 65536u / 8u); // about a quarter of the cache, in whole blocks
+}
+
+TEST_CASE("Do the vectorised encoding kernels produce exactly the same bytes as the scalar kernels?")
+{
+	using namespace waveread_detail;
+	std::mt19937 rng{ 2020u };
+	std::uniform_real_distribution<float> uniform{ -1.2f, 1.2f }, dither{ -1.f, 1.f };
+	std::vector<float> samples(4099u), noise(4099u);
+	for (size_t i{ 0u }; i < samples.size(); ++i)
+	{
+		samples[i] = i % 13u == 7u ? std::numeric_limits<float>::quiet_NaN() : uniform(rng);
+		noise[i] = dither(rng);
+	}
+	samples[1] = 1.f;
+	samples[2] = -1.f;
+	for (int bits : { 8, 16, 24, 32 })
+		for (Simd simd : { Simd::sse2, Simd::avx2 })
+			for (const float* n : { (const float*)nullptr, (const float*)noise.data() })
+				for (size_t count : { 0u, 1u, 5u, 9u, 15u, 16u, 17u, 31u, 33u, 67u, 4099u })
+				{
+					std::vector<uint8_t> expected(4u * count + 1u, 0u), actual(4u * count + 1u, 0u);
+					encoder(bits, Simd::none)(samples.data(), n, expected.data(), count);
+					encoder(bits, simd)(samples.data(), n, actual.data(), count);
+					REQUIRE(expected == actual);
+				}
+
+	// int32_t narrowed to 16 and 24 bits, including ties either side of even and the largest samples, which round up past the top of the format.
+	std::vector<int32_t> integers(4099u);
+	for (size_t i{ 0u }; i < integers.size(); ++i)
+		integers[i] = (int32_t)rng();
+	const int32_t edges[]{ std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::min(), 0x7FFFFF80, 0x00018000, 0x00028000, -0x00018000, 0x180, 0x280, -0x180, -1, 0 };
+	std::copy(std::begin(edges), std::end(edges), integers.begin());
+	for (int bits : { 16, 24 })
+		for (Simd simd : { Simd::sse2, Simd::avx2 })
+			for (const float* n : { (const float*)nullptr, (const float*)noise.data() })
+				for (size_t count : { 0u, 1u, 5u, 9u, 15u, 16u, 17u, 31u, 33u, 67u, 4099u })
+				{
+					std::vector<uint8_t> expected(4u * count + 1u, 0u), actual(4u * count + 1u, 0u);
+					(bits == 16 ? &encodePcmAs<int32_t, 16> : &encodePcmAs<int32_t, 24>)(integers.data(), n, expected.data(), count);
+					typedEncoder<int32_t>(bits, simd)(integers.data(), n, actual.data(), count);
+					REQUIRE(expected == actual);
+				}
+	// integers of the format's width are copied as they are
+	std::vector<uint8_t> copied(2u * 64u);
+	std::vector<int16_t> shorts(integers.begin(), integers.begin() + 64);
+	typedEncoder<int16_t>(16)(shorts.data(), nullptr, copied.data(), 64u);
+	REQUIRE(std::memcmp(copied.data(), shorts.data(), copied.size()) == 0);
+	// and narrower integers are shifted up
+	for (int bits : { 24, 32 })
+	{
+		std::vector<uint8_t> expected(4u * 64u, 0u), actual(4u * 64u, 0u);
+		(bits == 24 ? &encodePcmAs<int16_t, 24> : &encodePcmAs<int16_t, 32>)(shorts.data(), nullptr, expected.data(), 64u);
+		typedEncoder<int16_t>(bits)(shorts.data(), nullptr, actual.data(), 64u);
+		REQUIRE(expected == actual);
+	}
+}
+
+TEST_CASE("Does writing audio read from a file, and reading it back, give exactly the same samples?")
+{
+	auto dataOf = [](const std::string& path) {
+		std::unique_ptr<std::istream> stream{ new std::ifstream{ path, std::ios::binary } };
+		Waveread wr{ std::move(stream) };
+		if (!wr.open())
+			return std::string{};
+		std::ifstream file{ path, std::ios::binary };
+		std::string data((size_t)wr.header().m_dataSize, '\0');
+		file.seekg((std::streamoff)wr.header().m_dataOffset);
+		file.read(&data[0], (std::streamsize)data.size());
+		return data;
+	};
+	const std::string name{ "written.wav" };
+	const int channels[2]{ 0,1 };
+	for (auto supported : supportedFiles)
+	{
+		std::string path{ assetPath + std::string{ supported } };
+		std::string original{ dataOf(path) };
+		Waveread wr{ path };
+		REQUIRE(wr.open());
+		const WAV_HEADER& h{ wr.header() };
+		size_t frames{ h.samples() };
+		if (h.format() != WAV_FORMAT_PCM && h.format() != WAV_FORMAT_IEEE_FLOAT)
+			continue; // Wavewrite doesn't encode G.711
+		bool ieee{ h.format() == WAV_FORMAT_IEEE_FLOAT };
+		std::vector<float> floats{ wr.audio(0u, frames) };
+		std::vector<int32_t> integers(2u * frames);
+		std::vector<double> doubles(2u * frames), left(frames), right(frames);
+		double* planar[2]{ left.data(), right.data() };
+		REQUIRE(wr.audio(0u, frames, integers.data(), integers.size(), channels, 2u) == frames);
+		REQUIRE(wr.audio(0u, frames, doubles.data(), doubles.size(), channels, 2u) == frames);
+		REQUIRE(wr.audio(0u, frames, planar, frames, channels, 2u) == frames);
+
+		for (WAV_OUTPUT output : { WAV_OUTPUT::buffered, WAV_OUTPUT::mapped })
+			for (int input{ 0 }; input < 3; ++input)
+			{
+				if (input == 0 && ((h.m_34_bitsPerSample == 32 && !ieee) || h.m_34_bitsPerSample == 64))
+					continue; // floats hold only 24 bits of a 32-bit integer sample, and of a double
+				if (input == 1 && ieee)
+					continue;
+				{
+					Wavewrite ww{ name, (uint32_t)h.m_24_sampleRate, 2u, (uint16_t)h.m_34_bitsPerSample, h.format(), output, WAV_DITHER::none, 65536u };
+					size_t half{ frames / 2u }; // in two calls, planar for the second half of doubles
+					size_t written{ input == 0 ? ww.write(floats.data(), half) + ww.write(floats.data() + 2u * half, frames - half) :
+						input == 1 ? ww.write(integers.data(), half) + ww.write(integers.data() + 2u * half, frames - half) :
+						ww.write(doubles.data(), half) + ww.write((const double* const*)std::array<const double*, 2>{ { left.data() + half, right.data() + half } }.data(), frames - half) };
+					REQUIRE(written == frames);
+					REQUIRE(ww.frames() == frames);
+					REQUIRE(ww.close());
+				}
+				bool same{ dataOf(name) == original };
+				REQUIRE(same);
+				Waveread back{ name };
+				REQUIRE(back.open());
+				bool sameAudio{ back.audio(0u, frames) == floats };
+				REQUIRE(sameAudio);
+			}
+	}
+	std::remove(name.c_str());
+}
+
+TEST_CASE("Does a writer make RF64 files, pad odd sizes, cross windows of the mapping, and dither within one step?")
+{
+	const std::string name{ "written.wav" };
+	std::mt19937 rng{ 20u };
+	std::uniform_real_distribution<float> uniform{ -1.f, 1.f };
+	std::vector<float> samples(3u * 100001u);
+	for (float& s : samples)
+		s = uniform(rng);
+	for (WAV_OUTPUT output : { WAV_OUTPUT::buffered, WAV_OUTPUT::mapped })
+		for (bool rf64 : { false, true })
+		{
+			{
+				Wavewrite ww{ name, 44100u, 3u, 24u, WAV_FORMAT_PCM, output, WAV_DITHER::none, 65536u }; // windows of 64KB hold no whole number of 9-byte frames
+				ww.setRF64(rf64);
+				for (size_t done{ 0u }; done < 100001u; done += 777u)
+					REQUIRE(ww.write(samples.data() + 3u * done, std::min<size_t>(777u, 100001u - done)) == std::min<size_t>(777u, 100001u - done));
+				REQUIRE(ww.close());
+			}
+			Waveread wr{ name };
+			REQUIRE(wr.open());
+			REQUIRE(std::string(wr.header().m_0_headerChunkID, 4u) == (rf64 ? "RF64" : "RIFF"));
+			REQUIRE(wr.header().samples() == 100001u);
+			REQUIRE(wr.header().m_dataSize == 9u * 100001u);
+			std::vector<float> back{ wr.audio(0u, 100001u, { 0,1,2 }) };
+			bool close{ back.size() == samples.size() };
+			for (size_t i{ 0u }; close && i < samples.size(); ++i)
+				close = std::abs(back[i] - samples[i]) <= 0.5f / 8388608.f;
+			REQUIRE(close);
+		}
+
+	std::vector<float> quiet(20001u); // mono 8-bit: an odd number of bytes of audio
+	for (size_t i{ 0u }; i < quiet.size(); ++i)
+		quiet[i] = 0.3f * std::sin((float)i * 0.01f);
+	for (WAV_DITHER dither : { WAV_DITHER::none, WAV_DITHER::triangular })
+	{
+		{
+			Wavewrite ww{ name, 8000u, 1u, 8u, WAV_FORMAT_PCM, WAV_OUTPUT::buffered, dither };
+			REQUIRE(ww.write(quiet) == quiet.size());
+		}
+		std::ifstream file{ name, std::ios::binary | std::ios::ate };
+		REQUIRE((size_t)file.tellg() == 80u + quiet.size() + 1u);
+		Waveread wr{ name };
+		std::vector<float> back{ wr.audio(0u, quiet.size(), { 0 }) };
+		REQUIRE(back.size() == quiet.size());
+		double worst{ 0.0 }, sum{ 0.0 };
+		for (size_t i{ 0u }; i < quiet.size(); ++i)
+		{
+			worst = std::max(worst, (double)std::abs(back[i] - quiet[i]) * 128.0);
+			sum += (double)(back[i] - quiet[i]) * 128.0;
+		}
+		REQUIRE(worst <= (dither == WAV_DITHER::none ? 0.5 : 1.5));
+		REQUIRE(std::abs(sum / (double)quiet.size()) < 0.05);
+	}
+
+	// a writer with no channels writes nothing, whichever way it is given audio
+	Wavewrite none{ name, 8000u, 0u, 16u };
+	REQUIRE(none.write(quiet) == 0u);
+	REQUIRE(none.write(quiet.data(), 10u) == 0u);
+	REQUIRE(!none.open());
+	std::remove(name.c_str());
+}
+
+TEST_CASE("Do A-law and mu-law files decode to the linear samples of G.711, in every sample type?")
+{
+	const int channels[2]{ 0,1 };
+	for (size_t file : { 7u, 8u })
+	{
+		std::string path{ assetPath + std::string{ supportedFiles[file] } };
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::ifstream{ path, std::ios::binary } } };
+		REQUIRE(wr.open());
+		REQUIRE(wr.header().format() == (file == 7u ? WAV_FORMAT_ALAW : WAV_FORMAT_MULAW));
+		size_t frames{ wr.header().samples() };
+		std::vector<float> floats{ wr.audio(0u, frames) };
+		std::vector<int16_t> shorts(2u * frames);
+		std::vector<double> doubles(2u * frames);
+		REQUIRE(floats.size() == 2u * frames);
+		REQUIRE(wr.audio(0u, frames, shorts.data(), shorts.size(), channels, 2u) == frames);
+		REQUIRE(wr.audio(0u, frames, doubles.data(), doubles.size(), channels, 2u) == frames);
+		double worst{ 0.0 };
+		bool same{ true };
+		for (size_t f{ 0u }; f < frames; ++f)
+			for (size_t c{ 0u }; c < 2u; ++c)
+			{
+				double expected{ 0.8 * std::sin(2.0 * 3.14159265358979323846 * (440.0 + 220.0 * (double)c) * (double)f / 44100.0) };
+				worst = std::max(worst, std::abs((double)floats[2u * f + c] - expected));
+				same = same && floats[2u * f + c] == (float)shorts[2u * f + c] / 32768.f && doubles[2u * f + c] == (double)shorts[2u * f + c] / 32768.0;
+			}
+		REQUIRE(worst < 0.02); // half the largest step of either law
+		REQUIRE(same);
+	}
+
+	auto decode = [](uint16_t format, uint8_t byte) {
+		std::string fmt{ le(format, 2u) + le(1u, 2u) + le(8000u, 4u) + le(8000u, 4u) + le(1u, 2u) + le(8u, 2u) };
+		std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", std::string(1u, (char)byte), 1u) };
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::istringstream{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks } } };
+		int16_t sample{ 0 };
+		const int channel{ 0 };
+		wr.audio(0u, 1u, &sample, 1u, &channel, 1u);
+		return sample;
+	};
+	REQUIRE(decode(WAV_FORMAT_ALAW, 0xD5u) == 8);
+	REQUIRE(decode(WAV_FORMAT_ALAW, 0x55u) == -8);
+	REQUIRE(decode(WAV_FORMAT_ALAW, 0xAAu) == 32256);
+	REQUIRE(decode(WAV_FORMAT_ALAW, 0x2Au) == -32256);
+	REQUIRE(decode(WAV_FORMAT_MULAW, 0xFFu) == 0);
+	REQUIRE(decode(WAV_FORMAT_MULAW, 0x80u) == 32124);
+	REQUIRE(decode(WAV_FORMAT_MULAW, 0x00u) == -32124);
+}
+
+TEST_CASE("Do ADPCM files decode to the sine, and does reading anywhere decode only the blocks it touches, once while they stay cached?")
+{
+	const int channels[2]{ 0,1 };
+	for (size_t file : { 9u, 10u })
+	{
+		std::string path{ assetPath + std::string{ supportedFiles[file] } };
+		Waveread mapped{ path };
+		REQUIRE(mapped.open());
+		REQUIRE(mapped.header().format() == (file == 9u ? WAV_FORMAT_IMA_ADPCM : WAV_FORMAT_MS_ADPCM));
+		size_t frames{ mapped.header().samples() };
+		std::vector<float> all{ mapped.audio(0u, frames) };
+		REQUIRE(all.size() == 2u * frames);
+		double worst{ 0.0 };
+		for (size_t f{ 32u }; f < frames; ++f) // once the step has adapted to the signal
+			for (size_t c{ 0u }; c < 2u; ++c)
+				worst = std::max(worst, std::abs((double)all[2u * f + c] - 0.8 * std::sin(2.0 * 3.14159265358979323846 * (440.0 + 220.0 * (double)c) * (double)f / 44100.0)));
+		REQUIRE(worst < 0.03);
+
+		// The asset is a single block. Blocks begin with the decoder's state, so repeating it makes a file of identical blocks, the last of them cut short.
+		std::ifstream in{ path, std::ios::binary };
+		std::string bytes{ std::istreambuf_iterator<char>{ in }, std::istreambuf_iterator<char>{} };
+		const WAV_CHUNK* fmt{ mapped.header().chunk("fmt ") };
+		size_t spb{ mapped.header().m_samplesPerBlock }, align{ (size_t)mapped.header().m_32_bytesPerBlock };
+		std::string block{ bytes.substr((size_t)mapped.header().m_dataOffset, align) }, data{};
+		for (size_t k{ 0u }; k < 6u; ++k)
+			data += block;
+		data += block.substr(0u, 264u);
+		std::string body{ "WAVE" + riffChunk("fmt ", bytes.substr((size_t)fmt->m_offset, (size_t)fmt->m_size), (uint32_t)fmt->m_size) + riffChunk("data", data, (uint32_t)data.size()) };
+		std::string repeated{ riffChunk("RIFF", body, (uint32_t)body.size()) };
+		Waveread whole{ std::unique_ptr<std::istream>{ new std::istringstream{ repeated } } };
+		REQUIRE(whole.open());
+		size_t last{ mapped.header().blockSamples(264u) };
+		REQUIRE(whole.header().samples() == 6u * spb + last);
+		std::vector<float> first{ whole.audio(0u, spb) }, everything{ whole.audio(0u, 7u * spb) };
+		REQUIRE(everything.size() == 2u * (6u * spb + last));
+		for (size_t k{ 0u }; k < 7u; ++k)
+			REQUIRE(std::equal(everything.begin() + 2u * k * spb, everything.begin() + 2u * std::min((k + 1u) * spb, 6u * spb + last), first.begin()));
+
+		Waveread scrub{ std::unique_ptr<std::istream>{ new std::istringstream{ repeated } } };
+		REQUIRE(scrub.audio(3u * spb + 17u, 40u) == std::vector<float>(everything.begin() + 2u * (3u * spb + 17u), everything.begin() + 2u * (3u * spb + 57u)));
+		REQUIRE(scrub.blocksDecoded() == 1u);
+		for (size_t start : { 3u * spb + 200u, 3u * spb, 3u * spb + 5u, 3u * spb + spb - 1u })
+			REQUIRE(scrub.audio(start, 1u) == std::vector<float>(everything.begin() + 2u * start, everything.begin() + 2u * (start + 1u)));
+		REQUIRE(scrub.blocksDecoded() == 1u);
+		std::vector<int16_t> shorts(40u);
+		REQUIRE(scrub.audio(2u * spb - 5u, 20u, shorts.data(), shorts.size(), channels, 2u) == 20u); // crosses from the second block into the third
+		for (size_t i{ 0u }; i < shorts.size(); ++i)
+			REQUIRE((float)shorts[i] / 32768.f == everything[2u * (2u * spb - 5u) + i]);
+		REQUIRE(scrub.blocksDecoded() == 3u);
+		std::vector<float> strided{ scrub.audio(0u, 7u * spb, { 1 }, 9u) };
+		REQUIRE(strided.size() == (6u * spb + last + 9u) / 10u);
+		for (size_t i{ 0u }; i < strided.size(); ++i)
+			REQUIRE(strided[i] == everything[2u * 10u * i + 1u]);
+
+		// threads converting from a block cache of 4 slots for 7 blocks, so that slots are evicted around the ones being read
+		Waveread shared{ std::unique_ptr<std::istream>{ new std::istringstream{ repeated } }, 8192u };
+		std::atomic<size_t> mismatches{ 0u };
+		std::vector<std::thread> threads{};
+		for (unsigned t{ 0u }; t < 8u; ++t)
+			threads.emplace_back([&, t]() {
+				std::mt19937 rng{ t };
+				size_t total{ everything.size() / 2u };
+				for (size_t i{ 0u }; i < 200u; ++i)
+				{
+					size_t start{ rng() % total }, count{ std::min<size_t>(1u + rng() % (2u * spb), total - start) };
+					if (shared.audio(start, count) != std::vector<float>(everything.begin() + 2u * start, everything.begin() + 2u * (start + count)))
+						++mismatches;
+				}
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+		REQUIRE(mismatches == 0u);
+	}
+}
+
+TEST_CASE("Do readers sharing a ring, on many threads, fill their caches with the same audio as a reader of the stream?")
+{
+	for (unsigned entries : { 0u, 8u }) // pread, and io_uring where the kernel allows it
+	{
+		Wavering ring{ entries };
+		if (entries == 0u)
+			REQUIRE(!ring.asynchronous());
+		std::atomic<size_t> mismatches{ 0u };
+		std::vector<std::thread> threads{};
+		for (size_t t{ 0u }; t < 2u * supportedFiles.size(); ++t) // two readers of each file
+			threads.emplace_back([&, t]() {
+				std::string name{ assetPath + std::string{ supportedFiles[t % supportedFiles.size()] } };
+				Waveread plain{ std::unique_ptr<std::istream>{ new std::ifstream{ name, std::ios::binary } } };
+				std::vector<float> expected{ plain.audio(0u, std::numeric_limits<size_t>::max(), { 0,1 }) };
+				Waveread shared{ name, ring, 2048u, 0.5, 256u }; // small pages, so each read fills several
+				std::mt19937 rng{ (unsigned)t };
+				size_t frames{ expected.size() / 2u };
+				for (size_t i{ 0u }; i < 50u; ++i)
+				{
+					size_t start{ rng() % frames }, count{ 1u + rng() % 200u };
+					std::vector<float> audio{ shared.audio(start, count, { 0,1 }) };
+					if (audio.size() != 2u * std::min(count, frames - start) || !std::equal(audio.begin(), audio.end(), expected.begin() + 2u * start))
+						++mismatches;
+				}
+				if (shared.audio(0u, frames, { 0,1 }) != expected)
+					++mismatches;
+				if (shared.stats().ringFallbacks != 0u || shared.stats().ringStopped != 0u)
+					++mismatches;
+			});
+		for (std::thread& thread : threads)
+			thread.join();
+		REQUIRE(mismatches == 0u);
+		REQUIRE((ring.reads() > 0u) == ring.asynchronous());
+		uint8_t buffer[16];
+		REQUIRE(ring.read(-1, 0u, sizeof(buffer), buffer) == -EBADF); // errors come back as numbers, so readers can tell lasting ones
+	}
+}
+
+TEST_CASE("Does a mixdown with gains give the same audio as mixing the audio of every channel, without heap allocation?")
+{
+	// output o of a frame from the audio of every channel, planar, as {C0, C1, ...}
+	auto mixed = [](const std::vector<float>& planar, size_t channels, const std::vector<float>& matrix, const std::vector<float>& gains) {
+		size_t frames{ planar.size() / channels }, outputs{ matrix.size() / channels };
+		std::vector<float> result(frames * outputs);
+		for (size_t f{ 0u }; f < frames; ++f)
+			for (size_t o{ 0u }; o < outputs; ++o)
+			{
+				float sum{ 0.f };
+				for (size_t c{ 0u }; c < channels; ++c)
+					sum += matrix[o * channels + c] * planar[c * frames + f];
+				result[f * outputs + o] = sum * (gains.empty() ? 1.f : gains[o]);
+			}
+		return result;
+	};
+	auto close = [](const std::vector<float>& a, const std::vector<float>& b) {
+		if (a.size() != b.size())
+			return false;
+		for (size_t i{ 0u }; i < a.size(); ++i)
+			if (std::abs(a[i] - b[i]) > 1e-6f)
+				return false;
+		return true;
+	};
+
+	const std::vector<float> mono{ 0.5f, 0.5f }, three{ 1.f, 0.f, 0.f, 1.f, 0.3f, -0.7f }, silent{ 0.f, 0.f, 1.f, 0.f };
+	for (auto supported : supportedFiles)
+	{
+		std::string name{ assetPath + std::string{supported} };
+		Waveread wr{ std::unique_ptr<std::istream>{ new std::ifstream{ name } } };
+		for (size_t stride : { 0u, 3u })
+		{
+			std::vector<float> planar{ wr.audio(32u, 300u, { 0,1 }, stride, false) };
+			REQUIRE(close(wr.mix(32u, 300u, mono, {}, stride), mixed(planar, 2u, mono, {})));
+			REQUIRE(close(wr.mix(32u, 300u, three, { 2.f, 0.5f, 1.f }, stride), mixed(planar, 2u, three, { 2.f, 0.5f, 1.f })));
+			REQUIRE(close(wr.mix(32u, 300u, silent, { 1.f, 0.25f }, stride), mixed(planar, 2u, silent, { 1.f, 0.25f })));
+		}
+		REQUIRE(wr.mix(0u, 10u, { 1.f, 1.f, 1.f }).empty()); // not a whole number of rows
+		REQUIRE(wr.mix(0u, 10u, mono, { 1.f, 1.f }).empty()); // a gain for an output that isn't there
+	}
+
+	// 5.1 to stereo, across several blocks of frames, at the end of the file, and into a buffer that holds fewer frames than asked for.
+	std::mt19937 rng{ 51u };
+	std::string data(6u * 2u * 1001u, '\0');
+	for (char& b : data)
+		b = (char)rng();
+	std::string fmt{ le(WAV_FORMAT_PCM, 2u) + le(6u, 2u) + le(48000u, 4u) + le(48000u * 12u, 4u) + le(12u, 2u) + le(16u, 2u) };
+	std::string chunks{ riffChunk("fmt ", fmt, 16u) + riffChunk("data", data, (uint32_t)data.size()) };
+	Waveread wr{ std::unique_ptr<std::istream>{ new std::istringstream{ "RIFF" + le(4u + chunks.size(), 4u) + "WAVE" + chunks } } };
+	const std::vector<float> stereo{ 1.f, 0.f, 0.7071f, 0.f, 0.7071f, 0.f, 0.f, 1.f, 0.7071f, 0.f, 0.f, 0.7071f }; // L R C LFE Ls Rs, without the LFE
+	const std::vector<float> gains{ 0.5f, 0.5f };
+	for (size_t start : { 0u, 7u, 900u })
+	{
+		std::vector<float> planar{ wr.audio(start, 1001u, { 0,1,2,3,4,5 }, 0u, false) };
+		std::vector<float> expected{ mixed(planar, 6u, stereo, gains) };
+		REQUIRE(close(wr.mix(start, 1001u, stereo, gains), expected));
+
+		std::vector<float> buffer(expected.size() - 3u, 0.f); // room for a frame and a half less than asked for
+		REQUIRE(wr.mix(start, 1001u, buffer.data(), buffer.size(), stereo.data(), 2u, gains.data()) == expected.size() / 2u - 2u);
+		REQUIRE(close(std::vector<float>(buffer.begin(), buffer.end() - 1), std::vector<float>(expected.begin(), expected.end() - 4)));
+	}
+
+	// with a stride, and from threads mixing at once, some of which find the reader's scratch in use
+	std::vector<float> strided{ mixed(wr.audio(5u, 300u, { 0,1,2,3,4,5 }, 2u, false), 6u, stereo, gains) };
+	REQUIRE(close(wr.mix(5u, 300u, stereo, gains, 2u), strided));
+	std::vector<std::vector<float>> results(4u);
+	std::vector<std::thread> threads;
+	for (std::vector<float>& result : results)
+		threads.emplace_back([&wr, &stereo, &gains, &result]() {
+			for (int i{ 0 }; i < 20; ++i)
+				result = wr.mix(5u, 300u, stereo, gains, 2u);
+		});
+	for (std::thread& thread : threads)
+		thread.join();
+	for (const std::vector<float>& result : results)
+		REQUIRE(close(result, strided));
+
+	float buffer[64]{};
+	size_t before{ allocations.load() };
+	size_t frames{ 0u };
+	for (size_t i{ 0u }; i < 64u; ++i)
+		frames += wr.mix(i, 32u, buffer, 64u, stereo.data(), 2u, gains.data());
+	REQUIRE(frames == 64u * 32u);
+	REQUIRE(allocations.load() == before);
+
+	using namespace waveread_detail;
+	std::vector<float> src(67u), base(67u);
+	for (size_t i{ 0u }; i < src.size(); ++i)
+	{
+		src[i] = std::sin((float)i);
+		base[i] = std::cos((float)i);
+	}
+	for (Simd simd : { Simd::sse2, Simd::avx2 })
+		for (size_t count : { 0u, 1u, 7u, 8u, 15u, 16u, 17u, 66u })
+		{
+			std::vector<float> expected{ base }, actual{ base };
+			accumulateKernel(Simd::none)(src.data(), -0.3f, expected.data(), count);
+			accumulateKernel(simd)(src.data(), -0.3f, actual.data(), count);
+			REQUIRE(std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0);
+		}
+}